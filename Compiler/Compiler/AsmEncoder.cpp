@@ -0,0 +1,426 @@
+#include "AsmEncoder.h"
+#include "error.h"
+
+#include <algorithm>
+
+static bool isReg(const AsmOperandPtr& op) {
+    return op && op->getOperandType() == AsmOperandType::Reg;
+}
+
+static bool isXmm(const AsmOperandPtr& op) {
+    if (!isReg(op))
+        return false;
+    AsmRegType reg = static_cast<AsmReg*>(op.get())->getRegType();
+    return reg == XMM0 || reg == XMM1 || reg == XMM2 || reg == XMM3 || reg == XMM4 || reg == XMM5;
+}
+
+static bool isMemory(const AsmOperandPtr& op) {
+    return op && op->getOperandType() == AsmOperandType::Memory;
+}
+
+static bool isInt(const AsmOperandPtr& op) {
+    return op && op->getOperandType() == AsmOperandType::IntImmediate;
+}
+
+static bool isLabel(const AsmOperandPtr& op) {
+    return op && op->getOperandType() == AsmOperandType::StringImmediate;
+}
+
+// nasm reads a label made of digits as a number.
+static bool isNumber(const std::string& label) {
+    return !label.empty() && label.find_first_not_of("0123456789") == std::string::npos;
+}
+
+static i64 getInt(const AsmOperandPtr& op) {
+    return static_cast<AsmIntImmediate*>(op.get())->getValue();
+}
+
+static const std::string& getLabel(const AsmOperandPtr& op) {
+    return static_cast<AsmStringImmediate*>(op.get())->getValue();
+}
+
+// The symbol of the slot holding the address of label; no label can contain
+// the '@'.
+static std::string getAddressSlot(const std::string& label) {
+    return label + "@";
+}
+
+static bool isInt8(i64 value) {
+    return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+static bool isInt32(i64 value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// The register number of the ModRM, SIB and REX fields; al and cl share
+// theirs with rax and rcx.
+static int getRegCode(AsmRegType reg) {
+    switch (reg) {
+        case RAX: case AL: case XMM0: return 0;
+        case RCX: case CL: case XMM1: return 1;
+        case RDX: case XMM2:          return 2;
+        case RBX: case XMM3:          return 3;
+        case RSP: case XMM4:          return 4;
+        case RBP: case XMM5:          return 5;
+        case RSI:                     return 6;
+        case RDI:                     return 7;
+        case R8:                      return 8;
+        case R9:                      return 9;
+        case R10:                     return 10;
+        case R11:                     return 11;
+        default:
+            throw UnencodableCommand(getAsmRegName(reg));
+    }
+}
+
+static int getRegCode(const AsmOperandPtr& op) {
+    return getRegCode(static_cast<AsmReg*>(op.get())->getRegType());
+}
+
+// The condition field of Jcc and SETcc.
+static int getConditionCode(AsmOpType op) {
+    switch (op) {
+        case JB:  case SETB:            return 0x2;
+        case JAE: case SETAE:           return 0x3;
+        case JE:  case JZ:  case SETE:  return 0x4;
+        case JNE: case JNZ: case SETNE: return 0x5;
+        case JBE: case SETBE:           return 0x6;
+        case JA:  case SETA:            return 0x7;
+        case JL:  case SETL:            return 0xC;
+        case JGE: case SETGE:           return 0xD;
+        case JLE: case SETLE:           return 0xE;
+        case JG:  case SETG:            return 0xF;
+        default:
+            throw UnencodableCommand(getAsmOpName(op));
+    }
+}
+
+AsmObject::AsmObject() : dataAlignment(1) {}
+
+// Completes the fixups for the code placed at textAddress, the data at
+// dataAddress and the import slots, in the order of imports, at slotsAddress.
+void AsmObject::link(uint64_t textAddress, uint64_t dataAddress, uint64_t slotsAddress) {
+    for (const AsmFixup& fixup : fixups) {
+        uint64_t target;
+        if (fixup.type == AsmFixupType::ImportSlot32)
+            target = slotsAddress + 8 * getImportIndex(fixup.name);
+        else {
+            auto symbol = symbols.find(fixup.name);
+            if (symbol == symbols.end())
+                throw UndefinedLabel(fixup.name);
+            target = (symbol->second.section == AsmSection::Text ? textAddress : dataAddress) + symbol->second.offset;
+        }
+        target += fixup.addend;
+        int size = fixup.type == AsmFixupType::Absolute64 ? 8 : 4;
+        if (fixup.type != AsmFixupType::Absolute64)
+            target -= textAddress + fixup.offset;
+        for (int i = 0; i < size; ++i)
+            text[fixup.offset + i] = (uint8_t)(target >> (8 * i));
+    }
+}
+
+size_t AsmObject::getImportIndex(const std::string& name) {
+    return std::distance(imports.begin(), imports.find(name));
+}
+
+AsmEncoder::AsmEncoder(AsmObject& object) : _object(object) {}
+
+void AsmEncoder::encode(AsmCmd& cmd) {
+    const AsmOperandPtr& op1 = cmd.getOperand1();
+    const AsmOperandPtr& op2 = cmd.getOperand2();
+    AsmOpType op = cmd.getOpType();
+    switch (op) {
+        case LABEL:
+            _object.symbols[static_cast<AsmLabel&>(cmd).getName()] = { AsmSection::Text, _object.text.size() };
+            return;
+        case ADD: encodeAlu(cmd, 0); return;
+        case OR:  encodeAlu(cmd, 1); return;
+        case AND: encodeAlu(cmd, 4); return;
+        case SUB: encodeAlu(cmd, 5); return;
+        case XOR: encodeAlu(cmd, 6); return;
+        case CMP: encodeAlu(cmd, 7); return;
+        case MOV:
+            encodeMov(cmd);
+            return;
+        case MOVQ:
+            encodeMovq(cmd);
+            return;
+        case TEST:
+            if (isReg(op2)) {
+                emitRM(0, true, 0x85, getRegCode(op2), op1);
+                return;
+            }
+            if (isInt(op2) && isInt32(getInt(op2))) {
+                emitRM(0, true, 0xF7, 0, op1, 4);
+                emitImmediate(getInt(op2), 4);
+                return;
+            }
+            break;
+        case LEA:
+            if (isReg(op1) && isMemory(op2)) {
+                emitRM(0, true, 0x8D, getRegCode(op1), op2);
+                return;
+            }
+            break;
+        case PUSH:
+        case POP:
+            if (isReg(op1)) {
+                int code = getRegCode(op1);
+                if (code >= 8)
+                    emit(0x41);
+                emit((op == PUSH ? 0x50 : 0x58) + (code & 7));
+                return;
+            }
+            if (isMemory(op1)) {
+                emitRM(0, false, op == PUSH ? 0xFF : 0x8F, op == PUSH ? 6 : 0, op1);
+                return;
+            }
+            if (op == PUSH && isInt(op1) && isInt32(getInt(op1))) {
+                bool isShort = isInt8(getInt(op1));
+                emit(isShort ? 0x6A : 0x68);
+                emitImmediate(getInt(op1), isShort ? 1 : 4);
+                return;
+            }
+            if (op == PUSH && isLabel(op1) && !isNumber(getLabel(op1))) {
+                _pushedAddresses.insert(getLabel(op1));
+                emit(0xFF);
+                emit(0x35);
+                emitFixup(getAddressSlot(getLabel(op1)), -4, AsmFixupType::Relative32);
+                return;
+            }
+            break;
+        case MUL:
+        case NEG:
+        case IDIV:
+            if (!op2) {
+                emitRM(0, true, 0xF7, op == MUL ? 4 : op == NEG ? 3 : 7, op1);
+                return;
+            }
+            break;
+        case IMUL:
+            if (!op2) {
+                emitRM(0, true, 0xF7, 5, op1);
+                return;
+            }
+            if (isReg(op1) && isInt(op2) && isInt32(getInt(op2))) {
+                bool isShort = isInt8(getInt(op2));
+                emitRM(0, true, isShort ? 0x6B : 0x69, getRegCode(op1), op1, isShort ? 1 : 4);
+                emitImmediate(getInt(op2), isShort ? 1 : 4);
+                return;
+            }
+            if (isReg(op1) && !isInt(op2)) {
+                emitRM(0, true, 0x0FAF, getRegCode(op1), op2);
+                return;
+            }
+            break;
+        case SHL:
+        case SHR:
+            if (isReg(op2) && static_cast<AsmReg*>(op2.get())->getRegType() == CL) {
+                emitRM(0, true, 0xD3, op == SHL ? 4 : 5, op1);
+                return;
+            }
+            if (isInt(op2)) {
+                emitRM(0, true, 0xC1, op == SHL ? 4 : 5, op1, 1);
+                emitImmediate(getInt(op2), 1);
+                return;
+            }
+            break;
+        case CQO:
+            emit(0x48);
+            emit(0x99);
+            return;
+        case RET:
+            emit(0xC3);
+            return;
+        case CALL:
+            if (isLabel(op1) && _object.imports.count(getLabel(op1))) {
+                emit(0xFF);
+                emit(0x15);
+                emitFixup(getLabel(op1), -4, AsmFixupType::ImportSlot32);
+                return;
+            }
+            encodeJump(0xE8, op1);
+            return;
+        case JMP:
+            encodeJump(0xE9, op1);
+            return;
+        case JE: case JNE: case JL: case JLE: case JGE: case JG:
+        case JB: case JBE: case JAE: case JA: case JZ: case JNZ:
+            encodeJump(0x0F80 + getConditionCode(op), op1);
+            return;
+        case SETE: case SETNE: case SETL: case SETLE: case SETGE:
+        case SETG: case SETB: case SETBE: case SETAE: case SETA:
+            emitRM(0, false, 0x0F90 + getConditionCode(op), 0, op1);
+            return;
+        case MOVZX:
+            emitRM(0, true, 0x0FB6, getRegCode(op1), op2);
+            return;
+        case ADDSD: emitRM(0xF2, false, 0x0F58, getRegCode(op1), op2); return;
+        case MULSD: emitRM(0xF2, false, 0x0F59, getRegCode(op1), op2); return;
+        case SUBSD: emitRM(0xF2, false, 0x0F5C, getRegCode(op1), op2); return;
+        case DIVSD: emitRM(0xF2, false, 0x0F5E, getRegCode(op1), op2); return;
+        case CVTSI2SD:
+            emitRM(0xF2, true, 0x0F2A, getRegCode(op1), op2);
+            return;
+        case COMISD:
+            emitRM(0x66, false, 0x0F2F, getRegCode(op1), op2);
+            return;
+        default:
+            break;
+    }
+    throw UnencodableCommand(cmd.toString());
+}
+
+// Appends a data definition under its name.
+void AsmEncoder::addData(AsmData& data) {
+    _object.symbols[data.getName()] = { AsmSection::Data, _object.data.size() };
+    data.encode(_object.data);
+}
+
+void AsmEncoder::alignData(size_t alignment) {
+    while (_object.data.size() % alignment)
+        _object.data.push_back(0);
+    _object.dataAlignment = std::max(_object.dataAlignment, alignment);
+}
+
+// Calls to an imported function go through the slot the loader fills with
+// its address.
+void AsmEncoder::addImport(const std::string& name) {
+    _object.imports.insert(name);
+}
+
+void AsmEncoder::finish() {
+    while (_object.text.size() % 8)
+        emit(0xCC);
+    for (auto& label : _pushedAddresses) {
+        _object.symbols[getAddressSlot(label)] = { AsmSection::Text, _object.text.size() };
+        emitFixup(label, 0, AsmFixupType::Absolute64);
+    }
+}
+
+// add, or, and, sub, xor and cmp share their encodings and differ in ext,
+// the opcode extension of the immediate forms.
+void AsmEncoder::encodeAlu(AsmCmd& cmd, int ext) {
+    const AsmOperandPtr& op1 = cmd.getOperand1();
+    const AsmOperandPtr& op2 = cmd.getOperand2();
+    if (isReg(op2))
+        emitRM(0, true, ext * 8 + 1, getRegCode(op2), op1);
+    else if (isReg(op1) && isMemory(op2))
+        emitRM(0, true, ext * 8 + 3, getRegCode(op1), op2);
+    else if (isInt(op2) && isInt32(getInt(op2))) {
+        bool isShort = isInt8(getInt(op2));
+        emitRM(0, true, isShort ? 0x83 : 0x81, ext, op1, isShort ? 1 : 4);
+        emitImmediate(getInt(op2), isShort ? 1 : 4);
+    }
+    else
+        throw UnencodableCommand(cmd.toString());
+}
+
+// A label as the source loads its address, which takes a 64-bit immediate
+// like any constant outside 32 bits.
+void AsmEncoder::encodeMov(AsmCmd& cmd) {
+    const AsmOperandPtr& op1 = cmd.getOperand1();
+    const AsmOperandPtr& op2 = cmd.getOperand2();
+    if (isReg(op2))
+        emitRM(0, true, 0x89, getRegCode(op2), op1);
+    else if (isReg(op1) && isMemory(op2))
+        emitRM(0, true, 0x8B, getRegCode(op1), op2);
+    else if (isInt(op2) && isInt32(getInt(op2))) {
+        emitRM(0, true, 0xC7, 0, op1, 4);
+        emitImmediate(getInt(op2), 4);
+    }
+    else if (isReg(op1) && (isInt(op2) || isLabel(op2))) {
+        int code = getRegCode(op1);
+        emit(code >= 8 ? 0x49 : 0x48);
+        emit(0xB8 + (code & 7));
+        if (isInt(op2))
+            emitImmediate(getInt(op2), 8);
+        else if (isNumber(getLabel(op2)))
+            emitImmediate((i64)std::stoull(getLabel(op2)), 8);
+        else
+            emitFixup(getLabel(op2), 0, AsmFixupType::Absolute64);
+    }
+    else
+        throw UnencodableCommand(cmd.toString());
+}
+
+// movq between two xmm registers has its own encoding; otherwise the xmm
+// side is the register operand.
+void AsmEncoder::encodeMovq(AsmCmd& cmd) {
+    const AsmOperandPtr& op1 = cmd.getOperand1();
+    const AsmOperandPtr& op2 = cmd.getOperand2();
+    if (isXmm(op1) && isXmm(op2))
+        emitRM(0xF3, false, 0x0F7E, getRegCode(op1), op2);
+    else if (isXmm(op1))
+        emitRM(0x66, true, 0x0F6E, getRegCode(op1), op2);
+    else if (isXmm(op2))
+        emitRM(0x66, true, 0x0F7E, getRegCode(op2), op1);
+    else
+        throw UnencodableCommand(cmd.toString());
+}
+
+void AsmEncoder::encodeJump(int opcode, const AsmOperandPtr& target) {
+    if (opcode > 0xFF)
+        emit(opcode >> 8);
+    emit(opcode & 0xFF);
+    emitFixup(getLabel(target), -4, AsmFixupType::Relative32);
+}
+
+// Emits an instruction with a ModRM operand: the prefix byte if any, REX when
+// the operation is 64-bit or a register above 7 is involved, the opcode
+// (0x0Fxx for two bytes) and the addressing of rm. immSize is the size of the
+// immediate that follows, which a RIP-relative displacement has to skip.
+void AsmEncoder::emitRM(int prefix, bool isWide, int opcode, int reg, const AsmOperandPtr& rm, int immSize) {
+    int rmCode = 5;
+    int offset = 0;
+    const AsmOperandPtr* base = &rm;
+    if (isMemory(rm)) {
+        AsmMemory* memory = static_cast<AsmMemory*>(rm.get());
+        base = &memory->getBase();
+        offset = memory->getOffset();
+    }
+    if (isReg(*base))
+        rmCode = getRegCode(*base);
+    int rex = (isWide ? 8 : 0) | (reg >= 8 ? 4 : 0) | (rmCode >= 8 ? 1 : 0);
+    if (prefix)
+        emit(prefix);
+    if (rex)
+        emit(0x40 | rex);
+    if (opcode > 0xFF)
+        emit(opcode >> 8);
+    emit(opcode & 0xFF);
+    reg = (reg & 7) << 3;
+    rmCode &= 7;
+    if (isReg(rm)) {
+        emit(0xC0 | reg | rmCode);
+        return;
+    }
+    if (isLabel(*base)) {
+        emit(reg | 5);
+        emitFixup(getLabel(*base), offset - 4 - immSize, AsmFixupType::Relative32);
+        return;
+    }
+    int mod = offset == 0 && rmCode != 5 ? 0x00 : isInt8(offset) ? 0x40 : 0x80;
+    emit(mod | reg | rmCode);
+    if (rmCode == 4)
+        emit(0x24);
+    if (mod == 0x40)
+        emitImmediate(offset, 1);
+    else if (mod == 0x80)
+        emitImmediate(offset, 4);
+}
+
+void AsmEncoder::emitImmediate(i64 value, int size) {
+    for (int i = 0; i < size; ++i)
+        emit((uint8_t)((uint64_t)value >> (8 * i)));
+}
+
+void AsmEncoder::emitFixup(const std::string& name, i64 addend, AsmFixupType type) {
+    _object.fixups.push_back({ _object.text.size(), name, addend, type });
+    emitImmediate(0, type == AsmFixupType::Absolute64 ? 8 : 4);
+}
+
+void AsmEncoder::emit(uint8_t byte) {
+    _object.text.push_back(byte);
+}
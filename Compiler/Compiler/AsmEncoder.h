@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "AsmGen.h"
+
+enum class AsmSection {
+    Text,
+    Data
+};
+
+// How a 32 or 64-bit field referring to a label is completed once the
+// addresses are known. Relative fields hold the target minus the address of
+// the field itself, so the addend already subtracts the distance from the
+// field to the end of the instruction.
+enum class AsmFixupType {
+    Relative32,
+    Absolute64,
+    // The 32-bit field refers to the slot holding the address of an imported
+    // function rather than to the function itself.
+    ImportSlot32
+};
+
+struct AsmFixup {
+    size_t offset;
+    std::string name;
+    i64 addend;
+    AsmFixupType type;
+};
+
+struct AsmSymbol {
+    AsmSection section;
+    size_t offset;
+};
+
+// Machine code and initialized data of a whole program. References to labels
+// are left as fixups in the code, so the sections can be placed anywhere.
+struct AsmObject {
+    AsmObject();
+    void link(uint64_t textAddress, uint64_t dataAddress, uint64_t slotsAddress);
+    size_t getImportIndex(const std::string& name);
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> data;
+    size_t dataAlignment;
+    std::map<std::string, AsmSymbol> symbols;
+    std::set<std::string> imports;
+    std::vector<AsmFixup> fixups;
+};
+
+// Encodes the commands the generators emit into x86-64 machine code. Labels
+// are reached RIP-relative, and an address pushed as a value is loaded from
+// a slot after the code, so only mov of an address holds it in the code.
+// Jumps always take a 32-bit displacement.
+class AsmEncoder {
+public:
+    AsmEncoder(AsmObject& object);
+    void encode(AsmCmd& cmd);
+    void addData(AsmData& data);
+    void alignData(size_t alignment);
+    void addImport(const std::string& name);
+    void finish();
+private:
+    void encodeAlu(AsmCmd& cmd, int ext);
+    void encodeMov(AsmCmd& cmd);
+    void encodeMovq(AsmCmd& cmd);
+    void encodeJump(int opcode, const AsmOperandPtr& target);
+    void emitRM(int prefix, bool isWide, int opcode, int reg, const AsmOperandPtr& rm, int immSize = 0);
+    void emitImmediate(i64 value, int size);
+    void emitFixup(const std::string& name, i64 addend, AsmFixupType type);
+    void emit(uint8_t byte);
+    AsmObject& _object;
+    std::set<std::string> _pushedAddresses;
+};
@@ -1,11 +1,241 @@
 #include "AsmGen.h"
+#include "Peephole.h"
+#include "AsmEncoder.h"
 
-AsmCode::AsmCode() : _labelCount(0), _namesCount(0), _depth(0) {
-    addData("formatInt", "\"%ld\"");
-    addData("formatFloat", "\"%f\"");
-    addData("formatNewLine", "10");
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+
+// Enough digits to read back as the same double; nasm needs the decimal
+// point to tell a float from an integer.
+static std::string toExactString(double value) {
+    std::stringstream sstream;
+    sstream << std::setprecision(17) << value;
+    std::string str = sstream.str();
+    if (str.find('.') == std::string::npos) {
+        size_t exponent = str.find('e');
+        str.insert(exponent == std::string::npos ? str.size() : exponent, ".0");
+    }
+    return str;
 }
 
+static const std::map<AsmOpType, std::string> asmOpNames = {
+    { PUSH,         "push" },
+    { POP,           "pop" },
+    { ADD,           "add" },
+    { SUB,           "sub" },
+    { MUL,           "mul" },
+    { IMUL,         "imul" },
+    { IDIV,         "idiv" },
+    { XOR,           "xor" },
+    { MOV,           "mov" },
+    { CALL,         "call" },
+    { MOVQ,         "movq" },
+    { ADDSD,       "addsd" },
+    { SUBSD,       "subsd" },
+    { DIVSD,       "divsd" },
+    { MULSD,       "mulsd" },
+    { CVTSI2SD, "cvtsi2sd" },
+    { LABEL,       "label" },
+    { CMP,           "cmp" },
+    { JMP,           "jmp" },
+    { JE,             "je" },
+    { JNE,           "jne" },
+    { JL,             "jl" },
+    { JLE,           "jle" },
+    { JGE,           "jge" },
+    { JG,             "jg" },
+    { COMISD,     "comisd" },
+    { JA,             "ja" },
+    { JAE,           "jae" },
+    { JBE,           "jbe" },
+    { JB,             "jb" },
+    { AND,           "and" },
+    { OR,             "or" },
+    { TEST,         "test" },
+    { JZ,             "jz" },
+    { JNZ,           "jnz" },
+    { NEG,           "neg" },
+    { LEA,           "lea" },
+    { RET,           "ret" },
+    { SHL,           "sal" },
+    { SHR,           "shr" },
+    { CQO,           "cqo" },
+    { SETE,         "sete" },
+    { SETNE,       "setne" },
+    { SETL,         "setl" },
+    { SETLE,       "setle" },
+    { SETGE,       "setge" },
+    { SETG,         "setg" },
+    { SETB,         "setb" },
+    { SETBE,       "setbe" },
+    { SETAE,       "setae" },
+    { SETA,         "seta" },
+    { MOVZX,       "movzx" },
+};
+
+static const std::map<AsmRegType, std::string> asmRegNames = {
+    { RAX,   "rax" },
+    { RBX,   "rbx" },
+    { RCX,   "rcx" },
+    { RDX,   "rdx" },
+    { RBP,   "rbp" },
+    { RSP,   "rsp" },
+    { RSI,   "rsi" },
+    { RDI,   "rdi" },
+    { XMM0, "xmm0" },
+    { XMM1, "xmm1" },
+    { CL,     "cl" },
+    { R8,     "r8" },
+    { R9,     "r9" },
+    { R10,   "r10" },
+    { R11,   "r11" },
+    { XMM2, "xmm2" },
+    { XMM3, "xmm3" },
+    { XMM4, "xmm4" },
+    { XMM5, "xmm5" },
+    { AL,     "al" },
+};
+
+// Every command the generators emit has a mnemonic; labels print themselves.
+const std::string& getAsmOpName(AsmOpType op) {
+    return asmOpNames.at(op);
+}
+
+const std::string& getAsmRegName(AsmRegType reg) {
+    return asmRegNames.at(reg);
+}
+
+AsmOpType getSetForJump(AsmOpType jump) {
+    switch (jump) {
+        case JE:  case JZ:  return SETE;
+        case JNE: case JNZ: return SETNE;
+        case JL:            return SETL;
+        case JLE:           return SETLE;
+        case JGE:           return SETGE;
+        case JG:            return SETG;
+        case JB:            return SETB;
+        case JBE:           return SETBE;
+        case JAE:           return SETAE;
+        default:            return SETA;
+    }
+}
+
+AsmOpType getInverseJump(AsmOpType jump) {
+    switch (jump) {
+        case JE:  return JNE;
+        case JNE: return JE;
+        case JZ:  return JNZ;
+        case JNZ: return JZ;
+        case JL:  return JGE;
+        case JGE: return JL;
+        case JLE: return JG;
+        case JG:  return JLE;
+        case JB:  return JAE;
+        case JAE: return JB;
+        case JBE: return JA;
+        default:  return JBE;
+    }
+}
+
+static const char* runtimeFunctions[] = { "pas_write_int", "pas_write_real", "pas_write_str", "pas_writeln" };
+
+static void appendBytes(std::vector<uint8_t>& bytes, uint64_t value, int size) {
+    for (int i = 0; i < size; ++i)
+        bytes.push_back((uint8_t)(value >> (8 * i)));
+}
+
+// The end of main: the program returns 0.
+static std::vector<AsmCmdPtr> getExitCommands() {
+    return {
+        AsmCmdPtr(new AsmCmd(MOV, AsmOperandPtr(new AsmReg(RSP)), AsmOperandPtr(new AsmReg(RBP)))),
+        AsmCmdPtr(new AsmCmd(XOR, AsmOperandPtr(new AsmReg(RAX)), AsmOperandPtr(new AsmReg(RAX)))),
+        AsmCmdPtr(new AsmCmd(RET))
+    };
+}
+
+static AsmCmdPtr makeCmd(AsmOpType op, AsmRegType reg) {
+    return AsmCmdPtr(new AsmCmd(op, AsmOperandPtr(new AsmReg(reg))));
+}
+
+static AsmCmdPtr makeCall(const std::string& function) {
+    return AsmCmdPtr(new AsmCmd(CALL, AsmOperandPtr(new AsmStringImmediate(function))));
+}
+
+// An executable carries its own write functions in place of the runtime
+// library: each passes its argument to printf from the C library with the
+// format of the matching runtime function, whose output printf matches.
+// They are entered 8 bytes below a 16-byte boundary, as after any call, and
+// exit() flushes what printf buffered.
+struct RuntimeFormat {
+    const char* function;
+    const char* name;
+    const char* format;
+};
+
+static const RuntimeFormat runtimeFormats[] = {
+    { "pas_write_int",  "pas_format_int",  "%lld" },
+    { "pas_write_real", "pas_format_real", "%f" },
+    { "pas_write_str",  "pas_format_str",  "%s" },
+    { "pas_writeln",    "pas_format_line", "\n" }
+};
+
+static AsmCmdPtr makeCmd(AsmOpType op, AsmRegType reg, AsmOperandPtr value) {
+    return AsmCmdPtr(new AsmCmd(op, AsmOperandPtr(new AsmReg(reg)), value));
+}
+
+static std::vector<AsmCmdPtr> getRuntimeCommands() {
+    std::vector<AsmCmdPtr> commands;
+    for (const RuntimeFormat& runtime : runtimeFormats) {
+        std::string function = runtime.function;
+        commands.push_back(AsmCmdPtr(new AsmLabel(function)));
+        if (function == "pas_write_real")
+            commands.push_back(makeCmd(MOVQ, XMM0, AsmOperandPtr(new AsmReg(RDI))));
+        else if (function != "pas_writeln")
+            commands.push_back(makeCmd(MOV, RSI, AsmOperandPtr(new AsmReg(RDI))));
+        commands.push_back(makeCmd(MOV, RDI, AsmOperandPtr(new AsmStringImmediate(runtime.name))));
+        commands.push_back(makeCmd(MOV, RAX, AsmOperandPtr(new AsmIntImmediate(function == "pas_write_real"))));
+        commands.push_back(makeCmd(SUB, RSP, AsmOperandPtr(new AsmIntImmediate(8))));
+        commands.push_back(makeCall("printf"));
+        commands.push_back(makeCmd(ADD, RSP, AsmOperandPtr(new AsmIntImmediate(8))));
+        commands.push_back(AsmCmdPtr(new AsmCmd(RET)));
+    }
+    return commands;
+}
+
+static std::vector<AsmCmdPtr> getStartCommands() {
+    return {
+        AsmCmdPtr(new AsmLabel("_start")),
+        makeCall("main"),
+        AsmCmdPtr(new AsmCmd(XOR, AsmOperandPtr(new AsmReg(RDI)), AsmOperandPtr(new AsmReg(RDI)))),
+        makeCall("exit")
+    };
+}
+
+// RBX, RBP, RSI and RDI are the registers the generated code uses that one
+// of the calling conventions preserves. RSP stays 16-byte aligned at the call.
+static std::vector<AsmCmdPtr> getCallCommands() {
+    std::vector<AsmCmdPtr> commands = { AsmCmdPtr(new AsmLabel("_call_main")) };
+    for (AsmRegType reg : { RBX, RBP, RSI, RDI })
+        commands.push_back(makeCmd(PUSH, reg));
+    commands.push_back(AsmCmdPtr(new AsmCmd(SUB, AsmOperandPtr(new AsmReg(RSP)), AsmOperandPtr(new AsmIntImmediate(8)))));
+    commands.push_back(makeCall("main"));
+    commands.push_back(AsmCmdPtr(new AsmCmd(ADD, AsmOperandPtr(new AsmReg(RSP)), AsmOperandPtr(new AsmIntImmediate(8)))));
+    for (AsmRegType reg : { RDI, RSI, RBP, RBX })
+        commands.push_back(makeCmd(POP, reg));
+    commands.push_back(AsmCmdPtr(new AsmCmd(RET)));
+    return commands;
+}
+
+#ifdef _WIN32
+static const AsmTarget hostTarget = AsmTarget::Win64;
+#else
+static const AsmTarget hostTarget = AsmTarget::SysV;
+#endif
+
+AsmCode::AsmCode() : _constAlignment(8), _labelCount(0), _namesCount(0), _depth(0), _backend(AsmBackend::Stack),
+    _target(hostTarget) {}
+
 void AsmCode::addCmd(AsmCmdPtr cmd) {
     _commands.push_back(cmd);
     //std::cout << cmd->toString() << std::endl; //todo delete
@@ -15,7 +245,7 @@ void AsmCode::addCmd(AsmOpType opType, AsmRegType reg) {
     addCmd(AsmCmdPtr(new AsmCmd(opType, AsmOperandPtr(new AsmReg(reg)))));
 }
 
-void AsmCode::addCmd(AsmOpType opType, AsmRegType reg, int val) {
+void AsmCode::addCmd(AsmOpType opType, AsmRegType reg, i64 val) {
     addCmd(AsmCmdPtr(new AsmCmd(opType, AsmOperandPtr(new AsmReg(reg)), AsmOperandPtr(new AsmIntImmediate(val)))));
 }
 
@@ -34,25 +264,104 @@ std::string AsmCode::genVarName() {
 std::string AsmCode::toString() {
     std::stringstream sstream;
     sstream << "global  main" << std::endl;
-    sstream << "extern  printf" << std::endl;
+    for (const char* function : runtimeFunctions)
+        sstream << "extern  " << function << std::endl;
     sstream << "section .text" << std::endl;
     //sstream << "\tmov rbp, rsp" << std::endl;
     for (auto command : _commands) {
         sstream << command->toString() << std::endl;
     }
-    sstream << "\tmov rsp, rbp" << std::endl;
-    sstream << "\txor rax, rax" << std::endl;
-    sstream << "\tret" << std::endl;
+    for (auto command : getExitCommands())
+        sstream << command->toString() << std::endl;
 
     sstream << "section .data" << std::endl;
+    // Pooled reals come first, each on an alignment boundary; at 8 bytes
+    // one align keeps the whole run aligned.
+    for (size_t i = 0; i < _realConsts.size(); ++i) {
+        if (i == 0 || _constAlignment > 8)
+            sstream << "\talign " << _constAlignment << std::endl;
+        sstream << _realConsts[i]->toString() << std::endl;
+    }
     for (auto asmData : _data) {
         sstream << asmData->toString() << std::endl;
     }
+    if (_target == AsmTarget::SysV)
+        sstream << "section .note.GNU-stack noalloc noexec nowrite progbits" << std::endl;
     return sstream.str();
 }
 
-std::string AsmCode::getVarName(std::string& name) {
-    return "v_" + name;
+// Encodes the same program as toString, followed by the entry point. Called
+// from the compiler, the program uses the runtime linked into it; as an
+// executable, it needs nothing but the C library.
+void AsmCode::assemble(AsmObject& object, AsmEntry entry) {
+    AsmEncoder encoder(object);
+    bool isExecutable = entry == AsmEntry::Executable;
+    if (isExecutable) {
+        encoder.addImport("printf");
+        encoder.addImport("exit");
+    }
+    else {
+        for (const char* function : runtimeFunctions)
+            encoder.addImport(function);
+    }
+    for (auto command : _commands)
+        encoder.encode(*command);
+    for (auto command : getExitCommands())
+        encoder.encode(*command);
+    for (auto command : isExecutable ? getStartCommands() : getCallCommands())
+        encoder.encode(*command);
+    if (isExecutable) {
+        for (auto command : getRuntimeCommands())
+            encoder.encode(*command);
+    }
+    encoder.finish();
+    for (size_t i = 0; i < _realConsts.size(); ++i) {
+        if (i == 0 || _constAlignment > 8)
+            encoder.alignData(_constAlignment);
+        encoder.addData(*_realConsts[i]);
+    }
+    for (auto asmData : _data)
+        encoder.addData(*asmData);
+    if (isExecutable) {
+        for (const RuntimeFormat& runtime : runtimeFormats) {
+            AsmStringData format(runtime.name, std::string("\"") + runtime.format + "\"");
+            encoder.addData(format);
+        }
+    }
+}
+
+void AsmCode::optimize(Peephole& peephole) {
+    peephole.run(_commands);
+}
+
+void AsmCode::setBackend(AsmBackend backend) {
+    _backend = backend;
+}
+
+AsmBackend AsmCode::getBackend() {
+    return _backend;
+}
+
+void AsmCode::setTarget(AsmTarget target) {
+    _target = target;
+}
+
+AsmTarget AsmCode::getTarget() {
+    return _target;
+}
+
+// The platform the compiler itself runs on.
+AsmTarget AsmCode::getHostTarget() {
+    return hostTarget;
+}
+
+// Name ids are global to the process, so the cache holds only the names
+// this program uses.
+const std::string& AsmCode::getVarName(int nameId) {
+    auto& name = _varNames[nameId];
+    if (name.empty())
+        name = "v_" + NameTable::getText(nameId);
+    return name;
 }
 
 void AsmCode::addLabel(std::string& labelName) {
@@ -63,7 +372,7 @@ void AsmCode::addData(std::string name, std::string value) {
     _data.push_back(AsmDataPtr(new AsmStringData(name, value)));
 }
 
-void AsmCode::addData(std::string name, int value) {
+void AsmCode::addData(std::string name, i64 value) {
     _data.push_back(AsmDataPtr(new AsmIntData(name, value)));
 }
 
@@ -75,30 +384,60 @@ void AsmCode::addArrayData(std::string name, int size) {
     _data.push_back(AsmDataPtr(new AsmArrayData(name, size)));
 }
 
+// Returns the name of a pooled dq holding value, adding it on first use.
+std::string AsmCode::addRealConst(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto it = _realNames.find(bits);
+    if (it != _realNames.end())
+        return it->second;
+    std::string name = genVarName();
+    _realConsts.push_back(AsmDataPtr(new AsmFloatData(name, value)));
+    _realNames[bits] = name;
+    return name;
+}
+
+// Returns the name of a pooled zero-terminated string, adding it on first
+// use. value is the text between the quotes.
+std::string AsmCode::addStringConst(const std::string& value) {
+    auto it = _stringNames.find(value);
+    if (it != _stringNames.end())
+        return it->second;
+    std::string name = genVarName();
+    addData(name, "\"" + value + "\"");
+    _stringNames[value] = name;
+    return name;
+}
+
+// Alignment in bytes of every pooled real: 8 suits movq and movsd, 16 lets
+// a constant be loaded with an aligned 16-byte SSE load.
+void AsmCode::setConstAlignment(int alignment) {
+    _constAlignment = alignment;
+}
+
+int AsmCode::getConstAlignment() {
+    return _constAlignment;
+}
+
+// write and writeln go to the buffered output runtime (Runtime/pasrt.c).
+// The value to write is on the stack.
 void AsmCode::addWriteInt() {
-    addCmd(POP, RAX);
-    addCmd(MOV, RDX, RAX);
-    addCmd(XOR, RAX, RAX);
-    addWrite("formatInt");
+    addCmd(POP, getArgumentReg());
+    addRuntimeCall("pas_write_int");
 }
 
 void AsmCode::addWriteFloat() {
-    addCmd(POP, RAX);
-    addCmd(MOV, RDX, RAX);
-    addCmd(XOR, RAX, RAX);
-    addWrite("formatFloat");
+    addCmd(POP, getArgumentReg());
+    addRuntimeCall("pas_write_real");
 }
 
 void AsmCode::addWriteString(std::string str) {
-    std::string name = genVarName();
-    addData(name, "\"" + str + "\"");
-    addCmd(XOR, RAX, RAX);
-    addWrite(name);
+    addCmd(MOV, getArgumentReg(), addStringConst(str));
+    addRuntimeCall("pas_write_str");
 }
 
 void AsmCode::addWriteln() {
-    addCmd(XOR, RAX, RAX);
-    addWrite("formatNewLine");
+    addRuntimeCall("pas_writeln");
 }
 
 void AsmCode::addLoopLabels(std::string _continue, std::string _break) {
@@ -127,11 +466,27 @@ AsmOperandPtr AsmCode::getAdressOperand(AsmRegType reg, int offset) {
     return AsmOperandPtr(new AsmMemory(reg, offset));
 }
 
-void AsmCode::addWrite(std::string format) {
-    addCmd(MOV, RCX, format);
-    addCmd(SUB, RSP, 8 * 4);
-    addCmd(CALL, "printf");
-    addCmd(ADD, RSP, 8 * 4);
+// Calls a runtime function with the 32 bytes of shadow space the Win64
+// convention reserves for the callee. System V needs RSP aligned to 16 at
+// the call, which the stack machine does not track, so the old RSP is saved
+// twice below the aligned top and reloaded from there afterwards.
+void AsmCode::addRuntimeCall(std::string function) {
+    if (_target == AsmTarget::Win64) {
+        addCmd(SUB, RSP, 8 * 4);
+        addCmd(CALL, function);
+        addCmd(ADD, RSP, 8 * 4);
+        return;
+    }
+    addCmd(MOV, RAX, RSP);
+    addCmd(AND, RSP, -16);
+    addCmd(PUSH, RAX);
+    addCmd(PUSH, RAX);
+    addCmd(CALL, function);
+    addCmd(MOV, RSP, getAdressOperand(RSP));
+}
+
+AsmRegType AsmCode::getArgumentReg() {
+    return _target == AsmTarget::Win64 ? RCX : RDI;
 }
 
 void AsmCode::addCmd(AsmOpType opType, std::string data) {
@@ -167,11 +522,11 @@ AsmCmdType AsmCmd::getCmdType() {
     return AsmCmdType::Cmd;
 }
 
-AsmOperandPtr AsmCmd::getOperand1() {
+const AsmOperandPtr& AsmCmd::getOperand1() {
     return _op1;
 }
 
-AsmOperandPtr AsmCmd::getOperand2() {
+const AsmOperandPtr& AsmCmd::getOperand2() {
     return _op2;
 }
 
@@ -180,7 +535,7 @@ int AsmCmd::getOperands() {
 }
 
 std::string AsmCmd::toString() {
-    std::string str = "\t" + asmOpNames[_opType];
+    std::string str = "\t" + getAsmOpName(_opType);
     str += _operands > 1 ? " " + _op1->toString() : "";
     str += _operands > 2 ? ", " + _op2->toString() : "";
     return str;
@@ -196,6 +551,10 @@ AsmCmdType AsmLabel::getCmdType() {
     return AsmCmdType::Label;
 }
 
+const std::string& AsmLabel::getName() {
+    return _name;
+}
+
 bool AsmImmediate::isImmediate() {
     return true;
 }
@@ -204,7 +563,7 @@ bool AsmOperand::isImmediate() {
     return false;
 }
 
-AsmIntImmediate::AsmIntImmediate(int value) : _value(value) {}
+AsmIntImmediate::AsmIntImmediate(i64 value) : _value(value) {}
 
 std::string AsmIntImmediate::toString() {
     return std::to_string(_value);
@@ -214,10 +573,16 @@ AsmOperandType AsmIntImmediate::getOperandType() {
     return AsmOperandType::IntImmediate;
 }
 
-int AsmIntImmediate::getValue() {
+i64 AsmIntImmediate::getValue() {
     return _value;
 }
 
+// Only mov takes a full 64-bit immediate; every other command sign-extends
+// a 32-bit one.
+bool AsmIntImmediate::isInt32() {
+    return _value >= INT32_MIN && _value <= INT32_MAX;
+}
+
 AsmStringImmediate::AsmStringImmediate(std::string value) : _value(value) {}
 
 std::string AsmStringImmediate::toString() {
@@ -228,36 +593,67 @@ AsmOperandType AsmStringImmediate::getOperandType() {
     return AsmOperandType::StringImmediate;
 }
 
+const std::string& AsmStringImmediate::getValue() {
+    return _value;
+}
+
 AsmData::AsmData(std::string name) : _name(name) {}
 
+const std::string& AsmData::getName() {
+    return _name;
+}
+
 AsmArrayData::AsmArrayData(std::string name, int size) : AsmData(name), _size(size) {}
 
 std::string AsmArrayData::toString() {
     return "\t" + _name + ": times " + std::to_string(_size) + " db 0";
 }
 
+void AsmArrayData::encode(std::vector<uint8_t>& bytes) {
+    bytes.insert(bytes.end(), _size, 0);
+}
+
 AsmFloatData::AsmFloatData(std::string name, double value) : AsmData(name), _value(value) {}
 
 std::string AsmFloatData::toString() {
-    return "\t" + _name + ": dq " + std::to_string(_value);
+    return "\t" + _name + ": dq " + toExactString(_value);
 }
 
-AsmIntData::AsmIntData(std::string name, int value) : AsmData(name), _value(value) {}
+void AsmFloatData::encode(std::vector<uint8_t>& bytes) {
+    uint64_t bits;
+    std::memcpy(&bits, &_value, sizeof(bits));
+    appendBytes(bytes, bits, 8);
+}
+
+AsmIntData::AsmIntData(std::string name, i64 value) : AsmData(name), _value(value) {}
 
 std::string AsmIntData::toString() {
     return "\t" + _name + ": dq " + std::to_string(_value);
 }
 
+void AsmIntData::encode(std::vector<uint8_t>& bytes) {
+    appendBytes(bytes, (uint64_t)_value, 8);
+}
+
 AsmStringData::AsmStringData(std::string name, std::string value) : AsmData(name), _value(value) {}
 
 std::string AsmStringData::toString() {
     return "\t" + _name + ": db " + _value + ", 0";
 }
 
+// The value is nasm text; a quoted string stands for the characters between
+// the quotes, which nasm takes as they are.
+void AsmStringData::encode(std::vector<uint8_t>& bytes) {
+    bool isQuoted = _value.size() >= 2 && _value.front() == '"' && _value.back() == '"';
+    std::string text = isQuoted ? _value.substr(1, _value.size() - 2) : _value;
+    bytes.insert(bytes.end(), text.begin(), text.end());
+    bytes.push_back(0);
+}
+
 AsmReg::AsmReg(AsmRegType reg) : _reg(reg) {}
 
 std::string AsmReg::toString() {
-    return asmRegNames[_reg];
+    return getAsmRegName(_reg);
 }
 
 AsmOperandType AsmReg::getOperandType() {
@@ -281,3 +677,11 @@ std::string AsmMemory::toString() {
 AsmOperandType AsmMemory::getOperandType() {
     return AsmOperandType::Memory;
 }
+
+const AsmOperandPtr& AsmMemory::getBase() {
+    return _operand;
+}
+
+int AsmMemory::getOffset() {
+    return _offset;
+}
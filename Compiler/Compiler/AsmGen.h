@@ -3,9 +3,13 @@
 //#include <set>
 #include <map>
 #include <memory>
+#include <unordered_map>
+#include <cstdint>
 #include <string>
 #include <sstream>
 #include <iostream>
+#include "NameTable.h"
+#include "Const.h"
 
 enum AsmRegType {
     RAX,
@@ -18,7 +22,16 @@ enum AsmRegType {
     RDI,
     XMM0,
     XMM1,
-    CL
+    CL,
+    R8,
+    R9,
+    R10,
+    R11,
+    XMM2,
+    XMM3,
+    XMM4,
+    XMM5,
+    AL
 };
 
 enum AsmOpType {
@@ -63,64 +76,29 @@ enum AsmOpType {
     RET,
     SHL,
     SHR,
+    CQO,
+    SETE,
+    SETNE,
+    SETL,
+    SETLE,
+    SETGE,
+    SETG,
+    SETB,
+    SETBE,
+    SETAE,
+    SETA,
+    MOVZX,
 };
 
-static std::map<AsmOpType, std::string> asmOpNames = {
-    { PUSH,         "push" },
-    { POP,           "pop" },
-    { ADD,           "add" },
-    { SUB,           "sub" },
-    { MUL,           "mul" },
-    { IMUL,         "imul" },
-    { IDIV,         "idiv" },
-    { XOR,           "xor" },
-    { MOV,           "mov" },
-    { CALL,         "call" },
-    { MOVQ,         "movq" },
-    { ADDSD,       "addsd" },
-    { SUBSD,       "subsd" },
-    { DIVSD,       "divsd" },
-    { MULSD,       "mulsd" },
-    { CVTSI2SD, "cvtsi2sd" },
-    { LABEL,       "label" },
-    { CMP,           "cmp" },
-    { JMP,           "jmp" },
-    { JE,             "je" },
-    { JNE,           "jne" },
-    { JL,             "jl" },
-    { JLE,           "jle" },
-    { JGE,           "jge" },
-    { JG,             "jg" },
-    { COMISD,     "comisd" },
-    { JA,             "ja" },
-    { JAE,           "jae" },
-    { JBE,           "jbe" },
-    { JB,             "jb" },
-    { AND,           "and" },
-    { OR,             "or" },
-    { TEST,         "test" },
-    { JZ,             "jz" },
-    { JNZ,           "jnz" },
-    { NEG,           "neg" },
-    { LEA,           "lea" },
-    { RET,           "ret" },
-    { SHL,           "sal" },
-    { SHR,           "shr" },
-};
+// Mnemonic of the command and name of the register as the listing spells
+// them.
+const std::string& getAsmOpName(AsmOpType op);
+const std::string& getAsmRegName(AsmRegType reg);
 
-static std::map<AsmRegType, std::string> asmRegNames = {
-    { RAX,   "rax" },
-    { RBX,   "rbx" },
-    { RCX,   "rcx" },
-    { RDX,   "rdx" },
-    { RBP,   "rbp" },
-    { RSP,   "rsp" },
-    { RSI,   "rsi" },
-    { RDI,   "rdi" },
-    { XMM0, "xmm0" },
-    { XMM1, "xmm1" },
-    { CL,     "cl" },
-};
+// The SETcc that stores 1 exactly when the conditional jump would be taken.
+AsmOpType getSetForJump(AsmOpType jump);
+// The conditional jump taken exactly when the given one is not.
+AsmOpType getInverseJump(AsmOpType jump);
 
 enum class AsmCmdType {
     Cmd,
@@ -154,12 +132,13 @@ public:
 
 class AsmIntImmediate : public AsmImmediate {
 public:
-    AsmIntImmediate(int value);
+    AsmIntImmediate(i64 value);
     std::string toString() override;
     AsmOperandType getOperandType() override;
-    int getValue();
+    i64 getValue();
+    bool isInt32();
 private:
-    int _value;
+    i64 _value;
 };
 
 class AsmStringImmediate : public AsmImmediate {
@@ -167,6 +146,7 @@ public:
     AsmStringImmediate(std::string value);
     std::string toString() override;
     AsmOperandType getOperandType() override;
+    const std::string& getValue();
 private:
     std::string _value;
 };
@@ -187,6 +167,8 @@ public:
     AsmMemory(AsmRegType reg, int offset = 0);
     std::string toString() override;
     AsmOperandType getOperandType() override;
+    const AsmOperandPtr& getBase();
+    int getOffset();
 private:
     AsmOperandPtr _operand;
     int _offset;
@@ -198,8 +180,8 @@ public:
     AsmCmd(AsmOpType opType, AsmOperandPtr op1 = AsmOperandPtr(), AsmOperandPtr op2 = AsmOperandPtr());
     virtual AsmOpType getOpType();
     virtual AsmCmdType getCmdType();
-    AsmOperandPtr getOperand1();
-    AsmOperandPtr getOperand2();
+    const AsmOperandPtr& getOperand1();
+    const AsmOperandPtr& getOperand2();
     int getOperands();
     virtual std::string toString();
 private:
@@ -213,6 +195,9 @@ class AsmData {
 public:
     AsmData(std::string name);
     virtual std::string toString() = 0;
+    // Appends the bytes the definition assembles to.
+    virtual void encode(std::vector<uint8_t>& bytes) = 0;
+    const std::string& getName();
 protected:
     std::string _name;
 };
@@ -222,6 +207,7 @@ class AsmArrayData : public AsmData {
 public:
     AsmArrayData(std::string name, int size);
     std::string toString() override;
+    void encode(std::vector<uint8_t>& bytes) override;
 private:
     int _size;
 };
@@ -230,22 +216,25 @@ class AsmFloatData : public AsmData {
 public:
     AsmFloatData(std::string name, double value);
     std::string toString() override;
+    void encode(std::vector<uint8_t>& bytes) override;
 private:
     double _value;
 };
 
 class AsmIntData : public AsmData {
 public:
-    AsmIntData(std::string name, int value);
+    AsmIntData(std::string name, i64 value);
     std::string toString() override;
+    void encode(std::vector<uint8_t>& bytes) override;
 private:
-    int _value;
+    i64 _value;
 };
 
 class AsmStringData : public AsmData {
 public:
     AsmStringData(std::string name, std::string value);
     std::string toString() override;
+    void encode(std::vector<uint8_t>& bytes) override;
 private:
     std::string _value;
 };
@@ -257,16 +246,46 @@ public:
     AsmLabel(std::string name);
     std::string toString() override;
     AsmCmdType getCmdType() override;
+    const std::string& getName();
 private:
     std::string _name;
 };
 
+// Code generation strategy for expressions: the stack machine pushes every
+// intermediate value, the register backend evaluates whole expression trees
+// in registers (see RegisterGen).
+enum class AsmBackend {
+    Stack,
+    Register
+};
+
+// Platform the program is assembled, linked and run for. Only calls into the
+// output runtime depend on it: Win64 passes the argument in RCX behind 32
+// bytes of shadow space, System V AMD64 (Linux) in RDI with RSP 16-byte
+// aligned at the call.
+enum class AsmTarget {
+    Win64,
+    SysV
+};
+
+// How assemble lets the program be entered. An executable starts at _start,
+// which calls main and leaves through the C library's exit. A caller inside
+// the compiler enters at _call_main, which keeps the registers main changes
+// but the caller relies on.
+enum class AsmEntry {
+    Executable,
+    Call
+};
+
+class Peephole;
+struct AsmObject;
+
 class AsmCode {
 public:
     AsmCode();
     void addCmd(AsmCmdPtr cmd);
     void addCmd(AsmOpType opType, AsmRegType reg);
-    void addCmd(AsmOpType opType, AsmRegType reg, int val);
+    void addCmd(AsmOpType opType, AsmRegType reg, i64 val);
     void addCmd(AsmOpType opType, AsmRegType reg1, AsmRegType reg2);
     void addCmd(AsmOpType opType, std::string data);
     void addCmd(AsmOpType opType, AsmRegType reg, std::string value);
@@ -276,12 +295,23 @@ public:
     std::string genLabelName();
     std::string genVarName();
     std::string toString();
-    std::string getVarName(std::string& name);
+    void assemble(AsmObject& object, AsmEntry entry);
+    void optimize(Peephole& peephole);
+    void setBackend(AsmBackend backend);
+    AsmBackend getBackend();
+    void setTarget(AsmTarget target);
+    AsmTarget getTarget();
+    static AsmTarget getHostTarget();
+    const std::string& getVarName(int nameId);
     void addLabel(std::string& labelName);
     void addData(std::string name, std::string value);
-    void addData(std::string name, int value);
+    void addData(std::string name, i64 value);
     void addData(std::string name, double value);
     void addArrayData(std::string name, int size);
+    std::string addRealConst(double value);
+    std::string addStringConst(const std::string& value);
+    void setConstAlignment(int alignment);
+    int getConstAlignment();
     void addWriteInt();
     void addWriteFloat();
     void addWriteString(std::string str);
@@ -293,12 +323,22 @@ public:
     AsmOperandPtr getAdressOperand(std::string name, int offset = 0);
     AsmOperandPtr getAdressOperand(AsmRegType reg, int offset = 0);
 private:
-    void addWrite(std::string format);
+    void addRuntimeCall(std::string function);
+    AsmRegType getArgumentReg();
     std::vector<AsmCmdPtr> _commands;
     std::vector<AsmDataPtr> _data;
+    // Constant pool: each distinct literal is emitted once, reals keyed by
+    // their bit pattern so that 0.0 and -0.0 stay apart.
+    std::vector<AsmDataPtr> _realConsts;
+    std::map<uint64_t, std::string> _realNames;
+    std::map<std::string, std::string> _stringNames;
+    int _constAlignment;
     std::vector<std::string> _breakLabels;
     std::vector<std::string> _continueLabels;
+    std::unordered_map<int, std::string> _varNames;
     int _labelCount;
     int _namesCount;
     int _depth;
+    AsmBackend _backend;
+    AsmTarget _target;
 };
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "BatchCompiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sys/stat.h>
+
+// The source name with its extension replaced by .asm.
+static std::string getListingName(const std::string& fileName) {
+    size_t dot = fileName.rfind('.');
+    size_t slash = fileName.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = fileName.size();
+    return fileName.substr(0, dot) + ".asm";
+}
+
+static std::string readSource(const std::string& fileName) {
+    std::ifstream fin(fileName, std::ios::binary);
+    if (fin.fail())
+        throw MissingFile(fileName);
+    return std::string(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+}
+
+static void writeListing(const std::string& fileName, const std::string& listing) {
+    std::ofstream out(fileName);
+    if (!out)
+        throw UnwritableFile(fileName);
+    out << listing;
+}
+
+static size_t getFileSize(const std::string& fileName) {
+    struct stat info;
+    return stat(fileName.c_str(), &info) ? 0 : (size_t)info.st_size;
+}
+
+BatchCompiler::BatchCompiler(const std::function<void(Parser&)>& setUp, unsigned threads) :
+    _setUp(setUp), _cache(nullptr), _pool(threads) {}
+
+void BatchCompiler::addFile(const std::string& fileName) {
+    _files.push_back(fileName);
+}
+
+// A response file names one source file per line; empty lines are skipped.
+void BatchCompiler::addResponseFile(const std::string& fileName) {
+    std::ifstream fin(fileName);
+    if (fin.fail())
+        throw MissingFile(fileName);
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (!line.empty())
+            _files.push_back(line);
+    }
+}
+
+void BatchCompiler::setCache(CompileCache* cache) {
+    _cache = cache;
+}
+
+// The listing of the file, from the cache when it has one for the source and
+// options. Listings of files with errors are not cached.
+std::string BatchCompiler::compile(const std::string& fileName, const std::string& options) {
+    if (!_cache) {
+        Parser parser(fileName.c_str());
+        _setUp(parser);
+        return parser.getListing();
+    }
+    std::string source = readSource(fileName);
+    std::string key = _cache->getKey(source, options);
+    std::string listing;
+    if (!_cache->load(key, listing)) {
+        Parser parser(source.data(), source.size(), true);
+        _setUp(parser);
+        listing = parser.getListing();
+        _cache->store(key, listing);
+    }
+    return listing;
+}
+
+// Larger files start first, so that no thread is left with a long file when
+// the others are done. Returns whether every file compiled.
+bool BatchCompiler::run(std::ostream& out) {
+    std::vector<size_t> order(_files.size());
+    std::vector<size_t> sizes(_files.size());
+    for (size_t i = 0; i < _files.size(); ++i) {
+        order[i] = i;
+        sizes[i] = getFileSize(_files[i]);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+    // Every file is set up alike, so the options of an empty program do.
+    std::string options;
+    if (_cache) {
+        Parser parser("", 0, true);
+        _setUp(parser);
+        options = parser.getCodeOptions();
+    }
+
+    std::vector<std::string> errors(_files.size());
+    auto start = std::chrono::steady_clock::now();
+    _pool.run(order.size(), [&](size_t i) {
+        const std::string& fileName = _files[order[i]];
+        try {
+            writeListing(getListingName(fileName), compile(fileName, options));
+        }
+        catch (const BaseException& e) {
+            errors[order[i]] = e.what();
+        }
+        catch (const std::exception& e) {
+            errors[order[i]] = e.what();
+        }
+        catch (...) {
+            errors[order[i]] = "Unexpected error.";
+        }
+    });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    size_t failed = 0;
+    for (size_t i = 0; i < _files.size(); ++i) {
+        if (errors[i].empty())
+            continue;
+        out << _files[i] << ": " << errors[i] << std::endl;
+        ++failed;
+    }
+    out << _files.size() << " files, " << failed << " failed: " << (long long)(elapsed.count() * 1e3)
+        << " ms on " << _pool.getThreads() << " threads" << std::endl;
+    if (_cache) {
+        _cache->trim();
+        out << _cache->getStatsString() << std::endl;
+    }
+    return failed == 0;
+}
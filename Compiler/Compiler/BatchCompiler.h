@@ -0,0 +1,30 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Parser.h"
+#include "ThreadPool.h"
+#include "CompileCache.h"
+
+// Compiles many programs in one process (see main.cpp). Every file gets its
+// own Parser on one of the pool's threads, set up by the given function, and
+// its listing is written next to it: name.asm for name.pas. An error stops
+// only the file it is in; errors are printed in the order the files were
+// given. With a cache, a file whose listing is cached is neither scanned
+// nor parsed.
+class BatchCompiler {
+public:
+    BatchCompiler(const std::function<void(Parser&)>& setUp, unsigned threads = 0);
+    void addFile(const std::string& fileName);
+    void addResponseFile(const std::string& fileName);
+    void setCache(CompileCache* cache);
+    bool run(std::ostream& out);
+private:
+    std::string compile(const std::string& fileName, const std::string& options);
+    std::function<void(Parser&)> _setUp;
+    CompileCache* _cache;
+    std::vector<std::string> _files;
+    ThreadPool _pool;
+};
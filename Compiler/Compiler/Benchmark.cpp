@@ -0,0 +1,178 @@
+#include "Benchmark.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include "Scanner.h"
+#include "Parser.h"
+#include "TextScan.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Peak resident set size of the process so far, in bytes.
+static size_t getPeakRss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss << 10;
+#endif
+#endif
+}
+
+// Reads the file and repeats it until the text is at least _minTextSize.
+void Benchmark::loadText(const char* fname) {
+    std::ifstream fin(fname, std::ios::binary);
+    if (fin.fail())
+        throw MissingFile(fname);
+    std::string source((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    if (source.empty())
+        return;
+    source += '\n';
+    while (_text.size() < _minTextSize)
+        _text += source;
+}
+
+// For every TextScan level prints the throughput of the whole scanner and of
+// the bare run primitives it is built on.
+void Benchmark::runLexer(const char* fname, std::ostream& out) {
+    loadText(fname);
+    out << "lexer: " << fname << ", " << _text.size() << " bytes" << std::endl;
+    TextScan::Level best = TextScan::getBestLevel();
+    for (int level = TextScan::Scalar; level <= best; ++level) {
+        TextScan::setLevel((TextScan::Level)level);
+        size_t tokens = 0, runs = 0;
+        double lexSpeed = lexMegabytesPerSecond(tokens);
+        double runsSpeed = runsMegabytesPerSecond(runs);
+        out << std::left << std::setw(8) << TextScan::getLevelName((TextScan::Level)level) << std::right << std::fixed << std::setprecision(1)
+            << " scanner " << std::setw(8) << lexSpeed << " MB/s (" << tokens << " tokens)"
+            << "   runs " << std::setw(8) << runsSpeed << " MB/s (" << runs << " runs)" << std::endl;
+    }
+    TextScan::setLevel(best);
+}
+
+// Best of several runs over the whole text.
+double Benchmark::lexMegabytesPerSecond(size_t& tokens) {
+    double best = 0;
+    for (int run = 0; run < _runs; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        Scanner scanner(_text.data(), _text.size());
+        tokens = 0;
+        while (scanner.getNextToken()->getType() != TokenType::EndOfFile)
+            ++tokens;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double speed = _text.size() / elapsed.count() / (1 << 20);
+        if (speed > best)
+            best = speed;
+    }
+    return best;
+}
+
+// Splits the text into whitespace, comment and identifier runs the way the
+// scanner's fast paths do, without building tokens.
+double Benchmark::runsMegabytesPerSecond(size_t& runs) {
+    double best = 0;
+    const char* last = _text.data() + _text.size();
+    for (int run = 0; run < _runs; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        const char* lastNewLine = nullptr;
+        size_t lines = 0;
+        runs = 0;
+        for (const char* pos = _text.data(); pos != last; ++runs) {
+            const char* next;
+            if (*pos == '{')
+                next = TextScan::findChar(pos, last, '}');
+            else if (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')
+                next = TextScan::skipSpaces(pos, last);
+            else
+                next = TextScan::skipIdentifier(pos, last);
+            if (next == pos || next != last)
+                ++next;
+            lines += TextScan::countNewLines(pos, next, &lastNewLine);
+            pos = next;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double speed = _text.size() / elapsed.count() / (1 << 20);
+        if (speed > best)
+            best = speed;
+    }
+    return best;
+}
+
+// Parses expressions of two extreme shapes: very long flat chains mixing all
+// priority levels and deeply nested parentheses and unary operators, then a
+// large statement-heavy program.
+void Benchmark::runParser(std::ostream& out) {
+    const int terms = 20000;
+    const int depth = 2000;
+    const int statements = 40000;
+    std::string flat = "a0";
+    const char* ops[] = { " + ", " * ", " - ", " div ", " < ", " or ", " / ", " and " };
+    for (int i = 1; i < terms; ++i)
+        flat += ops[i % 8] + std::string("a") + std::to_string(i);
+    std::string nested;
+    for (int i = 0; i < depth; ++i)
+        nested += i % 2 ? "-(" : "(a * ";
+    nested += "b";
+    for (int i = 0; i < depth; ++i)
+        nested += i % 2 ? " + c)" : ")";
+    std::string program = "var a, b, c, d : integer; x : float;\nbegin\n";
+    for (int i = 0; i < statements; ++i) {
+        switch (i % 4) {
+            case 0: program += "  a := (a + b * c) - d div 2 + (c - " + std::to_string(i) + ") * (b + a);\n"; break;
+            case 1: program += "  if (a < b) and (c > d) then b := b + 1 else c := c - a * 2;\n"; break;
+            case 2: program += "  while a > " + std::to_string(i) + " do a := a - (b + c) * 3;\n"; break;
+            case 3: program += "  x := x * 2.5 + a / (b + 1.0) - c;\n"; break;
+        }
+    }
+    program += "  writeln(a)\nend.\n";
+
+    struct { const char* name; const std::string* expr; bool isProgram; } cases[] = {
+        { "long", &flat, false },
+        { "nested", &nested, false },
+        { "program", &program, true }
+    };
+    // The peak RSS of the process never goes down, so each case shows the
+    // largest of it and the cases before; the program case is the largest.
+    out << "parser: expressions and program" << std::endl;
+    for (auto& it : cases) {
+        double seconds = parseSeconds(*it.expr, it.isProgram);
+        out << std::left << std::setw(8) << it.name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << it.expr->size() / seconds / (1 << 20) << " MB/s"
+            << std::setw(10) << seconds * 1e3 << " ms (" << it.expr->size() << " bytes), peak RSS "
+            << getPeakRss() / (1 << 20) << " MB" << std::endl;
+    }
+}
+
+// Times parsing together with releasing the tree, which goes away with the
+// parser's node arena.
+double Benchmark::parseSeconds(const std::string& text, bool isProgram) {
+    double best = 0;
+    for (int run = 0; run < _runs; ++run) {
+        std::unique_ptr<Parser> parser(new Parser(text.data(), text.size(), isProgram));
+        auto start = std::chrono::steady_clock::now();
+        if (isProgram)
+            parser->parse();
+        else
+            parser->parseExpr(0);
+        parser.reset();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
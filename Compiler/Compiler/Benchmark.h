@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+
+// Micro benchmarks run from the command line (see main.cpp). Inputs are made
+// large enough to give stable timings; every figure is the best of several runs.
+class Benchmark {
+public:
+    void runLexer(const char* fname, std::ostream& out);
+    void runParser(std::ostream& out);
+private:
+    void loadText(const char* fname);
+    double lexMegabytesPerSecond(size_t& tokens);
+    double runsMegabytesPerSecond(size_t& runs);
+    double parseSeconds(const std::string& text, bool isProgram);
+    std::string _text;
+    static const size_t _minTextSize = 8 << 20;
+    static const int _runs = 5;
+};
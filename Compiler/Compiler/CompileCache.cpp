@@ -0,0 +1,191 @@
+#include "CompileCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#define getpid _getpid
+#define utime _utime
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+static const uint64_t fnvOffset = 0xcbf29ce484222325;
+static const uint64_t fnvPrime = 0x100000001b3;
+
+// FNV-1a, continued from hash.
+static uint64_t hashBytes(uint64_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= fnvPrime;
+    }
+    return hash;
+}
+
+// Rebuilding the compiler changes the size or the modification time of its
+// executable, so they stand in for a version, as hashing the whole executable
+// would take longer than most compilations.
+static uint64_t getCompilerHash() {
+    static const uint64_t hash = []() {
+        std::string version = __DATE__ " " __TIME__;
+        struct stat info;
+#ifdef _WIN32
+        char path[MAX_PATH];
+        bool isFound = GetModuleFileNameA(nullptr, path, MAX_PATH) && !stat(path, &info);
+#else
+        bool isFound = !stat("/proc/self/exe", &info);
+#endif
+        if (isFound)
+            version = std::to_string(info.st_size) + " " + std::to_string(info.st_mtime);
+        return hashBytes(fnvOffset, version.data(), version.size());
+    }();
+    return hash;
+}
+
+// A temporary file this old was left by a build that did not finish.
+static const time_t staleTempSeconds = 60 * 60;
+
+static bool hasSuffix(const std::string& name, const char* suffix) {
+    size_t length = strlen(suffix);
+    return name.size() > length && name.compare(name.size() - length, length, suffix) == 0;
+}
+
+// The names of the entries and the temporary files in the directory.
+static std::vector<std::string> listFiles(const std::string& directory) {
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((directory + "/*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return names;
+    do
+        names.push_back(data.cFileName);
+    while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        return names;
+    while (dirent* entry = readdir(dir))
+        names.push_back(entry->d_name);
+    closedir(dir);
+#endif
+    names.erase(std::remove_if(names.begin(), names.end(), [](const std::string& name) {
+        return !hasSuffix(name, ".asm") && !hasSuffix(name, ".tmp");
+    }), names.end());
+    return names;
+}
+
+// The directory is created if it is missing; its parent must exist.
+CompileCache::CompileCache(const std::string& directory, uint64_t sizeLimit) :
+    _directory(directory), _sizeLimit(sizeLimit), _hits(0), _misses(0), _stores(0), _evictions(0),
+    _tempCount(0), _size(0), _entries(0) {
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+}
+
+std::string CompileCache::getKey(const std::string& source, const std::string& options) {
+    uint64_t compiler = getCompilerHash();
+    uint64_t hash = hashBytes(fnvOffset, (const char*)&compiler, sizeof(compiler));
+    hash = hashBytes(hash, options.data(), options.size() + 1);
+    hash = hashBytes(hash, source.data(), source.size());
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+    return key;
+}
+
+std::string CompileCache::getPath(const std::string& key) {
+    return _directory + "/" + key + ".asm";
+}
+
+bool CompileCache::load(const std::string& key, std::string& listing) {
+    std::string path = getPath(key);
+    std::ifstream fin(path, std::ios::binary);
+    if (fin.fail()) {
+        ++_misses;
+        return false;
+    }
+    listing = std::string(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    fin.close();
+    utime(path.c_str(), nullptr);
+    ++_hits;
+    return true;
+}
+
+// A failure to write only loses the entry.
+void CompileCache::store(const std::string& key, const std::string& listing) {
+    std::string path = getPath(key);
+    std::string temp = path + "." + std::to_string(getpid()) + "-" + std::to_string(_tempCount++) + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary);
+        out << listing;
+        if (!out) {
+            out.close();
+            std::remove(temp.c_str());
+            return;
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str())) {
+        std::remove(temp.c_str());
+        return;
+    }
+    ++_stores;
+}
+
+// Removes the temporary files of builds that did not finish, then the
+// entries used longest ago until the rest fit the size limit. Temporary files
+// still being written count toward the size but are left alone.
+void CompileCache::trim() {
+    std::lock_guard<std::mutex> lock(_trimMutex);
+    struct Entry {
+        std::string path;
+        uint64_t size;
+        time_t time;
+    };
+    std::vector<Entry> entries;
+    time_t staleTime = time(nullptr) - staleTempSeconds;
+    _size = 0;
+    for (auto& name : listFiles(_directory)) {
+        struct stat info;
+        std::string path = _directory + "/" + name;
+        if (stat(path.c_str(), &info))
+            continue;
+        if (hasSuffix(name, ".tmp")) {
+            if (info.st_mtime >= staleTime || std::remove(path.c_str()))
+                _size += info.st_size;
+            continue;
+        }
+        entries.push_back({ path, (uint64_t)info.st_size, info.st_mtime });
+        _size += info.st_size;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+    _entries = entries.size();
+    for (size_t i = 0; i < entries.size() && _size > _sizeLimit; ++i) {
+        if (std::remove(entries[i].path.c_str()))
+            continue;
+        _size -= entries[i].size;
+        --_entries;
+        ++_evictions;
+    }
+}
+
+// The size is as of the last trim.
+std::string CompileCache::getStatsString() const {
+    return "cache: " + std::to_string(_hits) + " hits, " + std::to_string(_misses) + " misses, "
+        + std::to_string(_stores) + " stored, " + std::to_string(_evictions) + " evicted, "
+        + std::to_string(_entries) + " entries in " + std::to_string(_size >> 10) + " KiB";
+}
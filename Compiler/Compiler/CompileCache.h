@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// On-disk cache of listings for repeated builds (see BatchCompiler). An entry
+// is keyed by a 64-bit hash of the source, the compiler executable and the
+// code options, and lives in the directory as <key>.asm. Entries are written
+// under a temporary name and renamed into place, so a reader never sees half
+// of one. A hit touches the entry; trim removes the least recently used
+// entries until the cache fits its size limit, and temporary files left by
+// builds that did not finish. Every method may be called
+// from several threads at once.
+class CompileCache {
+public:
+    CompileCache(const std::string& directory, uint64_t sizeLimit);
+    std::string getKey(const std::string& source, const std::string& options);
+    bool load(const std::string& key, std::string& listing);
+    void store(const std::string& key, const std::string& listing);
+    void trim();
+    std::string getStatsString() const;
+private:
+    std::string getPath(const std::string& key);
+    std::string _directory;
+    uint64_t _sizeLimit;
+    std::atomic<unsigned> _hits;
+    std::atomic<unsigned> _misses;
+    std::atomic<unsigned> _stores;
+    std::atomic<unsigned> _evictions;
+    std::atomic<unsigned> _tempCount;
+    std::mutex _trimMutex;
+    uint64_t _size;
+    size_t _entries;
+};
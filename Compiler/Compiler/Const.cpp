@@ -1,13 +1,5 @@
 #include "Const.h"
 
-exprType castTypes(exprType left, exprType right) {
-    if (left == right)
-        return left;
-    else {
-        return exprType::Real;
-    }
-}
-
 Const Const::ComputeUnaryAddition(Const arg) {
     return arg;
 }
@@ -88,80 +80,119 @@ Const Const::ComputeBinaryGe(Const left, Const right) {
     return left >= right;
 }
 
-Const::Const(exprType type, double value) : type(type), value(value) {}
+Const::Const(i64 value) : type(exprType::Integer), intValue(value), realValue(0) {}
+
+Const::Const(double value) : type(exprType::Real), intValue(0), realValue(value) {}
+
+bool Const::isIntZero() const {
+    return type == exprType::Integer && intValue == 0;
+}
+
+static bool areIntegers(const Const& left, const Const& right) {
+    return left.type == exprType::Integer && right.type == exprType::Integer;
+}
+
+// Two's complement wraparound without signed overflow.
+static i64 wrap(unsigned long long value) {
+    return (i64)value;
+}
 
 Const Const::operator==(Const right) {
-    return Const(exprType::Integer, value == right.value);
+    if (areIntegers(*this, right))
+        return Const((i64)(intValue == right.intValue));
+    return Const((i64)(getValue<double>() == right.getValue<double>()));
 }
 
 Const Const::operator<(Const right) {
-    return Const(exprType::Integer, value < right.value);
+    if (areIntegers(*this, right))
+        return Const((i64)(intValue < right.intValue));
+    return Const((i64)(getValue<double>() < right.getValue<double>()));
 }
 
 Const Const::operator>(Const right) {
-    return Const(type, (double)((i64)value > (i64)right.value));
+    if (areIntegers(*this, right))
+        return Const((i64)(intValue > right.intValue));
+    return Const((i64)(getValue<double>() > right.getValue<double>()));
 }
 
 Const Const::operator<=(Const right) {
-    return Const(type, (double)((i64)value <= (i64)right.value));
+    if (areIntegers(*this, right))
+        return Const((i64)(intValue <= right.intValue));
+    return Const((i64)(getValue<double>() <= right.getValue<double>()));
 }
 
 Const Const::operator>=(Const right) {
-    return Const(type, (double)((i64)value >= (i64)right.value));
+    if (areIntegers(*this, right))
+        return Const((i64)(intValue >= right.intValue));
+    return Const((i64)(getValue<double>() >= right.getValue<double>()));
 }
 
 Const Const::operator!=(Const right) {
-    return Const(type, (double)((i64)value != (i64)right.value));
+    if (areIntegers(*this, right))
+        return Const((i64)(intValue != right.intValue));
+    return Const((i64)(getValue<double>() != right.getValue<double>()));
 }
 
 Const Const::operator!() {
-    return Const(type, (double)(!((i64)value)));
+    return Const((i64)!getValue<i64>());
 }
 
+// The divisor is known to be non-zero; -1 is special-cased because the
+// quotient of the smallest i64 by it overflows.
 Const Const::operator%(Const right) {
-    return Const(type, (double)((i64)value % (i64)right.value));
+    i64 divisor = right.getValue<i64>();
+    return Const(divisor == -1 ? (i64)0 : getValue<i64>() % divisor);
 }
 
 Const Const::operator+(Const right) {
-    return Const(castTypes(type, right.type), value + right.value);
+    if (areIntegers(*this, right))
+        return Const(wrap((unsigned long long)intValue + (unsigned long long)right.intValue));
+    return Const(getValue<double>() + right.getValue<double>());
 }
 
 Const Const::operator-(Const right) {
-    return Const(castTypes(type, right.type), value - right.value);
+    if (areIntegers(*this, right))
+        return Const(wrap((unsigned long long)intValue - (unsigned long long)right.intValue));
+    return Const(getValue<double>() - right.getValue<double>());
 }
 
 Const Const::operator*(Const right) {
-    return Const(castTypes(type, right.type), value * right.value);
+    if (areIntegers(*this, right))
+        return Const(wrap((unsigned long long)intValue * (unsigned long long)right.intValue));
+    return Const(getValue<double>() * right.getValue<double>());
 }
 
 Const Const::operator/(Const right) {
-    exprType _type = castTypes(type, right.type);
-    double val = value / right.value;
-    if (_type == exprType::Integer)
-        val = (double)(int)val;
-    return Const(_type, val);
+    if (!areIntegers(*this, right))
+        return Const(getValue<double>() / right.getValue<double>());
+    if (right.intValue == -1)
+        return -*this;
+    return Const(intValue / right.intValue);
 }
 
 Const Const::operator-() {
-    return Const(type, -value);
+    if (type == exprType::Integer)
+        return Const(wrap(0 - (unsigned long long)intValue));
+    return Const(-realValue);
 }
 
 Const Const::operator&(Const right) {
-    return Const(type, (double)((i64)value & (i64)right.value));
+    return Const(getValue<i64>() & right.getValue<i64>());
 }
 
 Const Const::operator^(Const right) {
-    return Const(type, (double)((i64)value ^ (i64)right.value));
+    return Const(getValue<i64>() ^ right.getValue<i64>());
 }
 
 Const Const::operator|(Const right) {
-    return Const(type, (double)((i64)value | (i64)right.value));
+    return Const(getValue<i64>() | right.getValue<i64>());
 }
 
+// Shifts are logical and take the count modulo 64, like shl and shr.
 Const Const::operator >> (Const right) {
-    return Const(type, (double)((i64)value >> (i64)right.value));
+    return Const(wrap((unsigned long long)getValue<i64>() >> (right.getValue<i64>() & 63)));
 }
 
 Const Const::operator<<(Const right) {
-    return Const(type, (double)((i64)value << (i64)right.value));
-}
\ No newline at end of file
+    return Const(wrap((unsigned long long)getValue<i64>() << (right.getValue<i64>() & 63)));
+}
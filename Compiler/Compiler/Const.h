@@ -7,12 +7,17 @@ enum exprType {
 
 typedef long long i64;
 
+// Value of a constant expression, tagged with its type: integers are kept
+// as exact 64-bit values and wrap around like the generated code, reals are
+// doubles.
 struct Const {
-    Const(exprType type, double value);
+    Const(i64 value);
+    Const(double value);
     template<class T>
-    T getValue() {
-        return T(value);
+    T getValue() const {
+        return type == exprType::Integer ? T(intValue) : T(realValue);
     }
+    bool isIntZero() const;
 
     static Const ComputeUnaryAddition(Const arg);
     static Const ComputeUnarySubtraction(Const arg);
@@ -36,7 +41,8 @@ struct Const {
     static Const ComputeBinaryGe(Const left, Const right);   
 
     exprType type;
-    double value;
+    i64 intValue;
+    double realValue;
     Const operator == (Const right);
     Const operator < (Const right);
     Const operator > (Const right);
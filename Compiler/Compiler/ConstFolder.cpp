@@ -0,0 +1,321 @@
+#include "ConstFolder.h"
+
+#include <cmath>
+
+static bool getInt(PNode node, i64& value) {
+    if (node->getNodeType() != SynNodeType::IntegerNumber)
+        return false;
+    value = static_cast<IntConstNode*>(node)->getValue();
+    return true;
+}
+
+static bool getReal(PNode node, double& value) {
+    i64 intValue;
+    if (getInt(node, intValue))
+        value = (double)intValue;
+    else if (node->getNodeType() == SynNodeType::RealNumber)
+        value = static_cast<RealConstNode*>(node)->getValue();
+    else
+        return false;
+    return true;
+}
+
+// Const computes like the generated code; division by zero is left to trap
+// at run time.
+static bool computeInt(TokenType op, i64 left, i64 right, i64& result) {
+    Const a(left), b(right);
+    switch (op) {
+        case TokenType::Add:          result = (a + b).intValue; break;
+        case TokenType::Sub:          result = (a - b).intValue; break;
+        case TokenType::Mul:          result = (a * b).intValue; break;
+        case TokenType::And:          result = (a & b).intValue; break;
+        case TokenType::Or:           result = (a | b).intValue; break;
+        case TokenType::Xor:          result = (a ^ b).intValue; break;
+        case TokenType::Shl:          result = (a << b).intValue; break;
+        case TokenType::Shr:          result = (a >> b).intValue; break;
+        case TokenType::Equal:        result = (a == b).intValue; break;
+        case TokenType::NotEqual:     result = (a != b).intValue; break;
+        case TokenType::Less:         result = (a < b).intValue; break;
+        case TokenType::LessEqual:    result = (a <= b).intValue; break;
+        case TokenType::Greater:      result = (a > b).intValue; break;
+        case TokenType::GreaterEqual: result = (a >= b).intValue; break;
+        case TokenType::Div:
+        case TokenType::Mod:
+            if (right == 0)
+                return false;
+            result = (op == TokenType::Div ? a / b : a % b).intValue;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// Real relations are not folded: the generated code leaves 0 or 1 in a
+// value typed as real, which no literal node can express.
+static bool computeReal(TokenType op, double left, double right, double& result) {
+    switch (op) {
+        case TokenType::Add:     result = left + right; break;
+        case TokenType::Sub:     result = left - right; break;
+        case TokenType::Mul:     result = left * right; break;
+        case TokenType::DivReal: result = left / right; break;
+        default:                 return false;
+    }
+    return std::isfinite(result);
+}
+
+ConstFolder::ConstFolder(NodeArena& nodes) : _nodes(nodes) {}
+
+void ConstFolder::fold(PNode body) {
+    _values.clear();
+    foldStatement(body);
+}
+
+void ConstFolder::foldStatement(PNode node) {
+    switch (node->getNodeType()) {
+        case SynNodeType::Block:
+            for (auto statement : static_cast<BlockNode*>(node)->getStatements())
+                foldStatement(statement);
+            break;
+        case SynNodeType::BinaryOp:
+            if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node))
+                foldAssignment(assignment);
+            else
+                _values.clear();
+            break;
+        case SynNodeType::IfStmt:
+            foldIf(static_cast<IfNode*>(node));
+            break;
+        case SynNodeType::WhileStmt: {
+            // The condition and the body also run after later iterations.
+            WhileNode* loop = static_cast<WhileNode*>(node);
+            _values.clear();
+            loop->setCond(foldValue(loop->getCond()));
+            foldStatement(loop->getBody());
+            _values.clear();
+            break;
+        }
+        case SynNodeType::ForStmt:
+            foldFor(static_cast<ForNode*>(node));
+            break;
+        case SynNodeType::RepeatStmt: {
+            // continue jumps straight to the condition.
+            RepeatNode* loop = static_cast<RepeatNode*>(node);
+            _values.clear();
+            foldStatement(loop->getBody());
+            _values.clear();
+            loop->setCond(foldValue(loop->getCond()));
+            _values.clear();
+            break;
+        }
+        case SynNodeType::Call:
+            foldCall(static_cast<CallNode*>(node), dynamic_cast<WriteNode*>(node) != nullptr);
+            break;
+        case SynNodeType::Break:
+        case SynNodeType::Continue:
+        case SynNodeType::Empty:
+            break;
+        default:
+            _values.clear();
+    }
+}
+
+void ConstFolder::foldAssignment(AssignmentNode* node) {
+    node->setRight(foldValue(node->getRight()));
+    PNode left = node->getLeft();
+    SymbolPtr symbol = left->getNodeType() == SynNodeType::Identifier ? static_cast<IdentifierNode*>(left)->getSymbol() : nullptr;
+    if (!symbol || !isTracked(symbol)) {
+        _values.clear();
+        return;
+    }
+    PNode value = node->getRight();
+    SymbolType varType = symbol->getVarType();
+    if ((value->getNodeType() == SynNodeType::IntegerNumber && varType == SymbolType::TypeInteger) ||
+        (value->getNodeType() == SynNodeType::RealNumber && varType == SymbolType::TypeReal))
+        _values[symbol] = value;
+    else
+        _values.erase(symbol);
+}
+
+// Keeps what both branches agree on, or what the branch taken leaves when
+// the condition is known.
+void ConstFolder::foldIf(IfNode* node) {
+    node->setCond(foldValue(node->getCond()));
+    Values before = _values;
+    foldStatement(node->getThen());
+    Values afterThen;
+    afterThen.swap(_values);
+    _values = before;
+    if (node->getElse())
+        foldStatement(node->getElse());
+    i64 cond;
+    if (getInt(node->getCond(), cond)) {
+        if (cond)
+            _values.swap(afterThen);
+        return;
+    }
+    for (auto it = _values.begin(); it != _values.end();) {
+        auto then = afterThen.find(it->first);
+        if (then != afterThen.end() && isSameValue(then->second, it->second))
+            ++it;
+        else
+            it = _values.erase(it);
+    }
+}
+
+// The final value is evaluated again before every iteration.
+void ConstFolder::foldFor(ForNode* node) {
+    node->setInitial(foldValue(node->getInitial()));
+    _values.clear();
+    node->setFinal(foldValue(node->getFinal()));
+    foldStatement(node->getBody());
+    _values.clear();
+}
+
+// Arguments are evaluated before the call, which may then change any
+// variable unless it is write or writeln. A var parameter needs its argument
+// as an lvalue, so only operator subtrees are folded in other calls.
+void ConstFolder::foldCall(CallNode* node, bool isWrite) {
+    const std::vector<PNode>& args = node->getArgs();
+    for (auto arg : args)
+        if (!isPure(arg))
+            _values.clear();
+    for (size_t i = 0; i < args.size(); ++i)
+        if (isWrite || *args[i] == SynNodeType::BinaryOp || *args[i] == SynNodeType::UnaryOp)
+            node->setArg(i, foldExpr(args[i]));
+    if (!isWrite)
+        _values.clear();
+}
+
+// Folds an expression evaluated once at this point, forgetting the known
+// values first if evaluating it may call a function.
+PNode ConstFolder::foldValue(PNode node) {
+    if (!isPure(node))
+        _values.clear();
+    return foldExpr(node);
+}
+
+PNode ConstFolder::foldExpr(PNode node) {
+    switch (node->getNodeType()) {
+        case SynNodeType::Identifier: {
+            SymbolPtr symbol = static_cast<IdentifierNode*>(node)->getSymbol();
+            if (symbol->getType() == SymbolType::ConstInteger)
+                return makeInt(std::dynamic_pointer_cast<SymIntegerConst>(symbol)->getValue());
+            if (symbol->getType() == SymbolType::ConstReal)
+                return makeReal(std::dynamic_pointer_cast<SymRealConst>(symbol)->getValue());
+            auto it = _values.find(symbol);
+            return it == _values.end() ? node : it->second;
+        }
+        case SynNodeType::BinaryOp:
+            return foldBinary(static_cast<BinOpNode*>(node));
+        case SynNodeType::UnaryOp:
+            return foldUnary(static_cast<UnaryNode*>(node));
+        default:
+            return node;
+    }
+}
+
+PNode ConstFolder::foldBinary(BinOpNode* node) {
+    node->setLeft(foldExpr(node->getLeft()));
+    node->setRight(foldExpr(node->getRight()));
+    if (!node->isArithmetic())
+        return node;
+    if (node->getType() == SymbolType::TypeInteger) {
+        i64 left, right, result;
+        if (getInt(node->getLeft(), left) && getInt(node->getRight(), right) &&
+            computeInt(node->getOpType(), left, right, result))
+            return makeInt(result);
+        return node;
+    }
+    double left, right, result;
+    if (getReal(node->getLeft(), left) && getReal(node->getRight(), right) &&
+        computeReal(node->getOpType(), left, right, result))
+        return makeReal(result);
+    return node;
+}
+
+// Mirrors UnaryNode::generate: integers are negated or have their low bit
+// flipped, reals can only be negated, and any other operator leaves the
+// operand as it is.
+PNode ConstFolder::foldUnary(UnaryNode* node) {
+    node->setArg(foldExpr(node->getArg()));
+    PNode arg = node->getArg();
+    i64 intValue;
+    if (getInt(arg, intValue)) {
+        switch (node->getOpType()) {
+            case TokenType::Sub: return makeInt((-Const(intValue)).intValue);
+            case TokenType::Not: return makeInt(intValue ^ 1);
+            default:             return arg;
+        }
+    }
+    if (arg->getNodeType() == SynNodeType::RealNumber)
+        return node->getOpType() == TokenType::Sub ? makeReal(-static_cast<RealConstNode*>(arg)->getValue()) : arg;
+    return node;
+}
+
+PNode ConstFolder::makeInt(i64 value) {
+    return _nodes.make<IntConstNode>(value);
+}
+
+PNode ConstFolder::makeReal(double value) {
+    return _nodes.make<RealConstNode>(value);
+}
+
+// Expressions whose evaluation cannot change a variable.
+bool ConstFolder::isPure(PNode node) {
+    switch (node->getNodeType()) {
+        case SynNodeType::IntegerNumber:
+        case SynNodeType::RealNumber:
+        case SynNodeType::String:
+            return true;
+        case SynNodeType::Identifier:
+            switch (static_cast<IdentifierNode*>(node)->getSymbol()->getType()) {
+                case SymbolType::VarGlobal:
+                case SymbolType::VarLocal:
+                case SymbolType::Param:
+                case SymbolType::VarParam:
+                case SymbolType::FuncResult:
+                case SymbolType::ConstInteger:
+                case SymbolType::ConstReal:
+                    return true;
+                default:
+                    return false;
+            }
+        case SynNodeType::BinaryOp:
+            return isPure(static_cast<BinOpNode*>(node)->getLeft()) && isPure(static_cast<BinOpNode*>(node)->getRight());
+        case SynNodeType::UnaryOp:
+            return isPure(static_cast<UnaryNode*>(node)->getArg());
+        default:
+            return false;
+    }
+}
+
+// Integer and real variables that nothing but a plain assignment can change
+// between two calls. A var parameter may alias another variable, so it is
+// never tracked.
+bool ConstFolder::isTracked(SymbolPtr symbol) {
+    switch (symbol->getType()) {
+        case SymbolType::VarGlobal:
+        case SymbolType::VarLocal:
+            if (symbol->getSize() != 8)
+                return false;
+            [[fallthrough]];
+        case SymbolType::Param: {
+            SymbolType varType = symbol->getVarType();
+            return varType == SymbolType::TypeInteger || varType == SymbolType::TypeReal;
+        }
+        default:
+            return false;
+    }
+}
+
+bool ConstFolder::isSameValue(PNode left, PNode right) {
+    i64 leftInt, rightInt;
+    if (getInt(left, leftInt) && getInt(right, rightInt))
+        return leftInt == rightInt;
+    if (left->getNodeType() != SynNodeType::RealNumber || right->getNodeType() != SynNodeType::RealNumber)
+        return false;
+    double leftReal = static_cast<RealConstNode*>(left)->getValue();
+    double rightReal = static_cast<RealConstNode*>(right)->getValue();
+    return leftReal == rightReal && std::signbit(leftReal) == std::signbit(rightReal);
+}
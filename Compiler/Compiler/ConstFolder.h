@@ -0,0 +1,37 @@
+#pragma once
+
+#include <map>
+#include "SynNode.h"
+#include "NodeArena.h"
+#include "Const.h"
+
+// Folds constant integer and real subexpressions of a statement body into
+// literal nodes, with the same results the generated code would compute at
+// run time, and replaces named constants by their values. Scalar variables
+// assigned a constant are propagated into the statements that follow, until
+// a call, a loop or an assignment the pass cannot track may change them.
+// Parents cache their type, so every replacement node has exactly the type of
+// the subexpression it replaces.
+class ConstFolder {
+public:
+    ConstFolder(NodeArena& nodes);
+    void fold(PNode body);
+private:
+    typedef std::map<SymbolPtr, PNode> Values;
+    void foldStatement(PNode node);
+    void foldAssignment(AssignmentNode* node);
+    void foldIf(IfNode* node);
+    void foldFor(ForNode* node);
+    void foldCall(CallNode* node, bool isWrite);
+    PNode foldValue(PNode node);
+    PNode foldExpr(PNode node);
+    PNode foldBinary(BinOpNode* node);
+    PNode foldUnary(UnaryNode* node);
+    PNode makeInt(i64 value);
+    PNode makeReal(double value);
+    static bool isPure(PNode node);
+    static bool isTracked(SymbolPtr symbol);
+    static bool isSameValue(PNode left, PNode right);
+    NodeArena& _nodes;
+    Values _values;
+};
@@ -0,0 +1,190 @@
+#include "ElfWriter.h"
+#include "error.h"
+
+#include <algorithm>
+#include <fstream>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+static const uint64_t baseAddress = 0x400000;
+static const uint64_t pageSize = 0x1000;
+static const char interpreter[] = "/lib64/ld-linux-x86-64.so.2";
+
+static const uint64_t headerSize = 64;
+static const uint64_t segmentHeaderSize = 56;
+static const uint64_t segmentCount = 6;
+static const uint64_t symbolSize = 24;
+static const uint64_t relocationSize = 24;
+static const uint64_t dynamicSize = 16;
+
+enum SegmentType : uint32_t {
+    SegmentLoad = 1,
+    SegmentDynamic = 2,
+    SegmentInterpreter = 3,
+    SegmentHeaders = 6,
+    SegmentStack = 0x6474e551
+};
+
+enum SegmentFlags : uint32_t {
+    Executable = 1,
+    Writable = 2,
+    Readable = 4
+};
+
+enum DynamicTag : uint64_t {
+    DynamicNull = 0,
+    DynamicNeeded = 1,
+    DynamicHash = 4,
+    DynamicStrings = 5,
+    DynamicSymbols = 6,
+    DynamicRelocations = 7,
+    DynamicRelocationsSize = 8,
+    DynamicRelocationSize = 9,
+    DynamicStringsSize = 10,
+    DynamicSymbolSize = 11,
+    DynamicRunPath = 29
+};
+
+// R_X86_64_GLOB_DAT: the slot receives the address of the symbol.
+static const uint64_t relocationSlot = 6;
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void put(std::vector<uint8_t>& image, uint64_t offset, uint64_t value, int size) {
+    for (int i = 0; i < size; ++i)
+        image[offset + i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t addString(std::string& strings, const std::string& str) {
+    uint64_t offset = strings.size();
+    strings += str;
+    strings += '\0';
+    return offset;
+}
+
+static void putSegment(std::vector<uint8_t>& image, uint64_t& offset, uint32_t type, uint32_t flags,
+                       uint64_t fileOffset, uint64_t size, uint64_t alignment) {
+    uint64_t address = type == SegmentStack ? 0 : baseAddress + fileOffset;
+    put(image, offset, type, 4);
+    put(image, offset + 4, flags, 4);
+    put(image, offset + 8, fileOffset, 8);
+    put(image, offset + 16, address, 8);
+    put(image, offset + 24, address, 8);
+    put(image, offset + 32, size, 8);
+    put(image, offset + 40, size, 8);
+    put(image, offset + 48, alignment, 8);
+    offset += segmentHeaderSize;
+}
+
+ElfWriter::ElfWriter(AsmObject& object) : _object(object) {}
+
+void ElfWriter::addLibrary(const std::string& name) {
+    _libraries.push_back(name);
+}
+
+// Where the loader looks for the libraries first; $ORIGIN is the directory
+// of the executable.
+void ElfWriter::setRunPath(const std::string& path) {
+    _runPath = path;
+}
+
+// The file is laid out as two segments mapped at their file offsets from
+// baseAddress: the headers, the tables the loader reads and the code,
+// readable and executable; then the dynamic section, the import slots and
+// the data, writable and starting on a new page.
+void ElfWriter::write(const std::string& fileName, const std::string& entry) {
+    std::vector<std::string> imports(_object.imports.begin(), _object.imports.end());
+    uint64_t symbolCount = imports.size() + 1;
+    std::string strings(1, '\0');
+    std::vector<uint64_t> libraryNames, importNames;
+    for (auto& library : _libraries)
+        libraryNames.push_back(addString(strings, library));
+    uint64_t runPathName = _runPath.empty() ? 0 : addString(strings, _runPath);
+    for (auto& import : imports)
+        importNames.push_back(addString(strings, import));
+    // The libraries and run path, eight entries locating the tables and the
+    // terminating null.
+    uint64_t dynamicCount = _libraries.size() + (_runPath.empty() ? 0 : 1) + 9;
+
+    uint64_t interpreterOffset = headerSize + segmentCount * segmentHeaderSize;
+    uint64_t hashOffset = alignUp(interpreterOffset + sizeof(interpreter), 8);
+    uint64_t symbolsOffset = alignUp(hashOffset + (2 + 1 + symbolCount) * 4, 8);
+    uint64_t stringsOffset = symbolsOffset + symbolCount * symbolSize;
+    uint64_t relocationsOffset = alignUp(stringsOffset + strings.size(), 8);
+    uint64_t textOffset = alignUp(relocationsOffset + imports.size() * relocationSize, 16);
+    uint64_t dynamicOffset = alignUp(textOffset + _object.text.size(), pageSize);
+    uint64_t slotsOffset = dynamicOffset + dynamicCount * dynamicSize;
+    uint64_t dataOffset = alignUp(slotsOffset + imports.size() * 8, std::max<uint64_t>(_object.dataAlignment, 8));
+    uint64_t fileSize = dataOffset + _object.data.size();
+    std::vector<uint8_t> image(fileSize, 0);
+
+    auto symbol = _object.symbols.find(entry);
+    if (symbol == _object.symbols.end())
+        throw UndefinedLabel(entry);
+    static const uint8_t identification[] = { 0x7F, 'E', 'L', 'F', 2, 1, 1 };
+    std::copy(std::begin(identification), std::end(identification), image.begin());
+    put(image, 16, 2, 2);                                                   // executable
+    put(image, 18, 62, 2);                                                  // x86-64
+    put(image, 20, 1, 4);
+    put(image, 24, baseAddress + textOffset + symbol->second.offset, 8);
+    put(image, 32, headerSize, 8);
+    put(image, 52, headerSize, 2);
+    put(image, 54, segmentHeaderSize, 2);
+    put(image, 56, segmentCount, 2);
+    put(image, 58, 64, 2);
+
+    uint64_t offset = headerSize;
+    putSegment(image, offset, SegmentHeaders, Readable, headerSize, segmentCount * segmentHeaderSize, 8);
+    putSegment(image, offset, SegmentInterpreter, Readable, interpreterOffset, sizeof(interpreter), 1);
+    putSegment(image, offset, SegmentLoad, Readable | Executable, 0, textOffset + _object.text.size(), pageSize);
+    putSegment(image, offset, SegmentLoad, Readable | Writable, dynamicOffset, fileSize - dynamicOffset, pageSize);
+    putSegment(image, offset, SegmentDynamic, Readable | Writable, dynamicOffset, dynamicCount * dynamicSize, 8);
+    putSegment(image, offset, SegmentStack, Readable | Writable, 0, 0, 16);
+    std::copy(std::begin(interpreter), std::end(interpreter), image.begin() + interpreterOffset);
+
+    // A hash table with a single empty bucket: the program exports nothing.
+    put(image, hashOffset, 1, 4);
+    put(image, hashOffset + 4, symbolCount, 4);
+    for (size_t i = 0; i < imports.size(); ++i) {
+        uint64_t entryOffset = symbolsOffset + (i + 1) * symbolSize;
+        put(image, entryOffset, importNames[i], 4);
+        put(image, entryOffset + 4, 0x12, 1);                               // global function
+        uint64_t relocationOffset = relocationsOffset + i * relocationSize;
+        put(image, relocationOffset, baseAddress + slotsOffset + i * 8, 8);
+        put(image, relocationOffset + 8, (i + 1) << 32 | relocationSlot, 8);
+    }
+    std::copy(strings.begin(), strings.end(), image.begin() + stringsOffset);
+    std::copy(_object.data.begin(), _object.data.end(), image.begin() + dataOffset);
+
+    std::vector<std::pair<uint64_t, uint64_t>> dynamic;
+    for (auto name : libraryNames)
+        dynamic.push_back({ DynamicNeeded, name });
+    if (!_runPath.empty())
+        dynamic.push_back({ DynamicRunPath, runPathName });
+    dynamic.push_back({ DynamicHash, baseAddress + hashOffset });
+    dynamic.push_back({ DynamicStrings, baseAddress + stringsOffset });
+    dynamic.push_back({ DynamicStringsSize, strings.size() });
+    dynamic.push_back({ DynamicSymbols, baseAddress + symbolsOffset });
+    dynamic.push_back({ DynamicSymbolSize, symbolSize });
+    dynamic.push_back({ DynamicRelocations, baseAddress + relocationsOffset });
+    dynamic.push_back({ DynamicRelocationsSize, imports.size() * relocationSize });
+    dynamic.push_back({ DynamicRelocationSize, relocationSize });
+    dynamic.push_back({ DynamicNull, 0 });
+    for (size_t i = 0; i < dynamic.size(); ++i) {
+        put(image, dynamicOffset + i * dynamicSize, dynamic[i].first, 8);
+        put(image, dynamicOffset + i * dynamicSize + 8, dynamic[i].second, 8);
+    }
+
+    _object.link(baseAddress + textOffset, baseAddress + dataOffset, baseAddress + slotsOffset);
+    std::copy(_object.text.begin(), _object.text.end(), image.begin() + textOffset);
+
+    std::ofstream out(fileName, std::ios::binary);
+    out.write((const char*)image.data(), image.size());
+    out.close();
+#ifndef _WIN32
+    chmod(fileName.c_str(), 0755);
+#endif
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "AsmEncoder.h"
+
+// Links an AsmObject into a dynamically linked x86-64 ELF executable loaded
+// at a fixed address. The dynamic loader fills one slot per imported
+// function from the given libraries at start up. The file has no section
+// headers, which only linkers and debuggers read.
+class ElfWriter {
+public:
+    ElfWriter(AsmObject& object);
+    void addLibrary(const std::string& name);
+    void setRunPath(const std::string& path);
+    void write(const std::string& fileName, const std::string& entry);
+private:
+    AsmObject& _object;
+    std::vector<std::string> _libraries;
+    std::string _runPath;
+};
@@ -0,0 +1,208 @@
+#include "IR.h"
+
+#include <sstream>
+
+static const char* getTypeName(IRType type) {
+    switch (type) {
+        case IRType::Int:  return "int";
+        case IRType::Real: return "real";
+        default:           return "none";
+    }
+}
+
+static const char* getOpName(TokenType op, bool isUnary) {
+    switch (op) {
+        case TokenType::Add:          return "add";
+        case TokenType::Sub:          return isUnary ? "neg" : "sub";
+        case TokenType::Mul:          return "mul";
+        case TokenType::Div:          return "div";
+        case TokenType::DivReal:      return "fdiv";
+        case TokenType::Mod:          return "mod";
+        case TokenType::And:          return "and";
+        case TokenType::Or:           return "or";
+        case TokenType::Xor:          return "xor";
+        case TokenType::Not:          return "not";
+        case TokenType::Shl:          return "shl";
+        case TokenType::Shr:          return "shr";
+        case TokenType::Equal:        return "eq";
+        case TokenType::NotEqual:     return "ne";
+        case TokenType::Less:         return "lt";
+        case TokenType::LessEqual:    return "le";
+        case TokenType::Greater:      return "gt";
+        case TokenType::GreaterEqual: return "ge";
+        default:                      return "?";
+    }
+}
+
+static std::string tempName(int temp) {
+    return "%" + std::to_string(temp);
+}
+
+static std::string blockName(int block) {
+    return "B" + std::to_string(block);
+}
+
+IRInstr::IRInstr(IROp op, IRType type) : op(op), type(type) {}
+
+bool IRInstr::isTerminator() const {
+    return op == IROp::Jump || op == IROp::Branch;
+}
+
+bool IRBlock::hasTerminator() const {
+    return !instrs.empty() && instrs.back().isTerminator();
+}
+
+IRFunction::IRFunction(const std::string& name) : _name(name) {}
+
+const std::string& IRFunction::getName() {
+    return _name;
+}
+
+int IRFunction::addBlock() {
+    _blocks.push_back(IRBlock());
+    return (int)_blocks.size() - 1;
+}
+
+IRBlock& IRFunction::getBlock(int id) {
+    return _blocks[id];
+}
+
+int IRFunction::getBlockCount() {
+    return (int)_blocks.size();
+}
+
+int IRFunction::addTemp(IRType type) {
+    _temps.push_back(type);
+    return (int)_temps.size() - 1;
+}
+
+IRType IRFunction::getTempType(int temp) {
+    return _temps[temp];
+}
+
+int IRFunction::getTempCount() {
+    return (int)_temps.size();
+}
+
+// Rebuilds successor and predecessor lists from the block terminators.
+void IRFunction::computeEdges() {
+    for (auto& block : _blocks) {
+        block.succs.clear();
+        block.preds.clear();
+    }
+    for (int id = 0; id < (int)_blocks.size(); ++id) {
+        if (!_blocks[id].hasTerminator())
+            continue;
+        const IRInstr& last = _blocks[id].instrs.back();
+        _blocks[id].succs.push_back(last.target);
+        if (last.op == IROp::Branch && last.elseTarget != last.target)
+            _blocks[id].succs.push_back(last.elseTarget);
+        for (int succ : _blocks[id].succs)
+            _blocks[succ].preds.push_back(id);
+    }
+}
+
+// Drops blocks the entry cannot reach (code after break or continue) and
+// renumbers the rest, keeping their layout order.
+void IRFunction::removeUnreachableBlocks() {
+    computeEdges();
+    std::vector<bool> isReachable(_blocks.size(), false);
+    std::vector<int> work(1, 0);
+    isReachable[0] = true;
+    while (!work.empty()) {
+        int id = work.back();
+        work.pop_back();
+        for (int succ : _blocks[id].succs)
+            if (!isReachable[succ]) {
+                isReachable[succ] = true;
+                work.push_back(succ);
+            }
+    }
+    std::vector<int> newIds(_blocks.size(), -1);
+    std::vector<IRBlock> blocks;
+    for (int id = 0; id < (int)_blocks.size(); ++id)
+        if (isReachable[id]) {
+            newIds[id] = (int)blocks.size();
+            blocks.push_back(_blocks[id]);
+        }
+    for (auto& block : blocks)
+        if (block.hasTerminator()) {
+            IRInstr& last = block.instrs.back();
+            last.target = newIds[last.target];
+            if (last.op == IROp::Branch)
+                last.elseTarget = newIds[last.elseTarget];
+        }
+    _blocks.swap(blocks);
+    computeEdges();
+}
+
+std::string IRFunction::toString() {
+    std::stringstream sstream;
+    sstream << "function " << _name << std::endl;
+    for (int id = 0; id < (int)_blocks.size(); ++id) {
+        sstream << blockName(id) << ":";
+        if (!_blocks[id].preds.empty()) {
+            sstream << "    ; preds";
+            for (int pred : _blocks[id].preds)
+                sstream << " " << blockName(pred);
+        }
+        sstream << std::endl;
+        for (const IRInstr& instr : _blocks[id].instrs) {
+            sstream << "    ";
+            if (instr.dst >= 0)
+                sstream << tempName(instr.dst) << ":" << getTypeName(instr.type) << " = ";
+            switch (instr.op) {
+                case IROp::Const:
+                    if (instr.type == IRType::Real)
+                        sstream << "const " << instr.realValue;
+                    else
+                        sstream << "const " << instr.intValue;
+                    break;
+                case IROp::Load:
+                    sstream << "load " << instr.var->getName();
+                    break;
+                case IROp::Store:
+                    sstream << "store " << instr.var->getName() << ", " << tempName(instr.a);
+                    break;
+                case IROp::Unary:
+                    sstream << getOpName(instr.opToken, true) << " " << tempName(instr.a);
+                    break;
+                case IROp::Binary:
+                    sstream << getOpName(instr.opToken, false) << " " << tempName(instr.a) << ", " << tempName(instr.b);
+                    break;
+                case IROp::IntToReal:
+                    sstream << "itof " << tempName(instr.a);
+                    break;
+                case IROp::Bits:
+                    sstream << "bits " << tempName(instr.a);
+                    break;
+                case IROp::Eval:
+                    sstream << "eval <expression>";
+                    break;
+                case IROp::Exec:
+                    sstream << "exec <statement>";
+                    break;
+                case IROp::Call:
+                    sstream << "call " << static_cast<CallNode*>(instr.node)->getSymbol()->getName();
+                    break;
+                case IROp::Write:
+                    sstream << "write " << tempName(instr.a);
+                    break;
+                case IROp::WriteString:
+                    sstream << "write '" << instr.text << "'";
+                    break;
+                case IROp::WriteLine:
+                    sstream << "writeln";
+                    break;
+                case IROp::Jump:
+                    sstream << "jump " << blockName(instr.target);
+                    break;
+                case IROp::Branch:
+                    sstream << "branch " << tempName(instr.a) << ", " << blockName(instr.target) << ", " << blockName(instr.elseTarget);
+                    break;
+            }
+            sstream << std::endl;
+        }
+    }
+    return sstream.str();
+}
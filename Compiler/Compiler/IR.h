@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Token.h"
+#include "Symbol.h"
+#include "SynNode.h"
+
+// Typed three-address intermediate representation between the syntax tree
+// and AsmCode. A function is a list of basic blocks in layout order; each
+// block ends in a Jump or Branch, except the block that falls off the end of
+// the function. Temporaries are numbered, typed, assigned exactly once and
+// never live across blocks; variables are read and written only through
+// Load and Store.
+enum class IRType {
+    None,
+    Int,
+    Real
+};
+
+enum class IROp {
+    Const,          // dst = constant
+    Load,           // dst = var
+    Store,          // var = a
+    Unary,          // dst = op a
+    Binary,         // dst = a op b; relations give an Int 0 or 1
+    IntToReal,      // dst = (real)a
+    Bits,           // dst = the bits of a, retyped
+    Eval,           // dst = value of an expression the IR does not model
+    Exec,           // statement the IR does not model
+    Call,           // procedure or function call statement
+    Write,          // print a
+    WriteString,    // print text
+    WriteLine,      // print a newline
+    Jump,           // goto target
+    Branch          // if a <> 0 goto target else goto elseTarget
+};
+
+struct IRInstr {
+    IROp op;
+    IRType type = IRType::None;     // type of dst, or of a for Store and Write
+    TokenType opToken = TokenType::Operation;
+    int dst = -1;
+    int a = -1;
+    int b = -1;
+    i64 intValue = 0;
+    double realValue = 0;
+    std::string text;
+    SymbolPtr var;
+    PNode node = nullptr;
+    int target = -1;
+    int elseTarget = -1;
+    IRInstr(IROp op, IRType type = IRType::None);
+    bool isTerminator() const;
+};
+
+struct IRBlock {
+    std::vector<IRInstr> instrs;
+    std::vector<int> succs;
+    std::vector<int> preds;
+    bool hasTerminator() const;
+};
+
+class IRFunction {
+public:
+    IRFunction(const std::string& name);
+    const std::string& getName();
+    int addBlock();
+    IRBlock& getBlock(int id);
+    int getBlockCount();
+    int addTemp(IRType type);
+    IRType getTempType(int temp);
+    int getTempCount();
+    void computeEdges();
+    void removeUnreachableBlocks();
+    std::string toString();
+private:
+    std::string _name;
+    std::vector<IRBlock> _blocks;
+    std::vector<IRType> _temps;
+};
@@ -0,0 +1,456 @@
+#include "IRBuilder.h"
+
+static IRType getIRType(SymbolType type) {
+    switch (type) {
+        case SymbolType::TypeReal:
+            return IRType::Real;
+        case SymbolType::TypeRecord:
+        case SymbolType::TypeArray:
+        case SymbolType::TypeOpenArray:
+        case SymbolType::TypeString:
+        case SymbolType::None:
+            return IRType::None;
+        default:
+            return IRType::Int;
+    }
+}
+
+static bool isRelation(TokenType op) {
+    switch (op) {
+        case TokenType::Equal:
+        case TokenType::NotEqual:
+        case TokenType::Less:
+        case TokenType::LessEqual:
+        case TokenType::Greater:
+        case TokenType::GreaterEqual:
+            return true;
+        default:
+            return false;
+    }
+}
+
+IRBuilder::IRBuilder(IRFunction& function) : _function(function), _block(-1) {}
+
+void IRBuilder::build(PNode body) {
+    startBlock();
+    lowerStatement(body);
+    _function.removeUnreachableBlocks();
+}
+
+// Integer and real variables that fit a register: globals, locals, value and
+// var parameters and function results.
+bool IRBuilder::isScalarVar(SymbolPtr symbol) {
+    SymbolType varType;
+    switch (symbol->getType()) {
+        case SymbolType::VarGlobal:
+        case SymbolType::VarLocal:
+            if (symbol->getSize() != 8)
+                return false;
+            [[fallthrough]];
+        case SymbolType::Param:
+        case SymbolType::VarParam:
+        case SymbolType::FuncResult:
+            varType = symbol->getVarType();
+            return varType == SymbolType::TypeInteger || varType == SymbolType::TypeReal;
+        default:
+            return false;
+    }
+}
+
+void IRBuilder::lowerStatement(PNode node) {
+    switch (node->getNodeType()) {
+        case SynNodeType::Block:
+            for (auto statement : static_cast<BlockNode*>(node)->getStatements())
+                lowerStatement(statement);
+            break;
+        case SynNodeType::BinaryOp:
+            if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node))
+                lowerAssignment(assignment);
+            else {
+                IRInstr instr(IROp::Exec);
+                instr.node = node;
+                add(instr);
+            }
+            break;
+        case SynNodeType::IfStmt:
+            lowerIf(static_cast<IfNode*>(node));
+            break;
+        case SynNodeType::WhileStmt:
+            lowerWhile(static_cast<WhileNode*>(node));
+            break;
+        case SynNodeType::ForStmt:
+            lowerFor(static_cast<ForNode*>(node));
+            break;
+        case SynNodeType::RepeatStmt:
+            lowerRepeat(static_cast<RepeatNode*>(node));
+            break;
+        case SynNodeType::Call:
+            if (WritelnNode* writeln = dynamic_cast<WritelnNode*>(node))
+                lowerWrite(writeln, true);
+            else if (WriteNode* write = dynamic_cast<WriteNode*>(node))
+                lowerWrite(write, false);
+            else {
+                IRInstr instr(IROp::Call);
+                instr.node = node;
+                add(instr);
+            }
+            break;
+        case SynNodeType::Break:
+            lowerLoopExit(true);
+            break;
+        case SynNodeType::Continue:
+            lowerLoopExit(false);
+            break;
+        case SynNodeType::Empty:
+            break;
+        default: {
+            IRInstr instr(IROp::Exec);
+            instr.node = node;
+            add(instr);
+        }
+    }
+}
+
+void IRBuilder::lowerAssignment(AssignmentNode* node) {
+    PNode left = node->getLeft();
+    SymbolType rightType = node->getRight()->getType();
+    if (left->getNodeType() != SynNodeType::Identifier || !isScalarVar(static_cast<IdentifierNode*>(left)->getSymbol()) ||
+        (rightType != SymbolType::TypeInteger && rightType != SymbolType::TypeReal)) {
+        IRInstr instr(IROp::Exec);
+        instr.node = node;
+        add(instr);
+        return;
+    }
+    int value = lowerExpr(node->getRight());
+    IRInstr store(IROp::Store, _function.getTempType(value));
+    store.var = static_cast<IdentifierNode*>(left)->getSymbol();
+    store.a = value;
+    add(store);
+}
+
+void IRBuilder::lowerIf(IfNode* node) {
+    BranchExits cond = lowerBranch(node->getCond());
+    int thenBlock = startBlock();
+    lowerStatement(node->getThen());
+    int thenEnd = _block;
+    addJump();
+    int elseBlock = -1;
+    int elseEnd = -1;
+    if (node->getElse()) {
+        elseBlock = startBlock();
+        lowerStatement(node->getElse());
+        elseEnd = _block;
+        addJump();
+    }
+    int join = startBlock();
+    patchExits(cond.trues, thenBlock);
+    patchExits(cond.falses, elseBlock >= 0 ? elseBlock : join);
+    setTargets(thenEnd, join);
+    if (elseEnd >= 0)
+        setTargets(elseEnd, join);
+}
+
+// while c do s:  jump cond / body: s / cond: branch c, body, end / end:
+void IRBuilder::lowerWhile(WhileNode* node) {
+    int entry = _block;
+    addJump();
+    int body = startBlock();
+    _loops.push_back(LoopExits());
+    lowerStatement(node->getBody());
+    int bodyEnd = _block;
+    addJump();
+    int cond = startBlock();
+    BranchExits exits = lowerBranch(node->getCond());
+    int end = startBlock();
+    setTargets(entry, cond);
+    setTargets(bodyEnd, cond);
+    patchExits(exits.trues, body);
+    patchExits(exits.falses, end);
+    patchLoopExits(cond, end);
+}
+
+// The final value is evaluated before every iteration, as the stack backend
+// does.
+void IRBuilder::lowerFor(ForNode* node) {
+    SymbolPtr var = node->getSymbol();
+    if (!isScalarVar(var) || var->getVarType() != SymbolType::TypeInteger) {
+        IRInstr instr(IROp::Exec);
+        instr.node = node;
+        add(instr);
+        return;
+    }
+    IRInstr init(IROp::Store, IRType::Int);
+    init.var = var;
+    init.a = lowerExpr(node->getInitial());
+    add(init);
+    int entry = _block;
+    addJump();
+
+    int body = startBlock();
+    _loops.push_back(LoopExits());
+    lowerStatement(node->getBody());
+    int bodyEnd = _block;
+    addJump();
+
+    int inc = startBlock();
+    IRInstr load(IROp::Load, IRType::Int);
+    load.var = var;
+    IRInstr one(IROp::Const, IRType::Int);
+    one.intValue = 1;
+    IRInstr step(IROp::Binary, IRType::Int);
+    step.opToken = node->isTo() ? TokenType::Add : TokenType::Sub;
+    step.a = addTemp(load);
+    step.b = addTemp(one);
+    IRInstr store(IROp::Store, IRType::Int);
+    store.var = var;
+    store.a = addTemp(step);
+    add(store);
+    addJump();
+
+    int cond = startBlock();
+    IRInstr compare(IROp::Binary, IRType::Int);
+    compare.opToken = node->isTo() ? TokenType::LessEqual : TokenType::GreaterEqual;
+    compare.b = lowerExpr(node->getFinal());
+    compare.a = addTemp(load);
+    addBranch(addTemp(compare), body);
+    int condEnd = _block;
+    int end = startBlock();
+    setTargets(entry, cond);
+    setTargets(bodyEnd, inc);
+    setTargets(inc, cond);
+    setTargets(condEnd, body, end);
+    patchLoopExits(inc, end);
+}
+
+// repeat s until c:  body: s / cond: branch c, end, body / end:
+void IRBuilder::lowerRepeat(RepeatNode* node) {
+    int entry = _block;
+    addJump();
+    int body = startBlock();
+    _loops.push_back(LoopExits());
+    lowerStatement(node->getBody());
+    int bodyEnd = _block;
+    addJump();
+    int cond = startBlock();
+    BranchExits exits = lowerBranch(node->getCond());
+    int end = startBlock();
+    setTargets(entry, body);
+    setTargets(bodyEnd, cond);
+    patchExits(exits.trues, end);
+    patchExits(exits.falses, body);
+    patchLoopExits(cond, end);
+}
+
+// Arguments of other types print nothing, as in the stack backend.
+void IRBuilder::lowerWrite(WriteNode* node, bool isLine) {
+    for (auto arg : node->getArgs()) {
+        switch (arg->getType()) {
+            case SymbolType::TypeInteger:
+            case SymbolType::TypeReal: {
+                int value = lowerExpr(arg);
+                IRInstr write(IROp::Write, _function.getTempType(value));
+                write.a = value;
+                add(write);
+                break;
+            }
+            case SymbolType::TypeString: {
+                IRInstr write(IROp::WriteString);
+                write.text = static_cast<StringConstNode*>(arg)->getValue();
+                add(write);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (isLine)
+        add(IRInstr(IROp::WriteLine));
+}
+
+// break and continue outside a loop do nothing. Statements after them start
+// an unreachable block that build() removes.
+void IRBuilder::lowerLoopExit(bool isBreak) {
+    if (_loops.empty())
+        return;
+    (isBreak ? _loops.back().breaks : _loops.back().continues).push_back(_block);
+    addJump();
+    startBlock();
+}
+
+void IRBuilder::patchLoopExits(int continueTarget, int breakTarget) {
+    for (int block : _loops.back().breaks)
+        setTargets(block, breakTarget);
+    for (int block : _loops.back().continues)
+        setTargets(block, continueTarget);
+    _loops.pop_back();
+}
+
+int IRBuilder::lowerExpr(PNode node) {
+    IRType type = getIRType(node->getType());
+    switch (node->getNodeType()) {
+        case SynNodeType::IntegerNumber: {
+            IRInstr instr(IROp::Const, IRType::Int);
+            instr.intValue = static_cast<IntConstNode*>(node)->getValue();
+            return addTemp(instr);
+        }
+        case SynNodeType::RealNumber: {
+            IRInstr instr(IROp::Const, IRType::Real);
+            instr.realValue = static_cast<RealConstNode*>(node)->getValue();
+            return addTemp(instr);
+        }
+        case SynNodeType::Identifier: {
+            SymbolPtr symbol = static_cast<IdentifierNode*>(node)->getSymbol();
+            if (symbol->getType() == SymbolType::ConstInteger) {
+                IRInstr instr(IROp::Const, IRType::Int);
+                instr.intValue = std::dynamic_pointer_cast<SymIntegerConst>(symbol)->getValue();
+                return addTemp(instr);
+            }
+            if (symbol->getType() == SymbolType::ConstReal) {
+                IRInstr instr(IROp::Const, IRType::Real);
+                instr.realValue = std::dynamic_pointer_cast<SymRealConst>(symbol)->getValue();
+                return addTemp(instr);
+            }
+            if (isScalarVar(symbol)) {
+                IRInstr instr(IROp::Load, type);
+                instr.var = symbol;
+                return addTemp(instr);
+            }
+            break;
+        }
+        case SynNodeType::BinaryOp:
+            if (static_cast<BinOpNode*>(node)->isArithmetic())
+                return lowerBinary(static_cast<BinOpNode*>(node));
+            break;
+        case SynNodeType::UnaryOp:
+            return lowerUnary(static_cast<UnaryNode*>(node));
+        default:
+            break;
+    }
+    IRInstr instr(IROp::Eval, type);
+    instr.node = node;
+    return addTemp(instr);
+}
+
+// Ends the current block with the branches that decide cond, leaving their
+// targets to be patched. A short-circuit and/or gets a block of its own for
+// the right operand, entered only when the left one does not decide it.
+IRBuilder::BranchExits IRBuilder::lowerBranch(PNode cond) {
+    BranchExits exits;
+    lowerBranch(cond, exits);
+    return exits;
+}
+
+void IRBuilder::lowerBranch(PNode cond, BranchExits& exits) {
+    if (cond->getNodeType() == SynNodeType::BinaryOp && static_cast<BinOpNode*>(cond)->isShortCircuit()) {
+        BinOpNode* node = static_cast<BinOpNode*>(cond);
+        bool isAnd = node->getOpType() == TokenType::And;
+        BranchExits left = lowerBranch(node->getLeft());
+        patchExits(isAnd ? left.trues : left.falses, startBlock());
+        std::vector<BranchExit>& decided = isAnd ? left.falses : left.trues;
+        std::vector<BranchExit>& outcome = isAnd ? exits.falses : exits.trues;
+        outcome.insert(outcome.end(), decided.begin(), decided.end());
+        lowerBranch(node->getRight(), exits);
+        return;
+    }
+    addBranch(lowerCond(cond));
+    exits.trues.push_back({ _block, false });
+    exits.falses.push_back({ _block, true });
+}
+
+void IRBuilder::patchExits(const std::vector<BranchExit>& exits, int target) {
+    for (const BranchExit& exit : exits) {
+        IRInstr& branch = _function.getBlock(exit.block).instrs.back();
+        (exit.isElse ? branch.elseTarget : branch.target) = target;
+    }
+}
+
+// A branch only tests its condition against zero, so a comparison of reals
+// can be tested as the integer it computes.
+int IRBuilder::lowerCond(PNode node) {
+    if (node->getNodeType() == SynNodeType::BinaryOp && static_cast<BinOpNode*>(node)->isArithmetic())
+        return lowerBinary(static_cast<BinOpNode*>(node), true);
+    return lowerExpr(node);
+}
+
+// A real comparison yields an integer 0 or 1 that the syntax tree types as
+// real; Bits keeps those semantics explicit.
+int IRBuilder::lowerBinary(BinOpNode* node, bool isCond) {
+    TokenType op = node->getOpType();
+    int left = lowerExpr(node->getLeft());
+    int right = lowerExpr(node->getRight());
+    if (node->getType() == SymbolType::TypeReal) {
+        left = toReal(left);
+        right = toReal(right);
+    }
+    IRInstr instr(IROp::Binary, isRelation(op) ? IRType::Int : getIRType(node->getType()));
+    instr.opToken = op;
+    instr.a = left;
+    instr.b = right;
+    int result = addTemp(instr);
+    if (isCond || instr.type == getIRType(node->getType()))
+        return result;
+    IRInstr bits(IROp::Bits, IRType::Real);
+    bits.a = result;
+    return addTemp(bits);
+}
+
+// Unary plus, and any operator on a type other than integer and real, leaves
+// the value unchanged.
+int IRBuilder::lowerUnary(UnaryNode* node) {
+    int arg = lowerExpr(node->getArg());
+    SymbolType argType = node->getArg()->getType();
+    TokenType op = node->getOpType();
+    bool isNegate = op == TokenType::Sub && (argType == SymbolType::TypeInteger || argType == SymbolType::TypeReal);
+    bool isNot = op == TokenType::Not && argType == SymbolType::TypeInteger;
+    if (!isNegate && !isNot)
+        return arg;
+    IRInstr instr(IROp::Unary, _function.getTempType(arg));
+    instr.opToken = op;
+    instr.a = arg;
+    return addTemp(instr);
+}
+
+int IRBuilder::toReal(int temp) {
+    if (_function.getTempType(temp) != IRType::Int)
+        return temp;
+    IRInstr instr(IROp::IntToReal, IRType::Real);
+    instr.a = temp;
+    return addTemp(instr);
+}
+
+int IRBuilder::addTemp(IRInstr instr) {
+    instr.dst = _function.addTemp(instr.type);
+    add(instr);
+    return instr.dst;
+}
+
+void IRBuilder::add(const IRInstr& instr) {
+    _function.getBlock(_block).instrs.push_back(instr);
+}
+
+void IRBuilder::addJump(int target) {
+    IRInstr instr(IROp::Jump);
+    instr.target = target;
+    add(instr);
+}
+
+void IRBuilder::addBranch(int cond, int target, int elseTarget) {
+    IRInstr instr(IROp::Branch, IRType::Int);
+    instr.a = cond;
+    instr.target = target;
+    instr.elseTarget = elseTarget;
+    add(instr);
+}
+
+// Points the terminator of block at its targets once they exist.
+void IRBuilder::setTargets(int block, int target, int elseTarget) {
+    IRInstr& last = _function.getBlock(block).instrs.back();
+    last.target = target;
+    if (last.op == IROp::Branch && elseTarget >= 0)
+        last.elseTarget = elseTarget;
+}
+
+int IRBuilder::startBlock() {
+    _block = _function.addBlock();
+    return _block;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include "IR.h"
+
+// Lowers a statement tree into an IRFunction. Control flow (blocks, if,
+// while, for, repeat, break, continue), assignments to scalar variables,
+// write/writeln and integer and real arithmetic become IR; anything else is
+// kept as an Eval or Exec instruction that the lowering hands back to the
+// stack backend.
+class IRBuilder {
+public:
+    IRBuilder(IRFunction& function);
+    void build(PNode body);
+    static bool isScalarVar(SymbolPtr symbol);
+private:
+    void lowerStatement(PNode node);
+    void lowerAssignment(AssignmentNode* node);
+    void lowerIf(IfNode* node);
+    void lowerWhile(WhileNode* node);
+    void lowerFor(ForNode* node);
+    void lowerRepeat(RepeatNode* node);
+    void lowerWrite(WriteNode* node, bool isLine);
+    void lowerLoopExit(bool isBreak);
+    void patchLoopExits(int continueTarget, int breakTarget);
+    // A branch terminator still waiting for its target (isElse false) or
+    // its else target.
+    struct BranchExit {
+        int block;
+        bool isElse;
+    };
+    struct BranchExits {
+        std::vector<BranchExit> trues;
+        std::vector<BranchExit> falses;
+    };
+    BranchExits lowerBranch(PNode cond);
+    void lowerBranch(PNode cond, BranchExits& exits);
+    void patchExits(const std::vector<BranchExit>& exits, int target);
+    int lowerExpr(PNode node);
+    int lowerCond(PNode node);
+    int lowerBinary(BinOpNode* node, bool isCond = false);
+    int lowerUnary(UnaryNode* node);
+    int toReal(int temp);
+    int addTemp(IRInstr instr);
+    void add(const IRInstr& instr);
+    void addJump(int target = -1);
+    void addBranch(int cond, int target = -1, int elseTarget = -1);
+    void setTargets(int block, int target, int elseTarget = -1);
+    int startBlock();
+    // Blocks ending in a break or continue of the loop being lowered; their
+    // jumps are patched once the loop's blocks exist.
+    struct LoopExits {
+        std::vector<int> breaks;
+        std::vector<int> continues;
+    };
+    IRFunction& _function;
+    int _block;
+    std::vector<LoopExits> _loops;
+};
@@ -0,0 +1,365 @@
+#include "IRLowering.h"
+
+static AsmOperandPtr makeReg(AsmRegType reg) {
+    return AsmOperandPtr(new AsmReg(reg));
+}
+
+static bool isRegOperand(const AsmOperandPtr& op) {
+    return op->getOperandType() == AsmOperandType::Reg;
+}
+
+static bool isXmmReg(AsmRegType reg) {
+    return reg == XMM0 || reg == XMM1 || reg == XMM2 || reg == XMM3 || reg == XMM4 || reg == XMM5;
+}
+
+static bool isSameReg(const AsmOperandPtr& a, const AsmOperandPtr& b) {
+    return isRegOperand(a) && isRegOperand(b) &&
+           static_cast<AsmReg*>(a.get())->getRegType() == static_cast<AsmReg*>(b.get())->getRegType();
+}
+
+static AsmOpType getJump(TokenType op, bool isReal) {
+    switch (op) {
+        case TokenType::Equal:     return JE;
+        case TokenType::NotEqual:  return JNE;
+        case TokenType::Less:      return isReal ? JB : JL;
+        case TokenType::LessEqual: return isReal ? JBE : JLE;
+        case TokenType::Greater:   return isReal ? JA : JG;
+        default:                   return isReal ? JAE : JGE;
+    }
+}
+
+IRLowering::IRLowering(AsmCode& asmCode) : _asmCode(asmCode) {}
+
+// A comparison whose only use is the branch right after it: the builder
+// gives every expression a temporary of its own, so the branch jumps on the
+// flags and the 0 or 1 is never stored.
+bool IRLowering::isFusedCompare(const IRInstr& instr, const IRInstr& next) {
+    if (instr.op != IROp::Binary || next.op != IROp::Branch || next.a != instr.dst || next.target == next.elseTarget)
+        return false;
+    switch (instr.opToken) {
+        case TokenType::Equal:
+        case TokenType::NotEqual:
+        case TokenType::Less:
+        case TokenType::LessEqual:
+        case TokenType::Greater:
+        case TokenType::GreaterEqual:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool IRLowering::isClobbering(const IRInstr& instr) {
+    switch (instr.op) {
+        case IROp::Eval:
+        case IROp::Exec:
+        case IROp::Call:
+        case IROp::Write:
+        case IROp::WriteString:
+        case IROp::WriteLine:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void IRLowering::generate(IRFunction& function) {
+    int count = function.getBlockCount();
+    _labels.clear();
+    for (int id = 0; id < count; ++id)
+        _labels.push_back(_asmCode.genLabelName());
+    _endLabel = _asmCode.genLabelName();
+    _isJumpTarget.assign(count + 1, false);
+    for (int id = 0; id < count; ++id) {
+        IRBlock& block = function.getBlock(id);
+        int next = id + 1;
+        if (!block.hasTerminator()) {
+            _isJumpTarget[count] = _isJumpTarget[count] || next != count;
+            continue;
+        }
+        const IRInstr& last = block.instrs.back();
+        if (last.op == IROp::Jump || last.target == last.elseTarget)
+            _isJumpTarget[last.target] = _isJumpTarget[last.target] || last.target != next;
+        else {
+            _isJumpTarget[last.target] = _isJumpTarget[last.target] || last.target != next;
+            _isJumpTarget[last.elseTarget] = true;
+        }
+    }
+
+    allocate(function);
+    if (_scan.getSlotCount())
+        _asmCode.addCmd(SUB, RSP, 8 * _scan.getSlotCount());
+    for (int id = 0; id < count; ++id) {
+        if (_isJumpTarget[id])
+            _asmCode.addLabel(_labels[id]);
+        IRBlock& block = function.getBlock(id);
+        for (size_t i = 0; i < block.instrs.size(); ++i) {
+            const IRInstr& instr = block.instrs[i];
+            if (i + 1 < block.instrs.size() && isFusedCompare(instr, block.instrs[i + 1]))
+                emitCompareBranch(instr, block.instrs[++i], id + 1);
+            else if (instr.isTerminator())
+                emitTerminator(instr, id + 1);
+            else
+                emit(instr);
+        }
+        if (!block.hasTerminator() && id + 1 != count)
+            _asmCode.addCmd(JMP, _endLabel);
+    }
+    if (_isJumpTarget[count])
+        _asmCode.addLabel(_endLabel);
+}
+
+// Temporaries never outlive their block, so one scan over the blocks in
+// layout order sees every interval whole.
+void IRLowering::allocate(IRFunction& function) {
+    for (int temp = 0; temp < function.getTempCount(); ++temp)
+        _scan.addVReg(function.getTempType(temp) == IRType::Real ? RegClass::Xmm : RegClass::Gpr);
+    int position = 0;
+    for (int id = 0; id < function.getBlockCount(); ++id)
+        for (const IRInstr& instr : function.getBlock(id).instrs) {
+            if (instr.dst >= 0)
+                _scan.extend(instr.dst, position);
+            if (instr.a >= 0)
+                _scan.extend(instr.a, position);
+            if (instr.b >= 0)
+                _scan.extend(instr.b, position);
+            if ((instr.op == IROp::Binary || instr.op == IROp::Unary || instr.op == IROp::Bits) && instr.dst >= 0)
+                _scan.setHint(instr.dst, instr.a);
+            if (isClobbering(instr))
+                _scan.addClobber(position);
+            ++position;
+        }
+    _scan.allocate();
+}
+
+void IRLowering::emit(const IRInstr& instr) {
+    switch (instr.op) {
+        case IROp::Const:
+            if (instr.type == IRType::Real) {
+                std::string name = _asmCode.addRealConst(instr.realValue);
+                emitMove(getLocation(instr.dst), RegClass::Xmm, _asmCode.getAdressOperand(name), RegClass::Gpr);
+            }
+            else
+                emitMove(getLocation(instr.dst), RegClass::Gpr, AsmOperandPtr(new AsmIntImmediate(instr.intValue)), RegClass::Gpr);
+            break;
+        case IROp::Load:
+            instr.var->generate(_asmCode);
+            emitPop(instr.dst);
+            break;
+        case IROp::Store: {
+            AsmOperandPtr value = useReg(instr.a, RCX);
+            instr.var->generateLValue(_asmCode);
+            _asmCode.addCmd(POP, RAX);
+            bool isXmm = isXmmReg(static_cast<AsmReg*>(value.get())->getRegType());
+            addCmd(isXmm ? MOVQ : MOV, _asmCode.getAdressOperand(RAX), value);
+            break;
+        }
+        case IROp::Unary:
+            emitUnary(instr);
+            break;
+        case IROp::Binary:
+            emitBinary(instr);
+            break;
+        case IROp::IntToReal: {
+            AsmOperandPtr src = useReg(instr.a, RAX);
+            AsmOperandPtr dst = _scan.isSpilled(instr.dst) ? makeReg(XMM0) : getLocation(instr.dst);
+            addCmd(CVTSI2SD, dst, src);
+            emitMove(getLocation(instr.dst), RegClass::Xmm, dst, RegClass::Xmm);
+            break;
+        }
+        case IROp::Bits:
+            emitMove(getLocation(instr.dst), getClass(instr.dst), getLocation(instr.a), getClass(instr.a));
+            break;
+        case IROp::Eval:
+            instr.node->generate(_asmCode);
+            emitPop(instr.dst);
+            break;
+        case IROp::Exec:
+        case IROp::Call:
+            instr.node->generate(_asmCode);
+            break;
+        case IROp::Write:
+            emitMove(makeReg(RAX), RegClass::Gpr, getLocation(instr.a), getClass(instr.a));
+            _asmCode.addCmd(PUSH, RAX);
+            if (instr.type == IRType::Real)
+                _asmCode.addWriteFloat();
+            else
+                _asmCode.addWriteInt();
+            break;
+        case IROp::WriteString:
+            _asmCode.addWriteString(instr.text);
+            break;
+        case IROp::WriteLine:
+            _asmCode.addWriteln();
+            break;
+        default:
+            // Jumps and branches end a block and are emitted with it.
+            break;
+    }
+}
+
+void IRLowering::emitBinary(const IRInstr& instr) {
+    AsmOperandPtr dst = getLocation(instr.dst);
+    AsmOperandPtr right = getLocation(instr.b);
+    RegClass regClass = getClass(instr.a);
+    bool isReal = regClass == RegClass::Xmm;
+    switch (instr.opToken) {
+        case TokenType::Equal:
+        case TokenType::NotEqual:
+        case TokenType::Less:
+        case TokenType::LessEqual:
+        case TokenType::Greater:
+        case TokenType::GreaterEqual: {
+            addCmd(isReal ? COMISD : CMP, useReg(instr.a, isReal ? XMM0 : RAX), right);
+            AsmOperandPtr flag = _scan.isSpilled(instr.dst) ? makeReg(RAX) : dst;
+            _asmCode.addCmd(getSetForJump(getJump(instr.opToken, isReal)), AL);
+            addCmd(MOVZX, flag, makeReg(AL));
+            emitMove(dst, RegClass::Gpr, flag, RegClass::Gpr);
+            return;
+        }
+        case TokenType::Div:
+        case TokenType::Mod: {
+            AsmOperandPtr divisor = right;
+            if (_scan.isSpilled(instr.b)) {
+                divisor = makeReg(RCX);
+                addCmd(MOV, divisor, right);
+            }
+            emitMove(makeReg(RAX), RegClass::Gpr, getLocation(instr.a), RegClass::Gpr);
+            _asmCode.addCmd(CQO);
+            addCmd(IDIV, divisor);
+            emitMove(dst, RegClass::Gpr, makeReg(instr.opToken == TokenType::Div ? RAX : RDX), RegClass::Gpr);
+            return;
+        }
+        case TokenType::Shl:
+        case TokenType::Shr: {
+            emitMove(makeReg(RCX), RegClass::Gpr, right, RegClass::Gpr);
+            AsmOperandPtr target = _scan.isSpilled(instr.dst) ? makeReg(RAX) : dst;
+            emitMove(target, RegClass::Gpr, getLocation(instr.a), RegClass::Gpr);
+            addCmd(instr.opToken == TokenType::Shl ? SHL : SHR, target, makeReg(CL));
+            emitMove(dst, RegClass::Gpr, target, RegClass::Gpr);
+            return;
+        }
+        default:
+            break;
+    }
+    AsmOpType op;
+    switch (instr.opToken) {
+        case TokenType::Add: op = isReal ? ADDSD : ADD; break;
+        case TokenType::Sub: op = isReal ? SUBSD : SUB; break;
+        case TokenType::Mul: op = isReal ? MULSD : IMUL; break;
+        case TokenType::And: op = AND; break;
+        case TokenType::Or:  op = OR; break;
+        case TokenType::Xor: op = XOR; break;
+        default:             op = DIVSD; break;
+    }
+    // dst starts as a copy of a, so it must not share a register with b.
+    bool isAliased = instr.a != instr.b && isSameReg(dst, right);
+    AsmOperandPtr target = _scan.isSpilled(instr.dst) || isAliased ? makeReg(isReal ? XMM0 : RAX) : dst;
+    emitMove(target, regClass, getLocation(instr.a), regClass);
+    addCmd(op, target, right);
+    emitMove(dst, regClass, target, regClass);
+}
+
+void IRLowering::emitUnary(const IRInstr& instr) {
+    AsmOperandPtr dst = getLocation(instr.dst);
+    if (instr.type == IRType::Real) {
+        unsigned long long signBit = 1;
+        signBit <<= 63;
+        AsmOperandPtr bits = makeReg(RAX);
+        emitMove(bits, RegClass::Gpr, getLocation(instr.a), RegClass::Xmm);
+        _asmCode.addCmd(MOV, RCX, std::to_string(signBit));
+        addCmd(XOR, bits, makeReg(RCX));
+        emitMove(dst, RegClass::Xmm, bits, RegClass::Gpr);
+        return;
+    }
+    AsmOperandPtr target = _scan.isSpilled(instr.dst) ? makeReg(RAX) : dst;
+    emitMove(target, RegClass::Gpr, getLocation(instr.a), RegClass::Gpr);
+    if (instr.opToken == TokenType::Sub)
+        addCmd(NEG, target);
+    else
+        addCmd(XOR, target, AsmOperandPtr(new AsmIntImmediate(1)));
+    emitMove(dst, RegClass::Gpr, target, RegClass::Gpr);
+}
+
+void IRLowering::emitTerminator(const IRInstr& instr, int next) {
+    if (instr.op == IROp::Jump || instr.target == instr.elseTarget) {
+        if (instr.target != next)
+            emitBranch(JMP, instr.target);
+        return;
+    }
+    AsmOperandPtr cond = makeReg(RAX);
+    if (getClass(instr.a) == RegClass::Gpr)
+        cond = useReg(instr.a, RAX);
+    else
+        emitMove(cond, RegClass::Gpr, getLocation(instr.a), RegClass::Xmm);
+    addCmd(TEST, cond, cond);
+    emitCondJump(JNZ, instr, next);
+}
+
+void IRLowering::emitCompareBranch(const IRInstr& compare, const IRInstr& branch, int next) {
+    bool isReal = getClass(compare.a) == RegClass::Xmm;
+    addCmd(isReal ? COMISD : CMP, useReg(compare.a, isReal ? XMM0 : RAX), getLocation(compare.b));
+    emitCondJump(getJump(compare.opToken, isReal), branch, next);
+}
+
+// Ends a block with a Branch whose condition holds when jump is taken,
+// falling through to whichever target comes next in layout.
+void IRLowering::emitCondJump(AsmOpType jump, const IRInstr& branch, int next) {
+    if (branch.target == next)
+        emitBranch(getInverseJump(jump), branch.elseTarget);
+    else {
+        emitBranch(jump, branch.target);
+        if (branch.elseTarget != next)
+            emitBranch(JMP, branch.elseTarget);
+    }
+}
+
+void IRLowering::emitBranch(AsmOpType op, int target) {
+    _asmCode.addCmd(op, _labels[target]);
+}
+
+// Takes the value the stack backend just pushed.
+void IRLowering::emitPop(int temp) {
+    if (getClass(temp) == RegClass::Gpr && !_scan.isSpilled(temp))
+        addCmd(POP, getLocation(temp));
+    else {
+        _asmCode.addCmd(POP, RAX);
+        emitMove(getLocation(temp), getClass(temp), makeReg(RAX), RegClass::Gpr);
+    }
+}
+
+// Copies the 64 bits of src to dst; MOVQ whenever an XMM register is
+// involved, through RAX when neither side is a register.
+void IRLowering::emitMove(const AsmOperandPtr& dst, RegClass dstClass, const AsmOperandPtr& src, RegClass srcClass) {
+    if (!isRegOperand(dst) && !isRegOperand(src)) {
+        AsmOperandPtr rax = makeReg(RAX);
+        addCmd(MOV, rax, src);
+        addCmd(MOV, dst, rax);
+        return;
+    }
+    if (isSameReg(dst, src))
+        return;
+    bool isXmm = (isRegOperand(dst) && dstClass == RegClass::Xmm) || (isRegOperand(src) && srcClass == RegClass::Xmm);
+    addCmd(isXmm ? MOVQ : MOV, dst, src);
+}
+
+// Register holding temp, loaded into scratch if it was spilled.
+AsmOperandPtr IRLowering::useReg(int temp, AsmRegType scratch) {
+    if (!_scan.isSpilled(temp))
+        return getLocation(temp);
+    AsmOperandPtr reg = makeReg(scratch);
+    addCmd(isXmmReg(scratch) ? MOVQ : MOV, reg, getLocation(temp));
+    return reg;
+}
+
+AsmOperandPtr IRLowering::getLocation(int temp) {
+    return _scan.getLocation(temp);
+}
+
+RegClass IRLowering::getClass(int temp) {
+    return _scan.getClass(temp);
+}
+
+void IRLowering::addCmd(AsmOpType op, const AsmOperandPtr& op1, const AsmOperandPtr& op2) {
+    _asmCode.addCmd(AsmCmdPtr(new AsmCmd(op, op1, op2)));
+}
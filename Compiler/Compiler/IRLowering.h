@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "AsmGen.h"
+#include "IR.h"
+#include "LinearScan.h"
+
+// Lowers an IRFunction to AsmCode. Temporaries are assigned to registers by
+// a linear scan over the blocks in layout order; Eval, Exec, Call and Write
+// instructions run stack-backend code or the output runtime and may use any
+// register, so temporaries live across them are spilled. A comparison feeding the
+// branch that ends its block jumps on the flags directly. Jumps to the next
+// block in layout are left out, and labels are only emitted for blocks that
+// are actually jumped to.
+class IRLowering {
+public:
+    IRLowering(AsmCode& asmCode);
+    void generate(IRFunction& function);
+private:
+    static bool isFusedCompare(const IRInstr& instr, const IRInstr& next);
+    static bool isClobbering(const IRInstr& instr);
+    void allocate(IRFunction& function);
+    void emit(const IRInstr& instr);
+    void emitBinary(const IRInstr& instr);
+    void emitUnary(const IRInstr& instr);
+    void emitTerminator(const IRInstr& instr, int next);
+    void emitCompareBranch(const IRInstr& compare, const IRInstr& branch, int next);
+    void emitCondJump(AsmOpType jump, const IRInstr& branch, int next);
+    void emitPop(int temp);
+    void emitMove(const AsmOperandPtr& dst, RegClass dstClass, const AsmOperandPtr& src, RegClass srcClass);
+    void emitBranch(AsmOpType op, int target);
+    AsmOperandPtr useReg(int temp, AsmRegType scratch);
+    AsmOperandPtr getLocation(int temp);
+    RegClass getClass(int temp);
+    void addCmd(AsmOpType op, const AsmOperandPtr& op1, const AsmOperandPtr& op2 = AsmOperandPtr());
+    AsmCode& _asmCode;
+    LinearScan _scan;
+    std::vector<std::string> _labels;
+    std::vector<bool> _isJumpTarget;
+    std::string _endLabel;
+};
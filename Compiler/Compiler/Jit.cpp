@@ -0,0 +1,100 @@
+#include "Jit.h"
+#include "error.h"
+#include "../Runtime/pasrt.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static const size_t pageSize = 0x1000;
+
+static const std::map<std::string, void*> runtimeFunctions = {
+    { "pas_write_int",  (void*)&pas_write_int },
+    { "pas_write_real", (void*)&pas_write_real },
+    { "pas_write_str",  (void*)&pas_write_str },
+    { "pas_writeln",    (void*)&pas_writeln },
+};
+
+// The output of the program running on this thread, which the runtime
+// flushes into.
+static thread_local std::string* output;
+
+static void capture(const char* data, size_t size) {
+    output->append(data, size);
+}
+
+static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint8_t* allocate(size_t size) {
+#ifdef _WIN32
+    void* memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        memory = nullptr;
+#endif
+    if (!memory)
+        throw std::bad_alloc();
+    return (uint8_t*)memory;
+}
+
+static bool makeExecutable(uint8_t* memory, size_t size) {
+#ifdef _WIN32
+    DWORD oldProtection;
+    return VirtualProtect(memory, size, PAGE_EXECUTE_READ, &oldProtection) != 0;
+#else
+    return mprotect(memory, size, PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+static void release(uint8_t* memory, size_t size) {
+#ifdef _WIN32
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, size);
+#endif
+}
+
+Jit::Jit(AsmObject& object) : _object(object) {}
+
+// The code takes whole pages, followed by the import slots and the data.
+std::string Jit::run(const std::string& entry) {
+    auto symbol = _object.symbols.find(entry);
+    if (symbol == _object.symbols.end())
+        throw UndefinedLabel(entry);
+    std::vector<void*> slots;
+    for (auto& import : _object.imports) {
+        auto function = runtimeFunctions.find(import);
+        if (function == runtimeFunctions.end())
+            throw UndefinedLabel(import);
+        slots.push_back(function->second);
+    }
+    size_t codeSize = alignUp(std::max<size_t>(_object.text.size(), 1), pageSize);
+    size_t dataOffset = alignUp(codeSize + slots.size() * sizeof(void*), std::max<size_t>(_object.dataAlignment, 8));
+    size_t size = dataOffset + _object.data.size();
+    uint8_t* memory = allocate(size);
+    _object.link((uint64_t)memory, (uint64_t)(memory + dataOffset), (uint64_t)(memory + codeSize));
+    std::copy(_object.text.begin(), _object.text.end(), memory);
+    std::memcpy(memory + codeSize, slots.data(), slots.size() * sizeof(void*));
+    std::copy(_object.data.begin(), _object.data.end(), memory + dataOffset);
+    if (!makeExecutable(memory, codeSize)) {
+        release(memory, size);
+        throw UnexecutableCode(codeSize);
+    }
+
+    std::string out;
+    output = &out;
+    pas_set_sink(capture);
+    ((void (*)())(memory + symbol->second.offset))();
+    pas_set_sink(nullptr);
+    output = nullptr;
+    release(memory, size);
+    return out;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include "AsmEncoder.h"
+
+// Runs a program assembled with AsmEntry::Call inside the compiler. The code
+// is copied into memory that is made executable once the fixups are done,
+// the runtime functions resolve to the ones the compiler links, and the
+// output is returned instead of printed. A program that faults takes the
+// compiler down with it.
+class Jit {
+public:
+    Jit(AsmObject& object);
+    std::string run(const std::string& entry);
+private:
+    AsmObject& _object;
+};
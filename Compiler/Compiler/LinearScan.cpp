@@ -0,0 +1,122 @@
+#include "LinearScan.h"
+
+#include <algorithm>
+
+// Allocatable registers. RAX, RCX, RDX and XMM0, XMM1 stay out of the pools:
+// code generators use them as scratch registers for spilled operands,
+// division, shifts and loads.
+static const AsmRegType gprPool[] = { RBX, R8, R9, R10, R11 };
+static const AsmRegType xmmPool[] = { XMM2, XMM3, XMM4, XMM5 };
+static const int gprPoolSize = sizeof(gprPool) / sizeof(gprPool[0]);
+static const int xmmPoolSize = sizeof(xmmPool) / sizeof(xmmPool[0]);
+
+LinearScan::LinearScan() : _slots(0) {}
+
+int LinearScan::addVReg(RegClass regClass) {
+    _classes.push_back(regClass);
+    _starts.push_back(-1);
+    _ends.push_back(-1);
+    _hints.push_back(-1);
+    return (int)_classes.size() - 1;
+}
+
+RegClass LinearScan::getClass(int vreg) {
+    return _classes[vreg];
+}
+
+void LinearScan::extend(int vreg, int position) {
+    if (_starts[vreg] < 0)
+        _starts[vreg] = position;
+    _ends[vreg] = std::max(_ends[vreg], position);
+}
+
+// Prefer the register of other if its interval ends where vreg starts, so
+// that copies between them vanish.
+void LinearScan::setHint(int vreg, int other) {
+    if (_classes[vreg] == _classes[other])
+        _hints[vreg] = other;
+}
+
+void LinearScan::addClobber(int position) {
+    _clobbers.push_back(position);
+}
+
+bool LinearScan::crossesClobber(int vreg) {
+    auto it = std::upper_bound(_clobbers.begin(), _clobbers.end(), _starts[vreg]);
+    return it != _clobbers.end() && *it < _ends[vreg];
+}
+
+void LinearScan::allocate() {
+    int count = (int)_classes.size();
+    _regs.assign(count, -1);
+    _locations.assign(count, AsmOperandPtr());
+    std::sort(_clobbers.begin(), _clobbers.end());
+    std::vector<int> order(count);
+    for (int i = 0; i < count; ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return _starts[a] < _starts[b]; });
+
+    std::vector<int> active;
+    std::vector<bool> isFree[] = { std::vector<bool>(gprPoolSize, true), std::vector<bool>(xmmPoolSize, true) };
+    for (int vreg : order) {
+        if (_starts[vreg] < 0)
+            continue;
+        int regClass = (int)_classes[vreg];
+        const AsmRegType* pool = _classes[vreg] == RegClass::Gpr ? gprPool : xmmPool;
+        int poolSize = _classes[vreg] == RegClass::Gpr ? gprPoolSize : xmmPoolSize;
+        for (size_t i = 0; i < active.size();) {
+            int other = active[i];
+            if (_ends[other] <= _starts[vreg]) {
+                isFree[(int)_classes[other]][_regs[other]] = true;
+                active.erase(active.begin() + i);
+            }
+            else
+                ++i;
+        }
+        if (crossesClobber(vreg)) {
+            spill(vreg);
+            continue;
+        }
+        int reg = -1;
+        int hint = _hints[vreg];
+        if (hint >= 0 && _regs[hint] >= 0 && isFree[regClass][_regs[hint]])
+            reg = _regs[hint];
+        for (int i = 0; reg < 0 && i < poolSize; ++i)
+            if (isFree[regClass][i])
+                reg = i;
+        if (reg < 0) {
+            int victim = -1;
+            for (int other : active)
+                if (_classes[other] == _classes[vreg] && (victim < 0 || _ends[other] > _ends[victim]))
+                    victim = other;
+            if (_ends[victim] <= _ends[vreg]) {
+                spill(vreg);
+                continue;
+            }
+            reg = _regs[victim];
+            spill(victim);
+            active.erase(std::find(active.begin(), active.end(), victim));
+        }
+        isFree[regClass][reg] = false;
+        _regs[vreg] = reg;
+        _locations[vreg] = AsmOperandPtr(new AsmReg(pool[reg]));
+        active.push_back(vreg);
+    }
+}
+
+void LinearScan::spill(int vreg) {
+    _regs[vreg] = -1;
+    _locations[vreg] = AsmOperandPtr(new AsmMemory(RSP, 8 * _slots++));
+}
+
+bool LinearScan::isSpilled(int vreg) {
+    return _regs[vreg] < 0;
+}
+
+const AsmOperandPtr& LinearScan::getLocation(int vreg) {
+    return _locations[vreg];
+}
+
+int LinearScan::getSlotCount() {
+    return _slots;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "AsmGen.h"
+
+enum class RegClass {
+    Gpr,
+    Xmm
+};
+
+// Linear-scan register allocation for straight-line machine code. Each
+// virtual register lives from its first to its last occurrence; intervals are
+// assigned registers in order of their start, and when a pool runs out the
+// interval that ends last goes to a stack slot. Positions marked as clobbers
+// (code that may use any register) cannot be spanned by a register, so
+// intervals crossing one are spilled. Spill slots are addressed relative to
+// RSP, so the caller reserves getSlotCount() qwords and keeps RSP fixed
+// between its own instructions.
+class LinearScan {
+public:
+    LinearScan();
+    int addVReg(RegClass regClass);
+    RegClass getClass(int vreg);
+    void extend(int vreg, int position);
+    void setHint(int vreg, int other);
+    void addClobber(int position);
+    void allocate();
+    bool isSpilled(int vreg);
+    const AsmOperandPtr& getLocation(int vreg);
+    int getSlotCount();
+private:
+    bool crossesClobber(int vreg);
+    void spill(int vreg);
+    std::vector<RegClass> _classes;
+    std::vector<int> _starts;
+    std::vector<int> _ends;
+    std::vector<int> _hints;
+    std::vector<int> _regs;
+    std::vector<AsmOperandPtr> _locations;
+    std::vector<int> _clobbers;
+    int _slots;
+};
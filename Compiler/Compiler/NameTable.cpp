@@ -0,0 +1,134 @@
+#include "NameTable.h"
+
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+// FNV-1a.
+static uint32_t hashText(const char* text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+NameTable::Slots::Slots(size_t size) : mask(size - 1), ids(new std::atomic<int>[size]) {
+    for (size_t i = 0; i < size; ++i)
+        ids[i].store(0, std::memory_order_relaxed);
+}
+
+NameTable::NameTable() : _nameCount(0) {
+    for (auto& shard : _shards) {
+        shard.tables.emplace_back(new Slots(256));
+        shard.slots.store(shard.tables.back().get(), std::memory_order_relaxed);
+        shard.count = 0;
+    }
+    for (auto& chunk : _chunks)
+        chunk.store(nullptr, std::memory_order_relaxed);
+}
+
+NameTable::~NameTable() {
+    for (auto& chunk : _chunks)
+        delete[] chunk.load(std::memory_order_relaxed);
+}
+
+NameTable& NameTable::instance() {
+    static NameTable table;
+    return table;
+}
+
+NameTable::Entry& NameTable::getEntry(int nameId) {
+    Entry* chunk = _chunks[nameId >> chunkBits].load(std::memory_order_acquire);
+    return chunk[nameId & ((1 << chunkBits) - 1)];
+}
+
+// The low bits of the hash pick the slot, the high ones the shard.
+int NameTable::find(const Slots& slots, uint32_t hash, const char* text, size_t length) {
+    for (size_t i = hash & slots.mask; ; i = (i + 1) & slots.mask) {
+        int id = slots.ids[i].load(std::memory_order_acquire);
+        if (!id)
+            return -1;
+        Entry& entry = getEntry(id - 1);
+        if (entry.hash == hash && entry.text.size() == length && !memcmp(entry.text.data(), text, length))
+            return id - 1;
+    }
+}
+
+int NameTable::getFoldedId(const char* text, size_t length) {
+    std::string folded(text, length);
+    for (auto& c : folded)
+        c = (char)tolower((unsigned char)c);
+    std::lock_guard<std::mutex> lock(_symbolMutex);
+    return _symbolIds.emplace(folded, (int)_symbolIds.size()).first->second;
+}
+
+// Called with the shard locked. The entry is complete before its id is
+// published in a slot, so a thread that finds the id sees the entry.
+int NameTable::add(Shard& shard, uint32_t hash, const char* text, size_t length) {
+    int nameId = _nameCount++;
+    if (nameId >> chunkBits >= chunkCount)
+        throw std::length_error("too many names");
+    auto& chunk = _chunks[nameId >> chunkBits];
+    if (!chunk.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(_chunkMutex);
+        if (!chunk.load(std::memory_order_relaxed))
+            chunk.store(new Entry[1 << chunkBits], std::memory_order_release);
+    }
+    Entry& entry = getEntry(nameId);
+    entry.text.assign(text, length);
+    entry.hash = hash;
+    entry.symbolId = getFoldedId(text, length);
+
+    Slots* slots = shard.slots.load(std::memory_order_relaxed);
+    if (2 * (shard.count + 1) > slots->mask + 1) {
+        Slots* grown = new Slots(2 * (slots->mask + 1));
+        shard.tables.emplace_back(grown);
+        for (size_t i = 0; i <= slots->mask; ++i) {
+            int id = slots->ids[i].load(std::memory_order_relaxed);
+            if (!id)
+                continue;
+            size_t j = getEntry(id - 1).hash & grown->mask;
+            while (grown->ids[j].load(std::memory_order_relaxed))
+                j = (j + 1) & grown->mask;
+            grown->ids[j].store(id, std::memory_order_relaxed);
+        }
+        shard.slots.store(grown, std::memory_order_release);
+        slots = grown;
+    }
+    size_t i = hash & slots->mask;
+    while (slots->ids[i].load(std::memory_order_relaxed))
+        i = (i + 1) & slots->mask;
+    slots->ids[i].store(nameId + 1, std::memory_order_release);
+    ++shard.count;
+    return nameId;
+}
+
+int NameTable::intern(const char* text, size_t length, int* symbolId) {
+    NameTable& table = instance();
+    uint32_t hash = hashText(text, length);
+    Shard& shard = table._shards[hash >> (32 - shardBits)];
+    int nameId = table.find(*shard.slots.load(std::memory_order_acquire), hash, text, length);
+    if (nameId < 0) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        nameId = table.find(*shard.slots.load(std::memory_order_relaxed), hash, text, length);
+        if (nameId < 0)
+            nameId = table.add(shard, hash, text, length);
+    }
+    if (symbolId != nullptr)
+        *symbolId = table.getEntry(nameId).symbolId;
+    return nameId;
+}
+
+int NameTable::intern(const std::string& text, int* symbolId) {
+    return intern(text.data(), text.size(), symbolId);
+}
+
+int NameTable::getSymbolId(int nameId) {
+    return instance().getEntry(nameId).symbolId;
+}
+
+const std::string& NameTable::getText(int nameId) {
+    return instance().getEntry(nameId).text;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Global identifier interner. Every distinct spelling gets a dense name id and
+// every case-folded spelling a dense symbol id, so "Foo" and "foo" have
+// different name ids but the same symbol id. Symbol tables are keyed on symbol
+// ids; name ids keep the original spelling for printing. Ids are never freed.
+//
+// Looking up a name already interned neither allocates nor locks, so lexer
+// and batch threads only contend when they add names. The spellings are
+// split into shards by hash; a shard's open-addressed table of name ids is
+// replaced, never changed in place, when it grows, and a thread that misses
+// in a table it loaded before the change looks again under the shard lock.
+class NameTable {
+public:
+    static int intern(const char* text, size_t length, int* symbolId = nullptr);
+    static int intern(const std::string& text, int* symbolId = nullptr);
+    static int getSymbolId(int nameId);
+    static const std::string& getText(int nameId);
+private:
+    struct Entry {
+        std::string text;
+        uint32_t hash;
+        int symbolId;
+    };
+    // Slots hold a name id plus one, or 0 when free.
+    struct Slots {
+        Slots(size_t size);
+        size_t mask;
+        std::unique_ptr<std::atomic<int>[]> ids;
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::atomic<Slots*> slots;
+        size_t count;
+        std::vector<std::unique_ptr<Slots>> tables;
+    };
+    static const int shardBits = 6;
+    static const int chunkBits = 14;
+    static const int chunkCount = 1 << 12;
+    NameTable();
+    ~NameTable();
+    static NameTable& instance();
+    Entry& getEntry(int nameId);
+    int find(const Slots& slots, uint32_t hash, const char* text, size_t length);
+    int add(Shard& shard, uint32_t hash, const char* text, size_t length);
+    int getFoldedId(const char* text, size_t length);
+    Shard _shards[1 << shardBits];
+    std::atomic<Entry*> _chunks[chunkCount];
+    std::atomic<int> _nameCount;
+    std::mutex _chunkMutex;
+    std::mutex _symbolMutex;
+    std::unordered_map<std::string, int> _symbolIds;
+};
@@ -0,0 +1,42 @@
+#include "NodeArena.h"
+#include "SynNode.h"
+
+#include <cstdint>
+
+NodeArena::NodeArena(size_t blockSize) :
+    _blockSize(blockSize) {}
+
+NodeArena::~NodeArena() {
+    clear();
+}
+
+void NodeArena::clear() {
+    for (auto it = _nodes.rbegin(); it != _nodes.rend(); ++it)
+        (*it)->~SynNode();
+    _nodes.clear();
+    _blocks.clear();
+    _bytesUsed = 0;
+    _pos = _end = nullptr;
+}
+
+size_t NodeArena::getNodeCount() const {
+    return _nodes.size();
+}
+
+size_t NodeArena::getBytesUsed() const {
+    return _bytesUsed;
+}
+
+void* NodeArena::allocate(size_t size, size_t align) {
+    uintptr_t pos = ((uintptr_t)_pos + align - 1) & ~(uintptr_t)(align - 1);
+    if (_pos == nullptr || pos + size > (uintptr_t)_end) {
+        size_t blockSize = size + align > _blockSize ? size + align : _blockSize;
+        _blocks.emplace_back(new char[blockSize]);
+        _pos = _blocks.back().get();
+        _end = _pos + blockSize;
+        pos = ((uintptr_t)_pos + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    _pos = (char*)(pos + size);
+    _bytesUsed += size;
+    return (void*)pos;
+}
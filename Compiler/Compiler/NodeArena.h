@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+class SynNode;
+
+// Bump-pointer arena owning the syntax tree of one compilation. Nodes are
+// placement-constructed into large blocks and link to each other through raw
+// pointers; the whole tree is destroyed at once when the arena is cleared or
+// goes away, so a node must never outlive the arena that made it.
+class NodeArena {
+public:
+    NodeArena(size_t blockSize = 1 << 16);
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+    ~NodeArena();
+    template<class T, class... Args>
+    T* make(Args&&... args);
+    void clear();
+    size_t getNodeCount() const;
+    size_t getBytesUsed() const;
+private:
+    void* allocate(size_t size, size_t align);
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    std::vector<SynNode*> _nodes;
+    size_t _blockSize;
+    size_t _bytesUsed = 0;
+    char* _pos = nullptr;
+    char* _end = nullptr;
+};
+
+template<class T, class... Args>
+inline T* NodeArena::make(Args&&... args) {
+    T* node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    _nodes.push_back(node);
+    return node;
+}
@@ -1,43 +1,121 @@
 #include "Parser.h"
 
-Parser::Parser(const char* fname, bool isSymbolCheck) :
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+// Binding power of the binary operators; every other token is none.
+// Operators of a higher level bind tighter and all of them are left
+// associative. The lookup table indexed by TokenType is built from the pairs
+// at compile time, so it does not depend on the enum order in Token.h.
+static constexpr signed char none = -1;
+static constexpr signed char relation = (signed char)Priority::Lowest;
+static constexpr signed char addition = (signed char)Priority::Third;
+static constexpr signed char multiplication = (signed char)Priority::Second;
+
+struct OperatorPriority {
+    TokenType type;
+    signed char priority;
+};
+
+static constexpr OperatorPriority binaryOperators[] = {
+    { TokenType::Equal,        relation },
+    { TokenType::NotEqual,     relation },
+    { TokenType::Less,         relation },
+    { TokenType::LessEqual,    relation },
+    { TokenType::Greater,      relation },
+    { TokenType::GreaterEqual, relation },
+    { TokenType::Add,          addition },
+    { TokenType::Sub,          addition },
+    { TokenType::Or,           addition },
+    { TokenType::Xor,          addition },
+    { TokenType::Mul,          multiplication },
+    { TokenType::DivReal,      multiplication },
+    { TokenType::Div,          multiplication },
+    { TokenType::Mod,          multiplication },
+    { TokenType::And,          multiplication },
+    { TokenType::Shl,          multiplication },
+    { TokenType::Shr,          multiplication },
+};
+
+static constexpr size_t tokenTypeCount = (size_t)TokenType::Writeln + 1;
+
+struct PriorityTable {
+    signed char priorities[tokenTypeCount];
+    bool hasDuplicate;
+};
+
+static constexpr PriorityTable makePriorityTable() {
+    PriorityTable result = {};
+    for (size_t i = 0; i < tokenTypeCount; ++i)
+        result.priorities[i] = none;
+    for (const OperatorPriority& op : binaryOperators) {
+        if (result.priorities[(size_t)op.type] != none)
+            result.hasDuplicate = true;
+        result.priorities[(size_t)op.type] = op.priority;
+    }
+    return result;
+}
+
+static constexpr PriorityTable binaryPriorities = makePriorityTable();
+static_assert(!binaryPriorities.hasDuplicate, "a binary operator is listed twice");
+
+static int getBinaryPriority(TokenType type) {
+    return binaryPriorities.priorities[(size_t)type];
+}
+
+static bool isUnaryOperation(TokenType type) {
+    return type == TokenType::Not || type == TokenType::Sub || type == TokenType::Add;
+}
+
+
+// With lexThreads, the whole file is lexed up front in chunks of at least
+// lexChunkSize bytes on that many threads (see Scanner::lexParallel).
+Parser::Parser(const char* fname, bool isSymbolCheck, unsigned lexThreads, size_t lexChunkSize) :
     _progName("main"),
     _scanner(fname),
     _symTables(SymTableStackPtr(new SymTableStack(SymTablePtr(new SymTable())))),
     _isSymbolCheck(isSymbolCheck),
-    _code() {
+    _code(),
+    _isIRLowering(false),
+    _isConstFolding(true),
+    _isShortCircuit(false),
+    _runner(ProgramRunner::Executable),
+    _profiler(nullptr) {
 
+    if (lexThreads > 0)
+        _scanner.lexParallel(lexThreads, lexChunkSize);
+    init();
+}
+
+Parser::Parser(const char* data, size_t size, bool isSymbolCheck) :
+    _progName("main"),
+    _scanner(data, size),
+    _symTables(SymTableStackPtr(new SymTableStack(SymTablePtr(new SymTable())))),
+    _isSymbolCheck(isSymbolCheck),
+    _code(),
+    _isIRLowering(false),
+    _isConstFolding(true),
+    _isShortCircuit(false),
+    _runner(ProgramRunner::Executable),
+    _profiler(nullptr) {
+
+    init();
+}
+
+void Parser::init() {
     _scanner.next();
-    _priorityTable = {
-        {
-            TokenType::Equal,
-            TokenType::NotEqual,
-            TokenType::Greater,
-            TokenType::GreaterEqual,
-            TokenType::Less,
-            TokenType::LessEqual
-        },
-        {
-            TokenType::Add,
-            TokenType::Sub,
-            TokenType::Or,
-            TokenType::Xor
-        },
-        {
-            TokenType::Mul,
-            TokenType::Div,
-            TokenType::DivReal,
-            TokenType::Mod,
-            TokenType::And,
-            TokenType::Shl,
-            TokenType::Shr
-        },
-        {
-            TokenType::Not,
-            TokenType::Sub,
-            TokenType::Add
-        }
-    };
 
     _computableUnOps[TokenType::Sub] = &Const::ComputeUnarySubtraction;
     _computableUnOps[TokenType::Not] = &Const::ComputeUnaryNeagtion;
@@ -48,6 +126,9 @@ Parser::Parser(const char* fname, bool isSymbolCheck) :
     _computableBinOps[TokenType::Mul] = &Const::ComputeBinaryMultiplication;
     _computableBinOps[TokenType::Div] = &Const::ComputeBinaryDiv;
     _computableBinOps[TokenType::DivReal] = &Const::ComputeBinaryDivision;
+    _computableBinOps[TokenType::Mod] = &Const::ComputeBinaryMod;
+    _computableBinOps[TokenType::Shl] = &Const::ComputeBinaryShl;
+    _computableBinOps[TokenType::Shr] = &Const::ComputeBinaryShr;
     _computableBinOps[TokenType::Equal] = &Const::ComputeBinaryEq;
     _computableBinOps[TokenType::NotEqual] = &Const::ComputeBinaryNe;
     _computableBinOps[TokenType::Greater] = &Const::ComputeBinaryGt;
@@ -82,40 +163,242 @@ std::string Parser::getStmtStr() {
     return parse()->toString("", true);
 }
 
-std::string Parser::getAsmStr() {
+// Names the files of one build, so that builds running at the same time in
+// this process or in another one in the same directory keep apart.
+static std::string getBuildName() {
+    static std::atomic<unsigned> count(0);
+    return "tmp-" + std::to_string(getpid()) + "-" + std::to_string(count++);
+}
+
+// Held while a command starts and while the compiler writes an executable. A
+// child gets a copy of every descriptor open when it is started, and keeps it
+// until it runs its own program; a file open for writing in any process cannot
+// be run, so programs written on other threads must not be open meanwhile.
+static std::mutex commandMutex;
+
+// Runs the command with the shell and waits for it, timed as the phase. A
+// command that cannot be started or does not exit with 0 throws.
+static void runCommand(Profiler* profiler, const char* phase, const std::string& command) {
+    Profiler::Scope scope(profiler, phase);
+#ifdef _WIN32
+    if (system(command.c_str()))
+        throw CommandFailed(command);
+#else
+    const char* argv[] = { "sh", "-c", command.c_str(), nullptr };
+    pid_t pid;
+    int error;
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        error = posix_spawn(&pid, "/bin/sh", nullptr, nullptr, (char**)argv, environ);
+    }
+    int status;
+    if (error || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+        throw CommandFailed(command);
+#endif
+}
+
+static void removeFiles(const std::vector<std::string>& files) {
+    for (auto& file : files)
+        std::remove(file.c_str());
+}
+
+void Parser::generate() {
     parse();
-    for (auto symbol : _symTables->top()->getSymbols()) {
-        symbol->generateDecl(_code);
-        if (symbol->getType() == SymbolType::Proc || symbol->getType() == SymbolType::Func)
-            generateProc(symbol, 0);
-    }
-    _code.addLabel(std::string("main"));
-    _code.addCmd(MOV, RBP, RSP);
-    _root->generate(_code);
-    //_code.addCmd(MOV, RBP, RSP);
-    std::ofstream tmp("tmp.asm");
-    tmp << _code.toString();
-    tmp.close();
-    system("nasm -f win64 tmp.asm -o tmp.o");
-    system("gcc tmp.o -o tmp.exe");
-    system("tmp.exe > tmp.out");
+    foldConstants();
+    {
+        Profiler::Scope scope(_profiler, "generate");
+        for (auto symbol : _symTables->top()->getSymbols()) {
+            symbol->generateDecl(_code);
+            if (symbol->getType() == SymbolType::Proc || symbol->getType() == SymbolType::Func)
+                generateProc(symbol, 0);
+        }
+        _code.addLabel(std::string("main"));
+        _code.addCmd(MOV, RBP, RSP);
+        generateBody("main", _root);
+        //_code.addCmd(MOV, RBP, RSP);
+    }
+    Profiler::Scope scope(_profiler, "peephole");
+    _code.optimize(_peephole);
+}
+
+std::string Parser::getAsmStr() {
+    generate();
+    if (_runner == ProgramRunner::Jit && _code.getTarget() == AsmCode::getHostTarget() && _outputFile.empty())
+        return runInMemory();
+    std::string name = getBuildName();
+    std::string program = _code.getTarget() == AsmTarget::Win64 ? name + ".exe" : name;
+    std::vector<std::string> files = { name + ".out", program };
+    try {
+        if (_code.getTarget() == AsmTarget::Win64) {
+            files.insert(files.end(), { name + ".asm", name + ".o" });
+            writeAsm(name + ".asm");
+            runCommand(_profiler, "nasm", "nasm -f win64 " + name + ".asm -o " + name + ".o");
+            runCommand(_profiler, "gcc", "gcc " + name + ".o ../Runtime/pasrt.c -o " + name + ".exe");
+            runCommand(_profiler, "run", name + ".exe > " + name + ".out");
+        }
+        else {
+            if (_runner == ProgramRunner::ExternalAssembler) {
+                // Variables are addressed absolutely, which a position-independent
+                // executable cannot relocate.
+                files.insert(files.end(), { name + ".asm", name + ".o" });
+                writeAsm(name + ".asm");
+                runCommand(_profiler, "nasm", "nasm -f elf64 " + name + ".asm -o " + name + ".o");
+                runCommand(_profiler, "gcc", "gcc -no-pie " + name + ".o ../Runtime/pasrt.c -o " + name);
+            }
+            else
+                writeExecutable(name);
+            runCommand(_profiler, "run", "./" + name + " > " + name + ".out");
+        }
+        if (!_outputFile.empty()) {
+            std::remove(_outputFile.c_str());
+            if (std::rename(program.c_str(), _outputFile.c_str()))
+                throw UnwritableFile(_outputFile);
+            files.erase(std::find(files.begin(), files.end(), program));
+        }
+    }
+    catch (...) {
+        removeFiles(files);
+        throw;
+    }
     //system("run_asm.bat");
-    std::ifstream sout("tmp.out");
+    std::ifstream sout(name + ".out");
     std::string out;
     out = std::string(std::istreambuf_iterator<char>(sout),
                       std::istreambuf_iterator<char>());
     sout.close();
+    removeFiles(files);
     return out;
 }
 
-PNode Parser::parseExpr(int priority) {
-    if (priority == (int)Priority::Highest) return parseFactor();
-    PNode result = parseExpr(priority + 1);
+// The nasm listing of the program, which is neither built nor run.
+std::string Parser::getListing() {
+    generate();
+    Profiler::Scope scope(_profiler, "listing");
+    return _code.toString();
+}
+
+// Every setting that changes the generated code, spelled out; parsers with
+// equal settings give equal text.
+std::string Parser::getCodeOptions() {
+    std::string options = "backend " + std::to_string((int)_code.getBackend())
+        + " target " + std::to_string((int)_code.getTarget())
+        + " align " + std::to_string(_code.getConstAlignment())
+        + " check " + std::to_string(_isSymbolCheck)
+        + " ir " + std::to_string(_isIRLowering)
+        + " fold " + std::to_string(_isConstFolding)
+        + " short " + std::to_string(_isShortCircuit)
+        + " peephole ";
+    for (int rule = 0; rule < (int)PeepholeRule::Count; ++rule)
+        options += _peephole.isEnabled((PeepholeRule)rule) ? '1' : '0';
+    return options;
+}
+
+void Parser::writeAsm(const std::string& fileName) {
+    std::ofstream out(fileName);
+    if (!out)
+        throw UnwritableFile(fileName);
+    Profiler::Scope scope(_profiler, "listing");
+    out << _code.toString();
+}
+
+// Assembles and links in process. The program carries its own write
+// functions and only needs the C library, so it runs from any directory.
+void Parser::writeExecutable(const std::string& fileName) {
+    AsmObject object;
+    {
+        Profiler::Scope scope(_profiler, "assemble");
+        _code.assemble(object, AsmEntry::Executable);
+    }
+    Profiler::Scope scope(_profiler, "write");
+    ElfWriter writer(object);
+    writer.addLibrary("libc.so.6");
+    std::lock_guard<std::mutex> lock(commandMutex);
+    writer.write(fileName, "_start");
+}
+
+std::string Parser::runInMemory() {
+    AsmObject object;
+    {
+        Profiler::Scope scope(_profiler, "assemble");
+        _code.assemble(object, AsmEntry::Call);
+    }
+    Profiler::Scope scope(_profiler, "run");
+    return Jit(object).run("_call_main");
+}
+
+std::string Parser::getIRStr() {
+    parse();
+    foldConstants();
+    std::string out;
+    for (auto symbol : _symTables->top()->getSymbols())
+        if (symbol->getType() == SymbolType::Proc || symbol->getType() == SymbolType::Func)
+            out += getProcIRStr(symbol);
+    IRFunction function("main");
+    IRBuilder(function).build(_root);
+    return out + function.toString();
+}
+
+Peephole& Parser::getPeephole() {
+    return _peephole;
+}
+
+void Parser::setBackend(AsmBackend backend) {
+    _code.setBackend(backend);
+}
+
+void Parser::setTarget(AsmTarget target) {
+    _code.setTarget(target);
+}
+
+void Parser::setRunner(ProgramRunner runner) {
+    _runner = runner;
+}
+
+// getAsmStr keeps the program it builds as fileName instead of removing it,
+// building one even when it would otherwise run the program in memory.
+void Parser::setOutputFile(const std::string& fileName) {
+    _outputFile = fileName;
+}
+
+// Scanning runs ahead of parsing from here on, so that it is timed by itself.
+void Parser::setProfiler(Profiler* profiler) {
+    _profiler = profiler;
+    _typeChecker.setProfiler(profiler);
+    Profiler::Scope scope(profiler, "scan");
+    if (profiler)
+        _scanner.lexRest();
+}
+
+void Parser::setIRLowering(bool isEnabled) {
+    _isIRLowering = isEnabled;
+}
+
+void Parser::setConstFolding(bool isEnabled) {
+    _isConstFolding = isEnabled;
+}
+
+void Parser::setConstAlignment(int alignment) {
+    _code.setConstAlignment(alignment);
+}
+
+// Borland's {$B-}: conditions stop evaluating and/or as soon as the left
+// operand decides them. Takes effect on the operators parsed after the call.
+void Parser::setShortCircuit(bool isEnabled) {
+    _isShortCircuit = isEnabled;
+}
+
+// Precedence climbing: parses a factor, then folds in binary operators whose
+// priority is at least minPriority, parsing each right operand one level up.
+PNode Parser::parseExpr(int minPriority) {
+    PNode result = parseFactor();
     TokenPtr t = _scanner.getToken();
-    while (checkPriority(priority, t->getType())) {
+    int priority;
+    while ((priority = getBinaryPriority(t->getType())) >= minPriority) {
         _scanner.next();
         PNode right = parseExpr(priority + 1);
-        result = PNode(new BinOpNode(t, result, right));
+        BinOpNode* node = _nodes.make<BinOpNode>(t, result, right);
+        node->setShortCircuit(_isShortCircuit);
+        result = node;
         t = _scanner.getToken();
     }
     return result;
@@ -123,10 +406,10 @@ PNode Parser::parseExpr(int priority) {
 
 PNode Parser::parseFactor() {
     TokenPtr t = _scanner.getToken();
-    if (checkPriority((int)Priority::Highest, t->getType())) {
+    if (isUnaryOperation(t->getType())) {
         _scanner.next();
-        PNode node = parseExpr((int)Priority::Highest);
-        return PNode(new UnaryNode(t, node));
+        PNode node = parseFactor();
+        return _nodes.make<UnaryNode>(t, node);
     }
     switch (t->getType()) {
         case TokenType::EndOfFile:
@@ -135,13 +418,13 @@ PNode Parser::parseFactor() {
             return parseIdentifier();
         case TokenType::IntegerNumber:
             _scanner.next();
-            return PNode(new IntConstNode(std::stoi(t->getValue())));
+            return _nodes.make<IntConstNode>(t->getIntValue());
         case TokenType::RealNumber:
             _scanner.next();
-            return PNode(new RealConstNode(std::stod(t->getValue())));
+            return _nodes.make<RealConstNode>(t->getRealValue());
         case TokenType::String:
             _scanner.next();
-            return PNode(new StringConstNode(t->getValue()));
+            return _nodes.make<StringConstNode>(t->getStringValue());
         case TokenType::OpeningParenthesis:
         {
             _scanner.next();
@@ -159,14 +442,14 @@ PNode Parser::parseOnlyIdentifier() {
     TokenPtr t = _scanner.getToken();
     TokenPtr indentToken = t;
     SymbolPtr sym = _symTables->getSymbol(t, _isSymbolCheck);
-    return PNode(new IdentifierNode(t->getValue(), sym));
+    return _nodes.make<IdentifierNode>(t->getNameId(), sym);
 }
 
 PNode Parser::parseIdentifier() {
     TokenPtr t = _scanner.getToken();
     TokenPtr indentToken = t;
     SymbolPtr sym = _symTables->getSymbol(t, _isSymbolCheck);
-    PNode result(new IdentifierNode(t->getValue(), sym));
+    PNode result = _nodes.make<IdentifierNode>(t->getNameId(), sym);
     bool isDone = false;
     while (!isDone) {
         t = _scanner.getNextToken();
@@ -183,13 +466,13 @@ PNode Parser::parseIdentifier() {
                     _symTables->pop();
                     SymbolPtr attr = sym->getVarTypeSymbol();
                     SymTypeRecordPtr rec = std::dynamic_pointer_cast<SymTypeRecord>(attr);
-                    if (!rec->have(t->getText()))
+                    if (!rec->have(t->getSymbolId()))
                         throw NoMember(t->getLine(), t->getCol(), t->getText());
-                    result = PNode(new RecordAccessNode(result, right, sym));
-                    sym = rec->getSymbol(t->getText());
+                    result = _nodes.make<RecordAccessNode>(result, right, sym);
+                    sym = rec->getSymbol(t->getSymbolId());
                 }
                 else
-                    result = PNode(new RecordAccessNode(result, parseOnlyIdentifier()));
+                    result = _nodes.make<RecordAccessNode>(result, parseOnlyIdentifier());
                 break;
             }
             case TokenType::OpeningSquareBracket:
@@ -206,7 +489,7 @@ PNode Parser::parseIdentifier() {
                     else
                         attr = sym;
                 }
-                result = PNode(new ArrayIndexNode(result, args, sym));
+                result = _nodes.make<ArrayIndexNode>(result, args, sym);
                 sym = attr;
                 _scanner.expect(TokenType::ClosingSquareBracket);
                 break;
@@ -225,7 +508,7 @@ PNode Parser::parseIdentifier() {
                     throw WrongNumberOfParam(indentToken->getLine(), indentToken->getCol(), indentToken->getText());
                 for (int i = 0; i < args.size(); ++i)
                     expectType(procArgs[i]->getVarType(), args[i], t);
-                result = PNode(new CallNode(result, args, sym));
+                result = _nodes.make<CallNode>(result, args, sym);
                 break;
             }
             default:
@@ -245,8 +528,8 @@ PNode Parser::parseStatement() {
         case TokenType::If: statement = parseIfStatement(); break;
         case TokenType::For: statement = parseForStatement(); break;
         case TokenType::Repeat: statement = parseRepeatStatement(); break;
-        case TokenType::Semicolon: statement = PNode(new EmptyNode()); break;
-        case TokenType::End: statement = PNode(new EmptyNode()); break;
+        case TokenType::Semicolon: statement = _nodes.make<EmptyNode>(); break;
+        case TokenType::End: statement = _nodes.make<EmptyNode>(); break;
         case TokenType::Write: statement = parseWrite(); break;
         case TokenType::Writeln: statement = parseWriteln(); break;
         case TokenType::Break: statement = parseBreak(); break;
@@ -257,7 +540,7 @@ PNode Parser::parseStatement() {
 }
 
 PNode Parser::parseCompoundStatement(std::string name) {
-    BlockNode* block = new BlockNode(name);
+    BlockNode* block = _nodes.make<BlockNode>(name);
     parseStatementSequence(block);
     if (getToken()->getType() != TokenType::End) {
         _scanner.expect(TokenType::Semicolon);
@@ -265,7 +548,7 @@ PNode Parser::parseCompoundStatement(std::string name) {
     }
     _scanner.expect(TokenType::End);
     _scanner.next();
-    return PNode(block);
+    return block;
 }
 
 void Parser::parseStatementSequence(BlockNode* block) {
@@ -290,7 +573,7 @@ PNode Parser::parseIfStatement() {
         _scanner.next();
         els = parseStatement();
     }
-    return PNode(new IfNode(cond, then, els));
+    return _nodes.make<IfNode>(cond, then, els);
 }
 
 PNode Parser::parseWhileStatement() {
@@ -300,7 +583,7 @@ PNode Parser::parseWhileStatement() {
     _scanner.expect(TokenType::Do);
     _scanner.next();
     PNode block = parseStatement();
-    return PNode(new WhileNode(cond, block));
+    return _nodes.make<WhileNode>(cond, block);
 }
 
 PNode Parser::parseForStatement() {
@@ -322,7 +605,7 @@ PNode Parser::parseForStatement() {
         _scanner.expect(TokenType::Do);
         _scanner.next();
         PNode stmt = parseStatement();
-        return PNode(new ForNode(varSym, initial_exp, final_exp, stmt, isTo));
+        return _nodes.make<ForNode>(varSym, initial_exp, final_exp, stmt, isTo);
     }
     else {
         TokenPtr t = getToken();
@@ -331,7 +614,7 @@ PNode Parser::parseForStatement() {
 }
 
 PNode Parser::parseRepeatStatement() {
-    BlockNode* body = new BlockNode("repeat block");
+    BlockNode* body = _nodes.make<BlockNode>("repeat block");
     parseStatementSequence(body);
     if (getToken()->getType() == TokenType::Semicolon)
         _scanner.next();
@@ -339,7 +622,7 @@ PNode Parser::parseRepeatStatement() {
     TokenPtr tok = getNextToken();
     PNode cond = parseExpr(0);
     expectType(SymbolType::TypeBoolean, cond, tok);
-    return PNode(new RepeatNode(cond, PNode(body)));
+    return _nodes.make<RepeatNode>(cond, body);
 }
 
 PNode Parser::parseIdentifierStatement() {
@@ -349,10 +632,10 @@ PNode Parser::parseIdentifierStatement() {
         TokenPtr tmp = getNextToken();
         PNode right = parseExpr(0);
         if (right->getNodeType() == SynNodeType::Call)
-            if (std::dynamic_pointer_cast<CallNode>(right)->getSymbol()->getType() == SymbolType::Proc)
+            if (dynamic_cast<CallNode*>(right)->getSymbol()->getType() == SymbolType::Proc)
                 throw ProcAssignment(tmp->getLine(), tmp->getCol());
         expectType(_typeChecker.getExprType(expr), right, tmp);
-        return PNode(new AssignmentNode(tok, expr, right));
+        return _nodes.make<AssignmentNode>(tok, expr, right);
     }
     /*else if (expr->getNodeType() != SynNodeType::Call) {
         throw InvalidExpression(tok->getLine(), tok->getCol());*/
@@ -414,7 +697,7 @@ SymbolPtr Parser::parseArray() {
 SymbolPtr Parser::parseSubrange() {
     TokenPtr token = getToken();
     if (token->getType() == TokenType::Identifier) {
-        if (_symTables->haveSymbol(token->getText())) {
+        if (_symTables->haveSymbol(token->getSymbolId())) {
             SymbolPtr symbol = _symTables->getSymbol(token, _isSymbolCheck);
             if (symbol->getType() == SymbolType::TypeAlias &&
                 std::dynamic_pointer_cast<SymTypeAlias>(symbol)->getRefType() == SymbolType::TypeSubrange) {
@@ -442,6 +725,7 @@ SymbolPtr Parser::parsePointer() {
 }
 
 PNode Parser::parse() {
+    Profiler::Scope scope(_profiler, "parse");
     parseDeclaration(0, true);
     _scanner.expect(TokenType::Begin);
     PNode stmt = parseCompoundStatement("main block");
@@ -545,18 +829,18 @@ void Parser::parseConstDeclaration() {
         if (type != nullptr) {
             if (_typeChecker.checkExprType(type->getType(), expr)) {
                 if (type->getType() == SymbolType::TypeInteger)
-                    constSymbol = SymbolPtr(new SymIntegerConst(identifier, (int)(value.value)));
+                    constSymbol = SymbolPtr(new SymIntegerConst(identifier, value.getValue<i64>()));
                 else if (type->getType() == SymbolType::TypeReal)
-                    constSymbol = SymbolPtr(new SymRealConst(identifier, value.value));
+                    constSymbol = SymbolPtr(new SymRealConst(identifier, value.getValue<double>()));
             }
             else
                 throw BadType(getToken()->getLine(), getToken()->getCol(), _typeChecker.typeNames[expr->getType()], type->getName());
         }
         else {
             if (value.type == exprType::Integer)
-                constSymbol = SymbolPtr(new SymIntegerConst(identifier, (int)(value.value)));
+                constSymbol = SymbolPtr(new SymIntegerConst(identifier, value.getValue<i64>()));
             else if (value.type == exprType::Real)
-                constSymbol = SymbolPtr(new SymRealConst(identifier, value.value));
+                constSymbol = SymbolPtr(new SymRealConst(identifier, value.getValue<double>()));
         }
         _symTables->top()->add(constSymbol);
         _scanner.expect(TokenType::Semicolon);
@@ -568,10 +852,10 @@ SymbolPtr Parser::parseConst(std::string identifier) {
     PNode expr = parseExpr(0);
     Const value = ComputeConstantExpression(expr);
     if (value.type == exprType::Integer) {
-        return SymbolPtr(new SymIntegerConst(identifier, (int)(value.value)));
+        return SymbolPtr(new SymIntegerConst(identifier, value.getValue<i64>()));
     }
     else {
-        return SymbolPtr(new SymRealConst(identifier, value.value));
+        return SymbolPtr(new SymRealConst(identifier, value.getValue<double>()));
     }
 }
 
@@ -626,16 +910,20 @@ void Parser::parseProcDeclaration(int depth) {
     _symTables->pop();
 }
 
+// Each procedure is timed apart from the ones nested in it.
 void Parser::generateProc(SymbolPtr symbol, int depth) {
     SymProcBasePtr proc = std::dynamic_pointer_cast<SymProcBase>(symbol);
-    _code.addLabel(symbol->getName() + std::to_string(proc->getDepth()));
-    _code.addCmd(PUSH, RBP);
-    _code.addCmd(MOV, RBP, RSP);
-    _code.addCmd(SUB, RSP, proc->getLocals()->getSize());
-    _procedureBodies[symbol]->generate(_code);
-    _code.addCmd(MOV, RSP, RBP);
-    _code.addCmd(POP, RBP);
-    _code.addCmd(RET);
+    {
+        Profiler::Scope scope(_profiler, "proc " + symbol->getName());
+        _code.addLabel(symbol->getName() + std::to_string(proc->getDepth()));
+        _code.addCmd(PUSH, RBP);
+        _code.addCmd(MOV, RBP, RSP);
+        _code.addCmd(SUB, RSP, proc->getLocals()->getSize());
+        generateBody(symbol->getName(), _procedureBodies[symbol]);
+        _code.addCmd(MOV, RSP, RBP);
+        _code.addCmd(POP, RBP);
+        _code.addCmd(RET);
+    }
     for (auto sym : proc->getLocals()->getSymbols()) {
         //if (sym->getName() == "write" && sym->getName() == "writeln") {
         //    throw "Error"; //todo, maybe replace
@@ -645,13 +933,46 @@ void Parser::generateProc(SymbolPtr symbol, int depth) {
     }
 }
 
+void Parser::foldConstants() {
+    if (!_isConstFolding)
+        return;
+    Profiler::Scope scope(_profiler, "fold");
+    ConstFolder folder(_nodes);
+    for (auto& body : _procedureBodies)
+        folder.fold(body.second);
+    folder.fold(_root);
+}
+
+// Statement bodies go through the IR when it is enabled and straight to the
+// stack backend otherwise.
+void Parser::generateBody(const std::string& name, PNode body) {
+    if (!_isIRLowering) {
+        body->generate(_code);
+        return;
+    }
+    IRFunction function(name);
+    IRBuilder(function).build(body);
+    IRLowering(_code).generate(function);
+}
+
+std::string Parser::getProcIRStr(SymbolPtr symbol) {
+    SymProcBasePtr proc = std::dynamic_pointer_cast<SymProcBase>(symbol);
+    IRFunction function(symbol->getName());
+    IRBuilder(function).build(_procedureBodies[symbol]);
+    std::string out = function.toString();
+    for (auto sym : proc->getLocals()->getSymbols())
+        if (sym->getType() == SymbolType::Proc || sym->getType() == SymbolType::Func)
+            out += getProcIRStr(sym);
+    return out;
+}
+
 PNode Parser::parseWrite() {
     _scanner.next();
     _scanner.expect(TokenType::OpeningParenthesis);
     _scanner.next();
     std::vector<PNode> args = getArgsArray(TokenType::ClosingParenthesis);
     _scanner.next();
-    return PNode(new WriteNode(PNode(new IdentifierNode("write", nullptr)), args));
+    return _nodes.make<WriteNode>(_nodes.make<IdentifierNode>(NameTable::intern("write"), nullptr), args);
 }
 
 PNode Parser::parseWriteln() {
@@ -660,17 +981,17 @@ PNode Parser::parseWriteln() {
     _scanner.next();
     std::vector<PNode> args = getArgsArray(TokenType::ClosingParenthesis);
     _scanner.next();
-    return PNode(new WritelnNode(PNode(new IdentifierNode("writeln", nullptr)), args));
+    return _nodes.make<WritelnNode>(_nodes.make<IdentifierNode>(NameTable::intern("writeln"), nullptr), args);
 }
 
 PNode Parser::parseBreak() {
     _scanner.next();
-    return PNode(new BreakNode());
+    return _nodes.make<BreakNode>();
 }
 
 PNode Parser::parseContinue() {
     _scanner.next();
-    return PNode(new ContinueNode());
+    return _nodes.make<ContinueNode>();
 }
 
 SymbolPtr Parser::parseType() {
@@ -778,31 +1099,36 @@ Const Parser::ComputeConstantExpression(PNode node) {
         throw InvalidExpression(getToken()->getLine(), getToken()->getCol());
 
     if (*node == SynNodeType::UnaryOp) {
-        auto it = _computableUnOps.find(std::dynamic_pointer_cast<OpNode>(node)->getOpType());
+        auto it = _computableUnOps.find(dynamic_cast<OpNode*>(node)->getOpType());
         if (it == _computableUnOps.end())
             throw InvalidExpression(getToken()->getLine(), getToken()->getCol());
-        return  (*(it->second))(ComputeConstantExpression(std::dynamic_pointer_cast<UnaryNode>(node)->getArg()));
+        return  (*(it->second))(ComputeConstantExpression(dynamic_cast<UnaryNode*>(node)->getArg()));
     }
     else if (*node == SynNodeType::BinaryOp) {
-        auto it = _computableBinOps.find(std::dynamic_pointer_cast<OpNode>(node)->getOpType());
+        auto it = _computableBinOps.find(dynamic_cast<OpNode*>(node)->getOpType());
         if (it == _computableBinOps.end())
             throw InvalidExpression(getToken()->getLine(), getToken()->getCol());
-        return (*(it->second))(ComputeConstantExpression(std::dynamic_pointer_cast<BinOpNode>(node)->getLeft()),
-                               ComputeConstantExpression(std::dynamic_pointer_cast<BinOpNode>(node)->getRight()));
+        Const left = ComputeConstantExpression(dynamic_cast<BinOpNode*>(node)->getLeft());
+        Const right = ComputeConstantExpression(dynamic_cast<BinOpNode*>(node)->getRight());
+        TokenType op = dynamic_cast<OpNode*>(node)->getOpType();
+        if ((op == TokenType::Div || op == TokenType::Mod || op == TokenType::DivReal) &&
+            left.type == exprType::Integer && right.isIntZero())
+            throw InvalidExpression(getToken()->getLine(), getToken()->getCol());
+        return (*(it->second))(left, right);
     }
     else if (*node == SynNodeType::RealNumber) {
-        return Const(exprType::Real, std::dynamic_pointer_cast<RealConstNode>(node)->getValue());
+        return Const(dynamic_cast<RealConstNode*>(node)->getValue());
     }
     else if (*node == SynNodeType::IntegerNumber) {
-        return Const(exprType::Integer, std::dynamic_pointer_cast<IntConstNode>(node)->getValue());
+        return Const(dynamic_cast<IntConstNode*>(node)->getValue());
     }
     else if (*node == SynNodeType::Identifier) {
-        SymbolPtr symb = _symTables->top()->getSymbol(std::dynamic_pointer_cast<IdentifierNode>(node)->getName());
+        SymbolPtr symb = _symTables->top()->getSymbol(dynamic_cast<IdentifierNode*>(node)->getSymbolId());
         switch (symb->getType()) {
             case SymbolType::ConstInteger:
-                return Const(exprType::Integer, std::dynamic_pointer_cast<SymIntegerConst>(symb)->getValue());
+                return Const(std::dynamic_pointer_cast<SymIntegerConst>(symb)->getValue());
             case SymbolType::ConstReal:
-                return Const(exprType::Real, std::dynamic_pointer_cast<SymRealConst>(symb)->getValue());
+                return Const(std::dynamic_pointer_cast<SymRealConst>(symb)->getValue());
             default:
                 throw InvalidExpression(getToken()->getLine(), getToken()->getCol());
         }
@@ -832,10 +1158,6 @@ void Parser::setSymbolCheck(bool isCheck) {
     _isSymbolCheck = isCheck;
 }
 
-bool Parser::checkPriority(int priority, TokenType tt) {
-    return _priorityTable[priority].find(tt) != _priorityTable[priority].end();
-}
-
 bool Parser::checkSymbolType(SymbolPtr symbol, SymbolType expectedType, TokenPtr token) {
     if (symbol->getType() != expectedType) {
         throw "Expected error";
@@ -5,9 +5,17 @@
 #include <fstream>
 #include "Scanner.h"
 #include "SynNode.h"
+#include "NodeArena.h"
 #include "Symbol.h"
 #include "TypeChecker.h"
 #include "Const.h"
+#include "Peephole.h"
+#include "ConstFolder.h"
+#include "IRBuilder.h"
+#include "IRLowering.h"
+#include "ElfWriter.h"
+#include "Jit.h"
+#include "Profiler.h"
 
 enum class Priority {
     Lowest = 0,
@@ -16,21 +24,48 @@ enum class Priority {
     Highest = 3
 };
 
+// How getAsmStr builds and runs the program: as a Linux executable the
+// compiler writes itself, in memory inside the compiler when the target is
+// the platform it runs on, or from the nasm listing with nasm and gcc, which
+// is what Win64 programs always take otherwise.
+enum class ProgramRunner {
+    Executable,
+    Jit,
+    ExternalAssembler
+};
+
 class Parser {
 public:
-    Parser(const char*, bool isSymbolCheck = true);
+    Parser(const char*, bool isSymbolCheck = true, unsigned lexThreads = 0,
+           size_t lexChunkSize = Scanner::defaultChunkSize);
+    Parser(const char* data, size_t size, bool isSymbolCheck);
     std::string getNodeTreeStr();
     std::string getDeclStr();
     std::string getProgStr();
     std::string getStmtStr();
     std::string getAsmStr();
+    std::string getListing();
+    std::string getCodeOptions();
+    std::string getIRStr();
+    Peephole& getPeephole();
+    void setBackend(AsmBackend backend);
+    void setTarget(AsmTarget target);
+    void setRunner(ProgramRunner runner);
+    void setOutputFile(const std::string& fileName);
+    void setProfiler(Profiler* profiler);
+    void setIRLowering(bool isEnabled);
+    void setConstFolding(bool isEnabled);
+    void setShortCircuit(bool isEnabled);
+    void setConstAlignment(int alignment);
     std::vector<PNode> parseCommaSeparated();
     void setSymbolCheck(bool isCheck);
 private:
+    friend class Benchmark;
 
     typedef Const(*computeUnOp)(Const);
     typedef Const(*computeBinOp)(Const, Const);
 
+    void init();
     PNode parseExpr(int);
     PNode parseFactor();
     PNode parseIdentifier();
@@ -64,6 +99,13 @@ private:
     void parseFuncDeclaration(int depth);
     void parseProcDeclaration(int depth);
     void generateProc(SymbolPtr symbol, int depth);
+    void generateBody(const std::string& name, PNode body);
+    void generate();
+    void writeAsm(const std::string& fileName);
+    void writeExecutable(const std::string& fileName);
+    std::string runInMemory();
+    void foldConstants();
+    std::string getProcIRStr(SymbolPtr symbol);
     void parseStatementSequence(BlockNode* block);
     SymbolPtr parseType();
     SymTablePtr parseParams(SymbolPtr proc);
@@ -77,11 +119,10 @@ private:
 
     TokenPtr getToken();
     TokenPtr getNextToken();
-    bool checkPriority(int, TokenType);
     bool checkSymbolType(SymbolPtr symbol, SymbolType expectedType, TokenPtr token);
 
     std::string _progName;
-    std::vector<std::set<TokenType>> _priorityTable;
+    NodeArena _nodes;
     std::map<SymbolPtr, PNode> _procedureBodies;
     std::map<TokenType, computeUnOp> _computableUnOps;
     std::map<TokenType, computeBinOp> _computableBinOps;
@@ -90,5 +131,12 @@ private:
     bool _isSymbolCheck;
     TypeChecker _typeChecker;
     AsmCode _code;
+    Peephole _peephole;
     PNode _root;
+    bool _isIRLowering;
+    bool _isConstFolding;
+    bool _isShortCircuit;
+    ProgramRunner _runner;
+    std::string _outputFile;
+    Profiler* _profiler;
 };
\ No newline at end of file
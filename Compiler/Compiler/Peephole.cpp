@@ -0,0 +1,422 @@
+#include "Peephole.h"
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+static const char* ruleNames[] = {
+    "push-pop",
+    "push-pop-move",
+    "move-fold",
+    "dead-move",
+    "jump-to-next",
+    "unreachable"
+};
+static_assert(sizeof(ruleNames) / sizeof(ruleNames[0]) == (size_t)PeepholeRule::Count, "ruleNames must cover every PeepholeRule");
+
+// Registers (as bit masks) and memory a command reads and writes. Commands the
+// pass does not model are barriers and end every window.
+struct CmdEffect {
+    unsigned reads = 0;
+    unsigned writes = 0;
+    bool readsMemory = false;
+    bool writesMemory = false;
+    bool isBarrier = false;
+};
+
+static unsigned regMask(AsmRegType reg) {
+    return 1u << (reg == CL ? RCX : reg == AL ? RAX : reg);
+}
+
+static bool isReg(const AsmOperandPtr& op) {
+    return op && op->getOperandType() == AsmOperandType::Reg;
+}
+
+static bool isMemory(const AsmOperandPtr& op) {
+    return op && op->getOperandType() == AsmOperandType::Memory;
+}
+
+static AsmRegType getReg(const AsmOperandPtr& op) {
+    return static_cast<AsmReg*>(op.get())->getRegType();
+}
+
+// Immediates above 32 bits can only be moved into a register.
+static bool isImmediateFor(const AsmOperandPtr& op, AsmOpType user) {
+    return op->getOperandType() == AsmOperandType::IntImmediate &&
+           (user == MOV || std::static_pointer_cast<AsmIntImmediate>(op)->isInt32());
+}
+
+static bool isGeneralReg(const AsmOperandPtr& op) {
+    if (!isReg(op))
+        return false;
+    AsmRegType reg = getReg(op);
+    return reg == RAX || reg == RBX || reg == RCX || reg == RDX || reg == RSI || reg == RDI ||
+           reg == R8 || reg == R9 || reg == R10 || reg == R11;
+}
+
+static unsigned operandRegs(const AsmOperandPtr& op) {
+    if (isReg(op))
+        return regMask(getReg(op));
+    if (isMemory(op))
+        return operandRegs(static_cast<AsmMemory*>(op.get())->getBase());
+    return 0;
+}
+
+static void addDestination(CmdEffect& effect, const AsmOperandPtr& op) {
+    if (isMemory(op)) {
+        effect.reads |= operandRegs(op);
+        effect.writesMemory = true;
+    }
+    else
+        effect.writes |= operandRegs(op);
+}
+
+static CmdEffect getEffect(const AsmCmdPtr& cmd) {
+    CmdEffect effect;
+    if (cmd->getCmdType() == AsmCmdType::Label) {
+        effect.isBarrier = true;
+        return effect;
+    }
+    const AsmOperandPtr& op1 = cmd->getOperand1();
+    const AsmOperandPtr& op2 = cmd->getOperand2();
+    switch (cmd->getOpType()) {
+        case PUSH:
+            effect.reads = operandRegs(op1) | regMask(RSP);
+            effect.writes = regMask(RSP);
+            effect.readsMemory = isMemory(op1);
+            effect.writesMemory = true;
+            break;
+        case POP:
+            effect.reads = regMask(RSP);
+            effect.writes = regMask(RSP);
+            effect.readsMemory = true;
+            addDestination(effect, op1);
+            break;
+        case MOV:
+        case MOVQ:
+        case CVTSI2SD:
+        case LEA:
+            effect.reads = operandRegs(op2);
+            effect.readsMemory = isMemory(op2) && cmd->getOpType() != LEA;
+            addDestination(effect, op1);
+            break;
+        case XOR:
+            if (isReg(op1) && isReg(op2) && getReg(op1) == getReg(op2)) {
+                effect.writes = regMask(getReg(op1));
+                break;
+            }
+            [[fallthrough]];
+        case ADD:
+        case SUB:
+        case AND:
+        case OR:
+        case SHL:
+        case SHR:
+        case ADDSD:
+        case SUBSD:
+        case MULSD:
+        case DIVSD:
+            effect.reads = operandRegs(op1) | operandRegs(op2);
+            effect.readsMemory = isMemory(op1) || isMemory(op2);
+            addDestination(effect, op1);
+            break;
+        case NEG:
+            effect.reads = operandRegs(op1);
+            effect.readsMemory = isMemory(op1);
+            addDestination(effect, op1);
+            break;
+        case CMP:
+        case TEST:
+        case COMISD:
+            effect.reads = operandRegs(op1) | operandRegs(op2);
+            effect.readsMemory = isMemory(op1) || isMemory(op2);
+            break;
+        case SETE:
+        case SETNE:
+        case SETL:
+        case SETLE:
+        case SETGE:
+        case SETG:
+        case SETB:
+        case SETBE:
+        case SETAE:
+        case SETA:
+            // Only the low byte changes, so the rest of the register is read.
+            effect.reads = operandRegs(op1);
+            addDestination(effect, op1);
+            break;
+        case MOVZX:
+            effect.reads = operandRegs(op2);
+            effect.readsMemory = isMemory(op2);
+            addDestination(effect, op1);
+            break;
+        case CQO:
+            effect.reads = regMask(RAX);
+            effect.writes = regMask(RDX);
+            break;
+        case IMUL:
+            if (op2) {
+                effect.reads = operandRegs(op1) | operandRegs(op2);
+                effect.readsMemory = isMemory(op2);
+                effect.writes = operandRegs(op1);
+                break;
+            }
+            [[fallthrough]];
+        case MUL:
+        case IDIV:
+            if (op2) {
+                effect.isBarrier = true;
+                break;
+            }
+            effect.reads = operandRegs(op1) | regMask(RAX) | regMask(RDX);
+            effect.writes = regMask(RAX) | regMask(RDX);
+            effect.readsMemory = isMemory(op1);
+            break;
+        default:
+            effect.isBarrier = true;
+    }
+    return effect;
+}
+
+static bool isJump(AsmOpType op) {
+    switch (op) {
+        case JMP: case JE: case JNE: case JL: case JLE: case JGE: case JG:
+        case JB: case JBE: case JAE: case JA: case JZ: case JNZ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isLabel(const AsmCmdPtr& cmd) {
+    return cmd->getCmdType() == AsmCmdType::Label;
+}
+
+// Deleted commands are left as nulls until the end of a pass.
+static size_t skipDeleted(const std::vector<AsmCmdPtr>& commands, size_t i) {
+    while (i < commands.size() && !commands[i])
+        ++i;
+    return i;
+}
+
+static size_t nextCommand(const std::vector<AsmCmdPtr>& commands, size_t i) {
+    return skipDeleted(commands, i + 1);
+}
+
+// True if the registers are overwritten before being read in the straight-line
+// code starting at i. Reaching a barrier or the end counts as a read.
+static bool isDeadFrom(const std::vector<AsmCmdPtr>& commands, size_t i, unsigned regs) {
+    for (i = skipDeleted(commands, i); i < commands.size(); i = nextCommand(commands, i)) {
+        CmdEffect effect = getEffect(commands[i]);
+        if (effect.isBarrier || (effect.reads & regs))
+            return false;
+        if (effect.writes & regs)
+            return true;
+    }
+    return false;
+}
+
+static AsmCmdPtr makeMove(AsmRegType reg, AsmOperandPtr value) {
+    return AsmCmdPtr(new AsmCmd(MOV, AsmOperandPtr(new AsmReg(reg)), value));
+}
+
+Peephole::Peephole() {
+    setEnabled(true);
+    for (auto& hits : _hits)
+        hits = 0;
+}
+
+void Peephole::setEnabled(PeepholeRule rule, bool isEnabled) {
+    _isEnabled[(int)rule] = isEnabled;
+}
+
+void Peephole::setEnabled(bool isEnabled) {
+    for (auto& enabled : _isEnabled)
+        enabled = isEnabled;
+}
+
+bool Peephole::isEnabled(PeepholeRule rule) const {
+    return _isEnabled[(int)rule];
+}
+
+int Peephole::getHits(PeepholeRule rule) const {
+    return _hits[(int)rule];
+}
+
+const char* Peephole::getRuleName(PeepholeRule rule) {
+    return ruleNames[(int)rule];
+}
+
+std::string Peephole::getStatsString() const {
+    std::stringstream stream;
+    stream << std::left << std::setw(16) << "peephole rule" << std::right << std::setw(8) << "hits" << std::endl;
+    int total = 0;
+    for (int rule = 0; rule < (int)PeepholeRule::Count; ++rule) {
+        stream << std::left << std::setw(16) << ruleNames[rule] << std::right << std::setw(8);
+        if (_isEnabled[rule])
+            stream << _hits[rule] << std::endl;
+        else
+            stream << "off" << std::endl;
+        total += _hits[rule];
+    }
+    stream << std::left << std::setw(16) << "total" << std::right << std::setw(8) << total << std::endl;
+    return stream.str();
+}
+
+void Peephole::run(std::vector<AsmCmdPtr>& commands) {
+    while (runPass(commands));
+}
+
+void Peephole::hit(PeepholeRule rule) {
+    ++_hits[(int)rule];
+}
+
+// Walks the commands backwards so that nested push/pop pairs are resolved from
+// the innermost one out within a single pass. Every rule removes at least one
+// command, so repeating passes until nothing fires terminates.
+bool Peephole::runPass(std::vector<AsmCmdPtr>& commands) {
+    bool isChanged = false;
+    for (size_t i = commands.size(); i-- > 0;) {
+        if (!commands[i])
+            continue;
+        isChanged |= applyUnreachable(commands, i) ||
+                     applyJumpToNext(commands, i) ||
+                     applyPushPop(commands, i) ||
+                     applyMoveFold(commands, i) ||
+                     applyDeadMove(commands, i);
+    }
+    if (isChanged)
+        commands.erase(std::remove(commands.begin(), commands.end(), nullptr), commands.end());
+    return isChanged;
+}
+
+// push x ... pop y, where the commands in between neither touch the stack nor
+// cross a barrier. The value is moved straight into y: at the pop if x is
+// still intact there, otherwise at the push if y is unused in between.
+bool Peephole::applyPushPop(std::vector<AsmCmdPtr>& commands, size_t i) {
+    if (commands[i]->getOpType() != PUSH || isLabel(commands[i]))
+        return false;
+    AsmOperandPtr value = commands[i]->getOperand1();
+    unsigned written = 0, used = 0;
+    bool writesMemory = false;
+    for (size_t j = nextCommand(commands, i); j < commands.size(); j = nextCommand(commands, j)) {
+        const AsmCmdPtr& cmd = commands[j];
+        if (cmd->getOpType() == POP && !isLabel(cmd) && isGeneralReg(cmd->getOperand1())) {
+            AsmRegType target = getReg(cmd->getOperand1());
+            bool isValueKept = !(operandRegs(value) & written) && !(isMemory(value) && writesMemory);
+            if (isValueKept && isReg(value) && getReg(value) == target) {
+                if (!isEnabled(PeepholeRule::PushPop))
+                    return false;
+                commands[i] = commands[j] = nullptr;
+                hit(PeepholeRule::PushPop);
+                return true;
+            }
+            if (!isEnabled(PeepholeRule::PushPopMove))
+                return false;
+            if (isValueKept) {
+                commands[i] = nullptr;
+                commands[j] = makeMove(target, value);
+            }
+            else if (!(used & regMask(target))) {
+                commands[i] = makeMove(target, value);
+                commands[j] = nullptr;
+            }
+            else
+                return false;
+            hit(PeepholeRule::PushPopMove);
+            return true;
+        }
+        CmdEffect effect = getEffect(cmd);
+        if (effect.isBarrier || ((effect.reads | effect.writes) & regMask(RSP)))
+            return false;
+        written |= effect.writes;
+        used |= effect.reads | effect.writes;
+        writesMemory |= effect.writesMemory;
+    }
+    return false;
+}
+
+// mov r, x followed by a command reading r only as its source operand, with r
+// dead afterwards: the source becomes x and the move goes away.
+bool Peephole::applyMoveFold(std::vector<AsmCmdPtr>& commands, size_t i) {
+    const AsmCmdPtr& move = commands[i];
+    if (!isEnabled(PeepholeRule::MoveFold) || move->getOpType() != MOV || isLabel(move) || !isGeneralReg(move->getOperand1()))
+        return false;
+    AsmRegType reg = getReg(move->getOperand1());
+    AsmOperandPtr value = move->getOperand2();
+    size_t j = nextCommand(commands, i);
+    if (j >= commands.size() || isLabel(commands[j]))
+        return false;
+    const AsmCmdPtr& user = commands[j];
+    AsmOperandPtr dest = user->getOperand1();
+    AsmOperandPtr source = user->getOperand2();
+    AsmOperandType valueType = value->getOperandType();
+    AsmCmdPtr folded;
+    switch (user->getOpType()) {
+        case PUSH:
+            if (isReg(dest) && getReg(dest) == reg && (valueType == AsmOperandType::Reg || isImmediateFor(value, PUSH)))
+                folded = AsmCmdPtr(new AsmCmd(PUSH, value));
+            break;
+        case MOV:
+        case ADD:
+        case SUB:
+        case AND:
+        case OR:
+        case XOR:
+        case CMP:
+            if (!isReg(source) || getReg(source) != reg || (operandRegs(dest) & regMask(reg)))
+                break;
+            if (valueType == AsmOperandType::Reg ||
+                (isReg(dest) && (isImmediateFor(value, user->getOpType()) || valueType == AsmOperandType::Memory)) ||
+                (isReg(dest) && valueType == AsmOperandType::StringImmediate && user->getOpType() == MOV))
+                folded = AsmCmdPtr(new AsmCmd(user->getOpType(), dest, value));
+            break;
+        default:
+            break;
+    }
+    if (!folded || !isDeadFrom(commands, nextCommand(commands, j), regMask(reg)))
+        return false;
+    commands[i] = nullptr;
+    commands[j] = folded;
+    hit(PeepholeRule::MoveFold);
+    return true;
+}
+
+bool Peephole::applyDeadMove(std::vector<AsmCmdPtr>& commands, size_t i) {
+    const AsmCmdPtr& move = commands[i];
+    if (!isEnabled(PeepholeRule::DeadMove) || move->getOpType() != MOV || isLabel(move) || !isGeneralReg(move->getOperand1()))
+        return false;
+    if (!isDeadFrom(commands, nextCommand(commands, i), regMask(getReg(move->getOperand1()))))
+        return false;
+    commands[i] = nullptr;
+    hit(PeepholeRule::DeadMove);
+    return true;
+}
+
+bool Peephole::applyJumpToNext(std::vector<AsmCmdPtr>& commands, size_t i) {
+    const AsmCmdPtr& jump = commands[i];
+    if (!isEnabled(PeepholeRule::JumpToNext) || isLabel(jump) || !isJump(jump->getOpType()))
+        return false;
+    const std::string& target = std::dynamic_pointer_cast<AsmStringImmediate>(jump->getOperand1())->getValue();
+    for (size_t j = nextCommand(commands, i); j < commands.size() && isLabel(commands[j]); j = nextCommand(commands, j))
+        if (std::dynamic_pointer_cast<AsmLabel>(commands[j])->getName() == target) {
+            commands[i] = nullptr;
+            hit(PeepholeRule::JumpToNext);
+            return true;
+        }
+    return false;
+}
+
+bool Peephole::applyUnreachable(std::vector<AsmCmdPtr>& commands, size_t i) {
+    const AsmCmdPtr& cmd = commands[i];
+    if (!isEnabled(PeepholeRule::Unreachable) || isLabel(cmd) || (cmd->getOpType() != JMP && cmd->getOpType() != RET))
+        return false;
+    bool isRemoved = false;
+    for (size_t j = nextCommand(commands, i); j < commands.size() && !isLabel(commands[j]); j = nextCommand(commands, j)) {
+        commands[j] = nullptr;
+        isRemoved = true;
+    }
+    if (isRemoved)
+        hit(PeepholeRule::Unreachable);
+    return isRemoved;
+}
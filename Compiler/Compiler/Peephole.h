@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "AsmGen.h"
+
+enum class PeepholeRule {
+    PushPop,        // push x ... pop x                ->  (nothing)
+    PushPopMove,    // push x ... pop y                ->  mov y, x
+    MoveFold,       // mov r, x / op y, r  (r dead)    ->  op y, x
+    DeadMove,       // mov r, x  (r dead)              ->  (nothing)
+    JumpToNext,     // jmp L / L:                      ->  L:
+    Unreachable,    // jmp L or ret / code / label     ->  jmp L or ret / label
+    Count
+};
+
+// Peephole pass over the generated command stream, run before the code is
+// printed. Rules only look inside straight-line code: labels, jumps and calls
+// end every window, so control flow is never changed. All rules are enabled by
+// default; each can be switched off and counts how many times it fired.
+class Peephole {
+public:
+    Peephole();
+    void setEnabled(PeepholeRule rule, bool isEnabled);
+    void setEnabled(bool isEnabled);
+    bool isEnabled(PeepholeRule rule) const;
+    int getHits(PeepholeRule rule) const;
+    std::string getStatsString() const;
+    static const char* getRuleName(PeepholeRule rule);
+    void run(std::vector<AsmCmdPtr>& commands);
+private:
+    bool runPass(std::vector<AsmCmdPtr>& commands);
+    bool applyPushPop(std::vector<AsmCmdPtr>& commands, size_t i);
+    bool applyMoveFold(std::vector<AsmCmdPtr>& commands, size_t i);
+    bool applyDeadMove(std::vector<AsmCmdPtr>& commands, size_t i);
+    bool applyJumpToNext(std::vector<AsmCmdPtr>& commands, size_t i);
+    bool applyUnreachable(std::vector<AsmCmdPtr>& commands, size_t i);
+    void hit(PeepholeRule rule);
+    bool _isEnabled[(int)PeepholeRule::Count];
+    int _hits[(int)PeepholeRule::Count];
+};
@@ -0,0 +1,191 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#define malloc_usable_size _msize
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#include <time.h>
+#define malloc_usable_size malloc_size
+#else
+#include <malloc.h>
+#include <time.h>
+#endif
+
+// Heap use of one thread. Memory freed on another thread than the one that
+// allocated it is subtracted there, so only differences taken on one thread
+// mean anything.
+struct HeapCounters {
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+    int64_t liveBytes;
+    int64_t peakBytes;
+};
+
+static thread_local HeapCounters heap;
+
+void* operator new(size_t size) {
+    void* memory = malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+    size_t usable = malloc_usable_size(memory);
+    ++heap.allocations;
+    heap.allocatedBytes += usable;
+    heap.liveBytes += usable;
+    heap.peakBytes = std::max(heap.peakBytes, heap.liveBytes);
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    if (!memory)
+        return;
+    heap.liveBytes -= malloc_usable_size(memory);
+    free(memory);
+}
+
+// The other forms go through the two above, so every pair of allocation and
+// release is counted alike.
+void operator delete(void* memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void* memory) noexcept {
+    operator delete(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+static double getThreadCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    uint64_t ticks = ((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime)
+        + ((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime);
+    return ticks * 1e-7;
+#else
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+Profiler::Scope::Scope(Profiler* profiler, const char* name) :
+    _profiler(profiler && profiler->enter(name) ? profiler : nullptr) {}
+
+Profiler::Scope::Scope(Profiler* profiler, const std::string& name) : Scope(profiler, name.c_str()) {}
+
+Profiler::Scope::~Scope() {
+    if (_profiler)
+        _profiler->leave();
+}
+
+Profiler::Profiler() : _start(mark()) {
+    heap.peakBytes = heap.liveBytes;
+}
+
+Profiler::Mark Profiler::mark() {
+    return { std::chrono::steady_clock::now(), getThreadCpuSeconds(), heap.allocations, heap.allocatedBytes,
+             heap.liveBytes, heap.peakBytes };
+}
+
+// Returns false when the innermost open phase has the same name.
+bool Profiler::enter(const char* name) {
+    if (!_open.empty() && _phases[_open.back().phase].name == name)
+        return false;
+    std::string path = _open.empty() ? name : _phases[_open.back().phase].path + "/" + name;
+    auto it = _paths.find(path);
+    if (it == _paths.end()) {
+        it = _paths.emplace(path, _phases.size()).first;
+        _phases.push_back({ name, path, (int)_open.size(), 0, 0, 0, 0, 0, 0 });
+    }
+    _open.push_back({ it->second, mark() });
+    heap.peakBytes = heap.liveBytes;
+    return true;
+}
+
+// The peak of a phase is measured from the heap use it started with; the
+// enclosing phase's peak is put back on leaving, raised to the inner one.
+void Profiler::leave() {
+    OpenPhase open = _open.back();
+    _open.pop_back();
+    measure(_phases[open.phase], open.start);
+    heap.peakBytes = std::max(heap.peakBytes, open.start.outerPeak);
+}
+
+void Profiler::measure(Phase& phase, const Mark& start) {
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start.wall;
+    ++phase.calls;
+    phase.wallSeconds += wall.count();
+    phase.cpuSeconds += getThreadCpuSeconds() - start.cpu;
+    phase.allocations += heap.allocations - start.allocations;
+    phase.allocatedBytes += heap.allocatedBytes - start.allocatedBytes;
+    phase.peakBytes = std::max(phase.peakBytes, heap.peakBytes - start.liveBytes);
+}
+
+// Everything since the profiler was made.
+Profiler::Phase Profiler::getTotal() {
+    Phase total = { "total", "total", 0, 0, 0, 0, 0, 0, 0 };
+    measure(total, _start);
+    return total;
+}
+
+// Phases are listed in the order they were first entered, nested ones
+// indented under their parent.
+std::string Profiler::getTable() {
+    std::string out;
+    char line[256];
+    snprintf(line, sizeof(line), "%-32s %8s %10s %10s %10s %12s %12s\n",
+             "phase", "calls", "wall ms", "cpu ms", "allocs", "alloc KiB", "peak KiB");
+    out += line;
+    std::vector<Phase> rows = _phases;
+    rows.push_back(getTotal());
+    for (auto& phase : rows) {
+        std::string name = std::string(phase.depth * 2, ' ') + phase.name;
+        snprintf(line, sizeof(line), "%-32s %8llu %10.3f %10.3f %10llu %12.1f %12.1f\n",
+                 name.c_str(), (unsigned long long)phase.calls, phase.wallSeconds * 1e3, phase.cpuSeconds * 1e3,
+                 (unsigned long long)phase.allocations, phase.allocatedBytes / 1024.0, phase.peakBytes / 1024.0);
+        out += line;
+    }
+    return out;
+}
+
+static std::string quote(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+std::string Profiler::getJson() {
+    std::string out = "{\"phases\": [";
+    std::vector<Phase> rows = _phases;
+    rows.push_back(getTotal());
+    char numbers[256];
+    for (size_t i = 0; i < rows.size(); ++i) {
+        Phase& phase = rows[i];
+        snprintf(numbers, sizeof(numbers),
+                 "\"depth\": %d, \"calls\": %llu, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+                 "\"allocations\": %llu, \"allocated_bytes\": %llu, \"peak_bytes\": %lld}",
+                 phase.depth, (unsigned long long)phase.calls, phase.wallSeconds * 1e3, phase.cpuSeconds * 1e3,
+                 (unsigned long long)phase.allocations, (unsigned long long)phase.allocatedBytes,
+                 (long long)phase.peakBytes);
+        out += (i ? ",\n  " : "\n  ") + std::string("{\"name\": ") + quote(phase.name)
+            + ", \"path\": " + quote(phase.path) + ", " + numbers;
+    }
+    return out + "\n]}\n";
+}
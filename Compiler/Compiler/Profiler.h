@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum class ProfileFormat {
+    None,
+    Table,
+    Json
+};
+
+// Wall time, CPU time and heap use of the phases of one compilation (see
+// main.cpp). Phases nest, and a phase entered again directly inside itself,
+// as the type checker does for subexpressions, is timed once. Every
+// operator new in the process is counted per thread; a profiler reads the
+// counts of the thread it was made on, which must be the one compiling.
+// External programs (nasm, gcc and the compiled program) show up in wall
+// time only. A null profiler makes every scope a no-op.
+class Profiler {
+public:
+    class Scope {
+    public:
+        Scope(Profiler* profiler, const char* name);
+        Scope(Profiler* profiler, const std::string& name);
+        ~Scope();
+    private:
+        Profiler* _profiler;
+    };
+    Profiler();
+    std::string getTable();
+    std::string getJson();
+private:
+    struct Phase {
+        std::string name;
+        std::string path;
+        int depth;
+        uint64_t calls;
+        double wallSeconds;
+        double cpuSeconds;
+        uint64_t allocations;
+        uint64_t allocatedBytes;
+        int64_t peakBytes;
+    };
+    struct Mark {
+        std::chrono::steady_clock::time_point wall;
+        double cpu;
+        uint64_t allocations;
+        uint64_t allocatedBytes;
+        int64_t liveBytes;
+        int64_t outerPeak;
+    };
+    struct OpenPhase {
+        size_t phase;
+        Mark start;
+    };
+    bool enter(const char* name);
+    void leave();
+    static Mark mark();
+    void measure(Phase& phase, const Mark& start);
+    Phase getTotal();
+    std::vector<Phase> _phases;
+    std::map<std::string, size_t> _paths;
+    std::vector<OpenPhase> _open;
+    Mark _start;
+};
@@ -0,0 +1,386 @@
+#include "RegisterGen.h"
+
+#include <algorithm>
+#include <cstdint>
+
+static AsmOperandPtr makeReg(AsmRegType reg) {
+    return AsmOperandPtr(new AsmReg(reg));
+}
+
+static bool isRegOperand(const AsmOperandPtr& op) {
+    return op->getOperandType() == AsmOperandType::Reg;
+}
+
+static bool isRelation(TokenType op) {
+    switch (op) {
+        case TokenType::Equal:
+        case TokenType::NotEqual:
+        case TokenType::Less:
+        case TokenType::LessEqual:
+        case TokenType::Greater:
+        case TokenType::GreaterEqual:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static AsmOpType getIntJump(TokenType op) {
+    switch (op) {
+        case TokenType::Equal:     return JE;
+        case TokenType::NotEqual:  return JNE;
+        case TokenType::Less:      return JL;
+        case TokenType::LessEqual: return JLE;
+        case TokenType::Greater:   return JG;
+        default:                   return JGE;
+    }
+}
+
+static AsmOpType getRealJump(TokenType op) {
+    switch (op) {
+        case TokenType::Equal:     return JE;
+        case TokenType::NotEqual:  return JNE;
+        case TokenType::Less:      return JB;
+        case TokenType::LessEqual: return JBE;
+        case TokenType::Greater:   return JA;
+        default:                   return JAE;
+    }
+}
+
+static bool isNumeric(SymbolType type) {
+    return type == SymbolType::TypeInteger || type == SymbolType::TypeReal;
+}
+
+static bool isIntConst(PNode node) {
+    return node->getNodeType() == SynNodeType::IntegerNumber;
+}
+
+static bool isInt32(i64 value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Whether the lowering handles the node itself rather than leaving it to the
+// stack backend. Only the node is checked, not its children.
+static bool isLowerable(PNode node) {
+    switch (node->getNodeType()) {
+        case SynNodeType::IntegerNumber:
+            return true;
+        case SynNodeType::BinaryOp:
+            return static_cast<BinOpNode*>(node)->isArithmetic();
+        case SynNodeType::UnaryOp:
+            return isNumeric(static_cast<UnaryNode*>(node)->getArg()->getType());
+        default:
+            return false;
+    }
+}
+
+// Subtrees left to the stack backend may use any register, except plain
+// variable and real constant loads, which only go through RAX.
+static bool isClobbering(PNode node) {
+    if (!isNumeric(node->getType()))
+        return true;
+    if (node->getNodeType() == SynNodeType::RealNumber)
+        return false;
+    if (node->getNodeType() != SynNodeType::Identifier)
+        return true;
+    SymbolPtr symbol = static_cast<IdentifierNode*>(node)->getSymbol();
+    switch (symbol->getType()) {
+        case SymbolType::VarGlobal:
+        case SymbolType::VarLocal:
+            return symbol->getSize() != 8;
+        case SymbolType::Param:
+        case SymbolType::VarParam:
+        case SymbolType::FuncResult:
+            return false;
+        default:
+            return true;
+    }
+}
+
+RegisterGen::RegisterGen(AsmCode& asmCode) : _asmCode(asmCode) {}
+
+bool RegisterGen::canGenerate(PNode node) {
+    return node->getNodeType() != SynNodeType::IntegerNumber && isLowerable(node);
+}
+
+void RegisterGen::generate(PNode node) {
+    int result = lower(node);
+    computeIntervals(result);
+    _scan.allocate();
+    if (_scan.getSlotCount())
+        _asmCode.addCmd(SUB, RSP, 8 * _scan.getSlotCount());
+    for (auto& instr : _instrs)
+        emit(instr);
+    emitResult(result);
+}
+
+void RegisterGen::addInstr(VOp op, int dst, int a, int b, AsmOpType asmOp, AsmOperandPtr imm) {
+    VInstr instr;
+    instr.op = op;
+    instr.asmOp = asmOp;
+    instr.dst = dst;
+    instr.a = a;
+    instr.b = b;
+    instr.imm = imm;
+    instr.node = nullptr;
+    instr.isClobbering = false;
+    _instrs.push_back(instr);
+}
+
+int RegisterGen::lower(PNode node) {
+    if (!isLowerable(node))
+        return lowerOnStack(node);
+    switch (node->getNodeType()) {
+        case SynNodeType::BinaryOp:
+            return lowerBinary(static_cast<BinOpNode*>(node));
+        case SynNodeType::UnaryOp:
+            return lowerUnary(static_cast<UnaryNode*>(node));
+        default: {
+            int dst = _scan.addVReg(RegClass::Gpr);
+            addInstr(VOp::Load, dst, -1, -1, MOV, AsmOperandPtr(new AsmIntImmediate(static_cast<IntConstNode*>(node)->getValue())));
+            return dst;
+        }
+    }
+}
+
+int RegisterGen::lowerBinary(BinOpNode* node) {
+    TokenType op = node->getOpType();
+    if (node->getType() == SymbolType::TypeReal) {
+        int left = lowerReal(node->getLeft());
+        int right = lowerReal(node->getRight());
+        if (isRelation(op)) {
+            int flag = _scan.addVReg(RegClass::Gpr);
+            addInstr(VOp::RealCompare, flag, left, right, getRealJump(op));
+            int dst = _scan.addVReg(RegClass::Xmm);
+            addInstr(VOp::Copy, dst, flag);
+            return dst;
+        }
+        int dst = _scan.addVReg(RegClass::Xmm);
+        addInstr(VOp::Copy, dst, left);
+        AsmOpType asmOp = op == TokenType::Add ? ADDSD : op == TokenType::Sub ? SUBSD : op == TokenType::Mul ? MULSD : DIVSD;
+        addInstr(VOp::RealAlu, dst, right, -1, asmOp);
+        return dst;
+    }
+
+    int left = lower(node->getLeft());
+    int right = -1;
+    AsmOperandPtr imm;
+    if (isIntConst(node->getRight()) && op != TokenType::Mul && isInt32(static_cast<IntConstNode*>(node->getRight())->getValue()))
+        imm = AsmOperandPtr(new AsmIntImmediate(static_cast<IntConstNode*>(node->getRight())->getValue()));
+    else
+        right = lower(node->getRight());
+    int dst = _scan.addVReg(RegClass::Gpr);
+    if (isRelation(op)) {
+        addInstr(VOp::IntCompare, dst, left, right, getIntJump(op), imm);
+        return dst;
+    }
+    addInstr(VOp::Copy, dst, left);
+    switch (op) {
+        case TokenType::Add: addInstr(VOp::Alu, dst, right, -1, ADD, imm); break;
+        case TokenType::Sub: addInstr(VOp::Alu, dst, right, -1, SUB, imm); break;
+        case TokenType::Mul: addInstr(VOp::Alu, dst, right, -1, IMUL); break;
+        case TokenType::And: addInstr(VOp::Alu, dst, right, -1, AND, imm); break;
+        case TokenType::Or:  addInstr(VOp::Alu, dst, right, -1, OR, imm); break;
+        case TokenType::Xor: addInstr(VOp::Alu, dst, right, -1, XOR, imm); break;
+        case TokenType::Div: addInstr(VOp::Divide, dst, right, -1, IDIV, imm); break;
+        case TokenType::Mod: addInstr(VOp::Modulo, dst, right, -1, IDIV, imm); break;
+        case TokenType::Shl: addInstr(VOp::Shift, dst, right, -1, SHL, imm); break;
+        default:             addInstr(VOp::Shift, dst, right, -1, SHR, imm); break;
+    }
+    return dst;
+}
+
+int RegisterGen::lowerUnary(UnaryNode* node) {
+    int arg = lower(node->getArg());
+    TokenType op = node->getOpType();
+    if (node->getArg()->getType() == SymbolType::TypeReal) {
+        if (op != TokenType::Sub)
+            return arg;
+        unsigned long long signBit = 1;
+        signBit <<= 63;
+        int bits = _scan.addVReg(RegClass::Gpr);
+        addInstr(VOp::Copy, bits, arg);
+        int mask = _scan.addVReg(RegClass::Gpr);
+        addInstr(VOp::Load, mask, -1, -1, MOV, AsmOperandPtr(new AsmStringImmediate(std::to_string(signBit))));
+        addInstr(VOp::Alu, bits, mask, -1, XOR);
+        int dst = _scan.addVReg(RegClass::Xmm);
+        addInstr(VOp::Copy, dst, bits);
+        return dst;
+    }
+    if (op != TokenType::Sub && op != TokenType::Not)
+        return arg;
+    int dst = _scan.addVReg(RegClass::Gpr);
+    addInstr(VOp::Copy, dst, arg);
+    if (op == TokenType::Sub)
+        addInstr(VOp::Negate, dst);
+    else
+        addInstr(VOp::Alu, dst, -1, -1, XOR, AsmOperandPtr(new AsmIntImmediate(1)));
+    return dst;
+}
+
+int RegisterGen::lowerReal(PNode node) {
+    int value = lower(node);
+    if (node->getType() != SymbolType::TypeInteger)
+        return value;
+    int dst = _scan.addVReg(RegClass::Xmm);
+    addInstr(VOp::IntToReal, dst, value);
+    return dst;
+}
+
+int RegisterGen::lowerOnStack(PNode node) {
+    int dst = _scan.addVReg(node->getType() == SymbolType::TypeReal ? RegClass::Xmm : RegClass::Gpr);
+    addInstr(VOp::Stack, dst);
+    _instrs.back().node = node;
+    _instrs.back().isClobbering = isClobbering(node);
+    return dst;
+}
+
+// A virtual register lives from its definition to its last use; the result
+// stays live until it is pushed after the last instruction.
+void RegisterGen::computeIntervals(int result) {
+    for (int i = 0; i < (int)_instrs.size(); ++i) {
+        const VInstr& instr = _instrs[i];
+        _scan.extend(instr.dst, i);
+        if (instr.a >= 0)
+            _scan.extend(instr.a, i);
+        if (instr.b >= 0)
+            _scan.extend(instr.b, i);
+        if (instr.op == VOp::Copy)
+            _scan.setHint(instr.dst, instr.a);
+        if (instr.isClobbering)
+            _scan.addClobber(i);
+    }
+    _scan.extend(result, (int)_instrs.size());
+}
+
+void RegisterGen::addCmd(AsmOpType op, const AsmOperandPtr& op1, const AsmOperandPtr& op2) {
+    _asmCode.addCmd(AsmCmdPtr(new AsmCmd(op, op1, op2)));
+}
+
+AsmOperandPtr RegisterGen::getSource(const VInstr& instr) {
+    return instr.a >= 0 ? _scan.getLocation(instr.a) : instr.imm;
+}
+
+// Register holding the current value of vreg, loaded into scratch if spilled.
+AsmOperandPtr RegisterGen::useReg(int vreg, AsmRegType scratch) {
+    if (!_scan.isSpilled(vreg))
+        return _scan.getLocation(vreg);
+    AsmOperandPtr reg = makeReg(scratch);
+    addCmd(_scan.getClass(vreg) == RegClass::Xmm ? MOVQ : MOV, reg, _scan.getLocation(vreg));
+    return reg;
+}
+
+// Register receiving a new value of vreg; finish() stores it if spilled.
+AsmOperandPtr RegisterGen::defReg(int vreg, AsmRegType scratch) {
+    return _scan.isSpilled(vreg) ? makeReg(scratch) : _scan.getLocation(vreg);
+}
+
+void RegisterGen::finish(int vreg, const AsmOperandPtr& reg) {
+    if (_scan.isSpilled(vreg))
+        addCmd(_scan.getClass(vreg) == RegClass::Xmm ? MOVQ : MOV, _scan.getLocation(vreg), reg);
+}
+
+void RegisterGen::emit(const VInstr& instr) {
+    switch (instr.op) {
+        case VOp::Load: {
+            AsmOperandPtr dst = defReg(instr.dst, RAX);
+            addCmd(MOV, dst, instr.imm);
+            finish(instr.dst, dst);
+            break;
+        }
+        case VOp::Copy:
+            emitMove(_scan.getLocation(instr.dst), _scan.getClass(instr.dst), _scan.getLocation(instr.a), _scan.getClass(instr.a));
+            break;
+        case VOp::Alu:
+        case VOp::RealAlu: {
+            AsmOperandPtr dst = useReg(instr.dst, instr.op == VOp::Alu ? RAX : XMM0);
+            addCmd(instr.asmOp, dst, getSource(instr));
+            finish(instr.dst, dst);
+            break;
+        }
+        case VOp::Negate: {
+            AsmOperandPtr dst = useReg(instr.dst, RAX);
+            addCmd(NEG, dst);
+            finish(instr.dst, dst);
+            break;
+        }
+        case VOp::Divide:
+        case VOp::Modulo: {
+            AsmOperandPtr divisor = instr.a >= 0 && !_scan.isSpilled(instr.a) ? _scan.getLocation(instr.a) : makeReg(RCX);
+            if (instr.a < 0 || _scan.isSpilled(instr.a))
+                addCmd(MOV, divisor, getSource(instr));
+            addCmd(MOV, makeReg(RAX), _scan.getLocation(instr.dst));
+            _asmCode.addCmd(CQO);
+            addCmd(IDIV, divisor);
+            addCmd(MOV, _scan.getLocation(instr.dst), makeReg(instr.op == VOp::Divide ? RAX : RDX));
+            break;
+        }
+        case VOp::Shift: {
+            addCmd(MOV, makeReg(RCX), getSource(instr));
+            AsmOperandPtr dst = useReg(instr.dst, RAX);
+            addCmd(instr.asmOp, dst, makeReg(CL));
+            finish(instr.dst, dst);
+            break;
+        }
+        case VOp::IntCompare: {
+            AsmOperandPtr right = instr.b >= 0 ? _scan.getLocation(instr.b) : instr.imm;
+            emitCompare(instr, useReg(instr.a, RAX), right);
+            break;
+        }
+        case VOp::RealCompare:
+            emitCompare(instr, useReg(instr.a, XMM0), _scan.getLocation(instr.b));
+            break;
+        case VOp::IntToReal: {
+            AsmOperandPtr src = useReg(instr.a, RAX);
+            AsmOperandPtr dst = defReg(instr.dst, XMM0);
+            addCmd(CVTSI2SD, dst, src);
+            finish(instr.dst, dst);
+            break;
+        }
+        case VOp::Stack:
+            instr.node->generate(_asmCode);
+            if (_scan.isSpilled(instr.dst) || _scan.getClass(instr.dst) == RegClass::Xmm) {
+                _asmCode.addCmd(POP, RAX);
+                emitMove(_scan.getLocation(instr.dst), _scan.getClass(instr.dst), makeReg(RAX), RegClass::Gpr);
+            }
+            else
+                addCmd(POP, _scan.getLocation(instr.dst));
+            break;
+    }
+}
+
+// Copies the 64 bits of src to dst; MOVQ whenever an XMM register is involved.
+void RegisterGen::emitMove(const AsmOperandPtr& dst, RegClass dstClass, const AsmOperandPtr& src, RegClass srcClass) {
+    if (!isRegOperand(dst) && !isRegOperand(src)) {
+        AsmOperandPtr rax = makeReg(RAX);
+        addCmd(MOV, rax, src);
+        addCmd(MOV, dst, rax);
+        return;
+    }
+    if (isRegOperand(dst) && isRegOperand(src) &&
+        static_cast<AsmReg*>(dst.get())->getRegType() == static_cast<AsmReg*>(src.get())->getRegType())
+        return;
+    bool isXmm = (isRegOperand(dst) && dstClass == RegClass::Xmm) || (isRegOperand(src) && srcClass == RegClass::Xmm);
+    addCmd(isXmm ? MOVQ : MOV, dst, src);
+}
+
+// Sets dst to 1 if the jump condition holds after comparing left with right,
+// to 0 otherwise.
+void RegisterGen::emitCompare(const VInstr& instr, const AsmOperandPtr& left, const AsmOperandPtr& right) {
+    addCmd(instr.op == VOp::IntCompare ? CMP : COMISD, left, right);
+    AsmOperandPtr dst = defReg(instr.dst, RAX);
+    _asmCode.addCmd(getSetForJump(instr.asmOp), AL);
+    addCmd(MOVZX, dst, makeReg(AL));
+    finish(instr.dst, dst);
+}
+
+void RegisterGen::emitResult(int result) {
+    AsmOperandPtr value = _scan.getLocation(result);
+    if (_scan.isSpilled(result) || _scan.getClass(result) == RegClass::Xmm) {
+        value = makeReg(RAX);
+        emitMove(value, RegClass::Gpr, _scan.getLocation(result), _scan.getClass(result));
+    }
+    if (_scan.getSlotCount())
+        _asmCode.addCmd(ADD, RSP, 8 * _scan.getSlotCount());
+    addCmd(PUSH, value);
+}
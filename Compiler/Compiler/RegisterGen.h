@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include "AsmGen.h"
+#include "SynNode.h"
+#include "LinearScan.h"
+
+// Register backend for expressions. An integer or real expression tree is
+// first lowered into straight-line code over virtual registers, then a
+// linear-scan allocator maps them onto the GPR and XMM pools and spills to
+// the stack only when a pool runs out. The finished value is pushed, so the
+// statements around the expression see the same contract as with the stack
+// backend. Subtrees the lowering does not understand (calls, arrays,
+// records, strings) are generated by the stack backend and popped into a
+// virtual register; values live across such a subtree are spilled, since it
+// may use any register.
+class RegisterGen {
+public:
+    RegisterGen(AsmCode& asmCode);
+    static bool canGenerate(PNode node);
+    void generate(PNode node);
+private:
+    enum class VOp {
+        Load,           // dst = imm
+        Copy,           // dst = a (also moves bits between GPR and XMM)
+        Alu,            // dst = dst op (a or imm)
+        Negate,         // dst = -dst
+        Divide,         // dst = dst div (a or imm)
+        Modulo,         // dst = dst mod (a or imm)
+        Shift,          // dst = dst shl/shr (a or imm)
+        IntCompare,     // dst = a cmp (b or imm) ? 1 : 0
+        RealAlu,        // dst = dst op a
+        RealCompare,    // dst = a comisd b ? 1 : 0
+        IntToReal,      // dst = (real)a
+        Stack           // dst = value the stack backend pushes for node
+    };
+    struct VInstr {
+        VOp op;
+        AsmOpType asmOp;
+        int dst;
+        int a;
+        int b;
+        AsmOperandPtr imm;
+        PNode node;
+        bool isClobbering;
+    };
+    void addInstr(VOp op, int dst, int a = -1, int b = -1, AsmOpType asmOp = LABEL, AsmOperandPtr imm = AsmOperandPtr());
+    int lower(PNode node);
+    int lowerBinary(BinOpNode* node);
+    int lowerUnary(UnaryNode* node);
+    int lowerReal(PNode node);
+    int lowerOnStack(PNode node);
+    void computeIntervals(int result);
+    void emit(const VInstr& instr);
+    void emitMove(const AsmOperandPtr& dst, RegClass dstClass, const AsmOperandPtr& src, RegClass srcClass);
+    void emitCompare(const VInstr& instr, const AsmOperandPtr& left, const AsmOperandPtr& right);
+    void emitResult(int result);
+    AsmOperandPtr getSource(const VInstr& instr);
+    AsmOperandPtr useReg(int vreg, AsmRegType scratch);
+    AsmOperandPtr defReg(int vreg, AsmRegType scratch);
+    void finish(int vreg, const AsmOperandPtr& reg);
+    void addCmd(AsmOpType op, const AsmOperandPtr& op1, const AsmOperandPtr& op2 = AsmOperandPtr());
+    AsmCode& _asmCode;
+    std::vector<VInstr> _instrs;
+    LinearScan _scan;
+};
@@ -1,32 +1,33 @@
 #include "Scanner.h"
-
-Scanner::Scanner(const char* fname) :
-    _line(1),
-    _col(0),
-    _tokenLine(1),
-    _tokenCol(0),
-    _char(' '),
-    _fin(fname),
-    _fname(fname),
-    _operations({
-        { "+",  TokenType::Add },
-        { "+=", TokenType::AddAssignment },
-        { "-",  TokenType::Sub },
-        { "-=", TokenType::SubAssignment },
-        { "*",  TokenType::Mul },
-        { "*=", TokenType::MulAssignment },
-        { "/",  TokenType::DivReal },
-        { "/=", TokenType::DivAssignment },
-        { ":=", TokenType::Assigment },
-        { "=",  TokenType::Equal },
-        { "<",  TokenType::Less },
-        { "<=", TokenType::LessEqual },
-        { ">",  TokenType::Greater },
-        { ">=", TokenType::GreaterEqual },
-        { "<>", TokenType::NotEqual },
-        { "^",  TokenType::Hat },
-}),
-_delimiters({
+#include "ThreadPool.h"
+
+#include <climits>
+
+struct TokenEntry {
+    const char* text;
+    TokenType type;
+};
+
+static constexpr TokenEntry operations[] = {
+    { "+",  TokenType::Add },
+    { "+=", TokenType::AddAssignment },
+    { "-",  TokenType::Sub },
+    { "-=", TokenType::SubAssignment },
+    { "*",  TokenType::Mul },
+    { "*=", TokenType::MulAssignment },
+    { "/",  TokenType::DivReal },
+    { "/=", TokenType::DivAssignment },
+    { ":=", TokenType::Assigment },
+    { "=",  TokenType::Equal },
+    { "<",  TokenType::Less },
+    { "<=", TokenType::LessEqual },
+    { ">",  TokenType::Greater },
+    { ">=", TokenType::GreaterEqual },
+    { "<>", TokenType::NotEqual },
+    { "^",  TokenType::Hat }
+};
+
+static constexpr TokenEntry delimiters[] = {
     { ".",  TokenType::Dot },
     { "..", TokenType::DoubleDot },
     { ",",  TokenType::Comma },
@@ -35,9 +36,10 @@ _delimiters({
     { "(",  TokenType::OpeningParenthesis },
     { ")",  TokenType::ClosingParenthesis },
     { "[",  TokenType::OpeningSquareBracket },
-    { "]",  TokenType::ClosingSquareBracket },
-}),
-_keywords({
+    { "]",  TokenType::ClosingSquareBracket }
+};
+
+static constexpr TokenEntry keywords[] = {
     { "and",       TokenType::And },
     { "array",     TokenType::Array },
     { "begin",     TokenType::Begin },
@@ -77,10 +79,136 @@ _keywords({
     { "xor",       TokenType::Xor },
     { "write",     TokenType::Write },
     { "writeln",   TokenType::Writeln }
-}) {
-    if (_fin.fail())
+};
+
+// Perfect hashes over the fixed token sets: every entry of a set lands in its
+// own slot of a 64-entry table holding its index in the set (or -1). The text
+// is still compared, so anything else just misses. The tables are built at
+// compile time and a set that stops hashing perfectly fails to compile.
+static constexpr size_t punctuationHash(char first, char second) {
+    return ((unsigned char)first + 3 * (unsigned char)second) & 63;
+}
+
+static constexpr size_t keywordHash(const char* word, size_t length) {
+    return (5 * (unsigned char)word[0] + 2 * (unsigned char)word[1] + 7 * (unsigned char)word[length - 1] + 8 * length) & 63;
+}
+
+static constexpr size_t textLength(const char* text) {
+    size_t length = 0;
+    while (text[length])
+        ++length;
+    return length;
+}
+
+struct SlotTable {
+    signed char slots[64];
+    bool hasCollision;
+};
+
+template <size_t N>
+static constexpr SlotTable makeSlots(const TokenEntry (&table)[N], bool isKeyword) {
+    SlotTable result = {};
+    for (size_t i = 0; i < 64; ++i)
+        result.slots[i] = -1;
+    for (size_t i = 0; i < N; ++i) {
+        const char* text = table[i].text;
+        size_t slot = isKeyword ? keywordHash(text, textLength(text)) : punctuationHash(text[0], text[1]);
+        if (result.slots[slot] >= 0)
+            result.hasCollision = true;
+        result.slots[slot] = (signed char)i;
+    }
+    return result;
+}
+
+static constexpr SlotTable operationSlots = makeSlots(operations, false);
+static constexpr SlotTable delimiterSlots = makeSlots(delimiters, false);
+static constexpr SlotTable keywordSlots = makeSlots(keywords, true);
+
+static_assert(!operationSlots.hasCollision, "two operations share a hash slot");
+static_assert(!delimiterSlots.hasCollision, "two delimiters share a hash slot");
+static_assert(!keywordSlots.hasCollision, "two keywords share a hash slot");
+
+static constexpr size_t maxKeywordLength = 9;
+
+// Rough number of source bytes per token (including the surrounding spaces),
+// used to size the token arena up front.
+static constexpr size_t averageTokenSize = 4;
+
+static const TokenEntry* findPunctuation(const TokenEntry* table, const signed char* slots, char first, char second) {
+    int idx = slots[punctuationHash(first, second)];
+    if (idx < 0 || table[idx].text[0] != first || table[idx].text[1] != second)
+        return nullptr;
+    return &table[idx];
+}
+
+static const TokenEntry* findOperation(char first, char second = 0) {
+    return findPunctuation(operations, operationSlots.slots, first, second);
+}
+
+static const TokenEntry* findDelimiter(char first, char second = 0) {
+    return findPunctuation(delimiters, delimiterSlots.slots, first, second);
+}
+
+static const TokenEntry* findKeyword(const char* word, size_t length) {
+    if (length < 2 || length > maxKeywordLength)
+        return nullptr;
+    char lower[maxKeywordLength];
+    for (size_t i = 0; i < length; ++i)
+        lower[i] = (char)tolower(word[i]);
+    int idx = keywordSlots.slots[keywordHash(lower, length)];
+    if (idx < 0 || strncmp(keywords[idx].text, lower, length) != 0 || keywords[idx].text[length] != '\0')
+        return nullptr;
+    return &keywords[idx];
+}
+
+static std::map<TokenType, std::string> makeTokenNames() {
+    std::map<TokenType, std::string> names;
+    for (auto& it : keywords)
+        names[it.type] = it.text;
+    for (auto& it : operations)
+        names[it.type] = it.text;
+    for (auto& it : delimiters)
+        names[it.type] = it.text;
+    names[TokenType::EndOfFile] = "end of file";
+    names[TokenType::Operation] = "operation";
+    names[TokenType::Delimiter] = "delimiter";
+    names[TokenType::Identifier] = "identifier";
+    names[TokenType::RealNumber] = "real number";
+    names[TokenType::IntegerNumber] = "integer number";
+    return names;
+}
+
+const std::map<TokenType, std::string> Scanner::_tokenNames = makeTokenNames();
+
+Scanner::Scanner(const char* fname) :
+    _fname(fname),
+    _source(fname),
+    _pos(_source.begin()),
+    _end(_source.end()),
+    _charPos(_pos),
+    _tokenStart(_pos),
+    _line(1),
+    _col(0),
+    _tokenLine(1),
+    _tokenCol(0),
+    _char(' ') {
+    if (_source.fail())
         throw MissingFile(fname);
-    setTokenNames();
+    _tokens.reserve(_source.size() / averageTokenSize);
+}
+
+Scanner::Scanner(const char* data, size_t size) :
+    _source(data, size),
+    _pos(_source.begin()),
+    _end(_source.end()),
+    _charPos(_pos),
+    _tokenStart(_pos),
+    _line(1),
+    _col(0),
+    _tokenLine(1),
+    _tokenCol(0),
+    _char(' ') {
+    _tokens.reserve(_source.size() / averageTokenSize);
 }
 
 TokenPtr Scanner::getToken() const {
@@ -104,19 +232,15 @@ void Scanner::expect(TokenPtr tok, TokenType type) {
     }
 }
 
-Scanner::~Scanner() {
-    _fin.close();
-}
-
 bool Scanner::readChar() {
-    _charBuffer.push_back(_char);
-    if (_charQueue.empty()) {
-        _char = _fin.get();
-        _eof = _fin.eof();
+    if (_pos != _end) {
+        _charPos = _pos;
+        _char = *_pos++;
     }
     else {
-        _char = _charQueue.front();
-        _charQueue.erase(0, 1);
+        _charPos = _end;
+        _char = EOF;
+        _eof = true;
     }
 
     if (isNewLine()) {
@@ -124,7 +248,38 @@ bool Scanner::readChar() {
         _col = -1;
     }
     ++_col;
-    return !_eof || _charQueue.size() != 0;
+    return !_eof;
+}
+
+// Moves the cursor to pos (a position at or after the current character, _end
+// meaning end of file) as if readChar() had been called for every character
+// in between, so runs found by TextScan are consumed in one step.
+void Scanner::advanceTo(const char* pos) {
+    if (pos == _charPos)
+        return;
+    const char* lastNewLine = nullptr;
+    size_t newLines = TextScan::countNewLines(_charPos + 1, pos != _end ? pos + 1 : _end, &lastNewLine);
+    if (newLines > 0) {
+        _line += (int)newLines;
+        _col = (int)(pos - lastNewLine);
+    }
+    else {
+        _col += (int)(pos - _charPos);
+    }
+    _charPos = pos;
+    if (pos != _end) {
+        _char = *pos;
+        _pos = pos + 1;
+    }
+    else {
+        _char = EOF;
+        _eof = true;
+        _pos = _end;
+    }
+}
+
+char Scanner::peekChar() {
+    return _pos != _end ? *_pos : EOF;
 }
 
 bool Scanner::isLetter() {
@@ -133,7 +288,7 @@ bool Scanner::isLetter() {
 }
 
 bool Scanner::isSpace() {
-    return _char == ' ' || _char == '\t' || _char == '\n';
+    return _char == ' ' || _char == '\t' || _char == '\n' || _char == '\r';
 }
 
 bool Scanner::isNumber() {
@@ -161,65 +316,58 @@ bool Scanner::isLetterOrDigit() {
 }
 
 bool Scanner::isOperation() {
-    return isOperation(std::string(1, _char));
-}
-
-bool Scanner::isOperation(const std::string & buf) {
-    return _operations.find(buf) != _operations.end();
+    return findOperation(_char) != nullptr;
 }
 
 bool Scanner::isNewLine() {
     return _char == '\n';
 }
 
-bool Scanner::isKeyWord(std::string word) {
-    return _keywords.find(word) != _keywords.end();
-}
-
 bool Scanner::isDelimiter() {
-    return isDelimiter(std::string(1, _char));
-}
-
-bool Scanner::isDelimiter(const std::string& str) {
-    return _delimiters.find(str) != _delimiters.end();
+    return findDelimiter(_char) != nullptr;
 }
 
 void Scanner::readOperation() {
-    std::string cc(1, _char);
+    char first = _char;
     readChar();
-    if (isOperation(cc + _char)) {
-        cc += _char;
+    const TokenEntry* op = findOperation(first, _char);
+    if (op != nullptr)
         readChar();
-    }
-    setToken(new Operation(_tokenLine, _tokenCol, _operations[cc], cc));
+    else
+        op = findOperation(first);
+    setToken(op->type, TokenType::Operation);
 }
 
 void Scanner::readDelimiterOrOperation() {
-    std::string c(1, _char);
+    char first = _char;
     readChar();
-    std::string cc = c + _char;
-    if (isOperation(cc)) {
-        setToken(new Operation(_tokenLine, _tokenCol, _operations[cc], cc));
+    const TokenEntry* entry = nullptr;
+    if ((entry = findOperation(first, _char)) != nullptr) {
         readChar();
+        setToken(entry->type, TokenType::Operation);
     }
-    else if (isDelimiter(cc)) {
-        setToken(new Delimiter(_tokenLine, _tokenCol, _delimiters[cc], cc));
+    else if ((entry = findDelimiter(first, _char)) != nullptr) {
         readChar();
+        setToken(entry->type, TokenType::Delimiter);
     }
     else {
-        setToken(new Delimiter(_tokenLine, _tokenCol, _delimiters[c], c));
+        entry = findDelimiter(first);
+        setToken(entry->type, TokenType::Delimiter);
     }
 }
 
 void Scanner::readIdentifier() {
-    while (readChar() && isLetterOrDigit());
-    std::string tmp = _charBuffer;
-    std::transform(tmp.begin(), tmp.end(), tmp.begin(), ::tolower);
-    if (isKeyWord(tmp)) {
-        setToken(new Word(_tokenLine, _tokenCol, _keywords[tmp], _charBuffer));
+    if (readChar() && isLetterOrDigit())
+        advanceTo(TextScan::skipIdentifier(_charPos, _end));
+    const TokenEntry* keyword = findKeyword(_tokenStart, _charPos - _tokenStart);
+    if (keyword != nullptr) {
+        setToken(keyword->type, TokenType::Word);
     }
     else {
-        setToken<Identifier>();
+        setToken(TokenType::Identifier, TokenType::Identifier);
+        int symbolId;
+        int nameId = NameTable::intern(_tokenStart, _charPos - _tokenStart, &symbolId);
+        _tokens.back().setName(nameId, symbolId);
     }
 }
 
@@ -244,7 +392,7 @@ void Scanner::readString() {
             value += (char)std::stoi(escape_number);
         }
     }
-    setToken(new String(_tokenLine, _tokenCol, _charBuffer, value));
+    setStringToken(value);
 }
 
 void Scanner::readNumber() {
@@ -273,84 +421,104 @@ void Scanner::readNumber() {
 }
 
 void Scanner::readDecimal() {
-    while (readChar() && isDigit());
+    readDigits();
     if (_char == '.') {
-        if (readChar() && _char == '.') {
-            _charBuffer.pop_back();
-            setToken<IntegerNumber>();
-            _charQueue = ".";
-            --_col;
+        if (peekChar() == '.') {
+            setIntegerToken(parseInteger(_tokenStart, _charPos, 10));
         }
-        else if (isDigit() || isOperation() || _eof || isSpace() || isDelimiter()) {
-            while (isDigit() && readChar());
+        else if ((readChar() && isDigit()) || isOperation() || _eof || isSpace() || isDelimiter()) {
+            if (isDigit())
+                advanceTo(TextScan::skipDigits(_charPos, _end));
             if (_char == '.') {
                 throwException<InvalidReal>();
             }
-            setToken<RealNumber>();
+            setRealToken();
         }
         else {
             throwException<InvalidReal>();
         }
     }
     else if (_char == 'e') {
-        double value = std::stod(_charBuffer);
-        std::string mantissaStr;
-        bool isPlus = true;
         if (readChar() && (_char == '-' || _char == '+')) {
-            isPlus = _char == '+';
             readChar();
         }
         if (!isDigit()) {
             throw InvalidReal(_tokenLine, _tokenCol);
         }
-        do {
-            mantissaStr += _char;
-        } while (readChar() && isDigit());
-        value *= std::pow(10.0, (2 * isPlus - 1) * std::stod(mantissaStr));
-        setToken<RealNumber>();
+        readDigits();
+        setRealToken();
     }
     else {
-        setToken<IntegerNumber>();
+        setIntegerToken(parseInteger(_tokenStart, _charPos, 10));
     }
 }
 
 void Scanner::readHexadecimal() {
     while (readChar() && isHexadecimalDigit());
-    int value = std::stoi(_charBuffer.substr(1), 0, 16);
-    setToken(new IntegerNumber(_tokenLine, _tokenCol, _charBuffer, value));
+    setIntegerToken(parseInteger(_tokenStart + 1, _charPos, 16));
 }
 
 void Scanner::readOctal() {
     while (readChar() && isOctalDigit());
-    int value = std::stoi(_charBuffer.substr(1), 0, 8);
-    setToken(new IntegerNumber(_tokenLine, _tokenCol, _charBuffer, value));
+    setIntegerToken(parseInteger(_tokenStart + 1, _charPos, 8));
 }
 
 void Scanner::readBinary() {
     while (readChar() && isBinaryDigit());
-    int value = std::stoi(_charBuffer.substr(1), 0, 2);
-    setToken(new IntegerNumber(_tokenLine, _tokenCol, _charBuffer, value));
+    setIntegerToken(parseInteger(_tokenStart + 1, _charPos, 2));
 }
 
 void Scanner::readDigits() {
-    while (readChar() && isDigit());
+    if (readChar() && isDigit())
+        advanceTo(TextScan::skipDigits(_charPos, _end));
 }
 
 void Scanner::skipSingleLineComment() {
-    while (readChar() && !isNewLine());
+    if (readChar() && !isNewLine())
+        advanceTo(TextScan::findChar(_charPos, _end, '\n'));
 }
 
 void Scanner::skipMultiLineComment() {
-    while (readChar() && _char != '}');
+    if (readChar() && _char != '}')
+        advanceTo(TextScan::findChar(_charPos, _end, '}'));
     if (_eof) {
         throwException<UnterminatedComment>();
     }
     readChar();
 }
 
-void Scanner::setToken(Token* tok) {
-    _token = TokenPtr(tok);
-    _charBuffer.clear();
+void Scanner::setToken(TokenType type, TokenType kind) {
+    _tokens.push_back(Token(_tokenLine, _tokenCol, type, kind, _tokenStart, _charPos - _tokenStart));
+    _token = TokenPtr(&_tokens, _tokens.size() - 1);
+}
+
+void Scanner::setIntegerToken(long long value) {
+    setToken(TokenType::IntegerNumber, TokenType::IntegerNumber);
+    _tokens.back().setIntValue(value);
+}
+
+void Scanner::setRealToken() {
+    setToken(TokenType::RealNumber, TokenType::RealNumber);
+    _tokens.back().setRealValue(std::stod(_tokens.back().getText()));
+}
+
+void Scanner::setStringToken(std::string& value) {
+    _strings.push_back(std::move(value));
+    setToken(TokenType::String, TokenType::String);
+    _tokens.back().setStringValue(&_strings.back());
+}
+
+long long Scanner::parseInteger(const char* first, const char* last, int base) {
+    if (first == last)
+        throwException<InvalidInteger>();
+    long long value = 0;
+    for (const char* it = first; it != last; ++it) {
+        int digit = *it <= '9' ? *it - '0' : *it - 'A' + 10;
+        if (value > (LLONG_MAX - digit) / base)
+            throwException<InvalidInteger>();
+        value = value * base + digit;
+    }
+    return value;
 }
 
 std::string Scanner::getTokenName(TokenPtr tok) {
@@ -367,24 +535,120 @@ std::string Scanner::getTokenName(TokenType type) {
     return "";
 }
 
-void Scanner::setTokenNames() {
-    for (auto it : _keywords)
-        _tokenNames[it.second] = it.first;
-    for (auto it : _operations)
-        _tokenNames[it.second] = it.first;
-    for (auto it : _delimiters)
-        _tokenNames[it.second] = it.first;
-    _tokenNames[TokenType::EndOfFile] = "end of file";
-    _tokenNames[TokenType::Operation] = "operation";
-    _tokenNames[TokenType::Delimiter] = "delimiter";
-    _tokenNames[TokenType::Identifier] = "identifier";
-    _tokenNames[TokenType::RealNumber] = "real number";
-    _tokenNames[TokenType::IntegerNumber] = "integer number";
+// Lexes the whole input up front; next() then walks the stored tokens. The
+// input is split at line starts outside strings and comments into at most
+// `threads` chunks of at least minChunkSize bytes. Each chunk is lexed on its
+// own thread by a scanner that starts at the chunk's first line, and the
+// chunks are stitched back in order. The result is the token stream next()
+// would produce, including a lexical error, which is raised when the parser
+// reaches it.
+void Scanner::lexParallel(unsigned threads, size_t minChunkSize) {
+    size_t chunks = std::min<size_t>(std::max(threads, 1u), std::max<size_t>(_source.size() / std::max<size_t>(minChunkSize, 1), 1));
+    std::vector<const char*> bounds = findChunkBounds(chunks);
+    if (bounds.size() == 2) {
+        lexAll();
+    }
+    else {
+        std::vector<std::unique_ptr<Scanner>> scanners;
+        int line = _line;
+        for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+            scanners.emplace_back(new Scanner(bounds[i], bounds[i + 1] - bounds[i]));
+            scanners.back()->_line = line;
+            const char* lastNewLine = nullptr;
+            line += (int)TextScan::countNewLines(bounds[i], bounds[i + 1], &lastNewLine);
+        }
+        ThreadPool pool((unsigned)scanners.size());
+        pool.run(scanners.size(), [&](size_t i) { scanners[i]->lexAll(); });
+
+        for (size_t i = 0; i < scanners.size(); ++i) {
+            Scanner& chunk = *scanners[i];
+            bool isLast = i + 1 == scanners.size();
+            for (auto& tok : chunk._tokens) {
+                if (tok.getType() == TokenType::EndOfFile && !isLast)
+                    break;
+                _tokens.push_back(tok);
+                if (tok.getType() == TokenType::String) {
+                    _strings.push_back(tok.getStringValue());
+                    _tokens.back().setStringValue(&_strings.back());
+                }
+            }
+            if (chunk._error) {
+                _error = chunk._error;
+                break;
+            }
+        }
+    }
+    _isLexed = true;
+    _cursor = 0;
+}
+
+// Lexes the rest of the input up front; next() then walks the stored tokens
+// from the one after the current token.
+void Scanner::lexRest() {
+    if (_isLexed)
+        return;
+    size_t cursor = _tokens.size();
+    TokenPtr token = _token;
+    lexAll();
+    _isLexed = true;
+    _cursor = cursor;
+    _token = token;
+}
+
+void Scanner::lexAll() {
+    try {
+        while (getNextToken()->getType() != TokenType::EndOfFile);
+    }
+    catch (...) {
+        _error = std::current_exception();
+    }
+}
+
+// Chunk boundaries: the input start, up to chunks - 1 line starts that are
+// not inside a string or comment, and the input end.
+std::vector<const char*> Scanner::findChunkBounds(size_t chunks) {
+    std::vector<const char*> bounds(1, _pos);
+    const char* pos = _pos;
+    for (size_t i = 1; i < chunks && pos != _end; ++i) {
+        const char* target = _pos + (_end - _pos) * i / chunks;
+        while (pos != _end) {
+            char c = *pos;
+            if (c == '{')
+                pos = TextScan::findChar(pos, _end, '}');
+            else if (c == '\'') {
+                while (++pos != _end && *pos != '\'' && *pos != '\n');
+                if (pos != _end && *pos == '\n')
+                    continue;
+            }
+            else if (c == '/' && pos + 1 != _end && pos[1] == '/') {
+                pos = TextScan::findChar(pos, _end, '\n');
+                continue;
+            }
+            else if (c == '\n' && pos + 1 >= target) {
+                ++pos;
+                break;
+            }
+            if (pos != _end)
+                ++pos;
+        }
+        if (pos != _end && pos != bounds.back())
+            bounds.push_back(pos);
+    }
+    bounds.push_back(_end);
+    return bounds;
 }
 
 void Scanner::next() {
+    if (_isLexed) {
+        if (_cursor < _tokens.size())
+            _token = TokenPtr(&_tokens, _cursor++);
+        else if (_error)
+            std::rethrow_exception(_error);
+        return;
+    }
     while (true) {
-        while (isSpace() && readChar());
+        while (isSpace() && readChar())
+            advanceTo(TextScan::skipSpaces(_charPos, _end));
 
         if (_char == '{') {
             _tokenLine = _line;
@@ -393,28 +657,20 @@ void Scanner::next() {
             continue;
         }
 
-        if (_char == '/') {
-            int tmp_line = _line;
-            int tmp_col = _col;
+        if (_char == '/' && peekChar() == '/') {
             readChar();
-            if (_char == '/') {
-                skipSingleLineComment();
-                continue;
-            }
-            else {
-                _charQueue.push_back(_char);
-                _char = '/';
-                _line = tmp_line;
-                _col = tmp_col;
-            }
+            skipSingleLineComment();
+            continue;
         }
 
         _tokenLine = _line;
         _tokenCol = _col;
-        _charBuffer.clear();
+        _tokenStart = _charPos;
 
-        if (_eof && _charQueue.size() == 0) {
-            setToken(new EndOfFile(_line, _col));
+        if (_eof) {
+            static const char endOfFileText[] = "End of file";
+            _tokens.push_back(Token(_line, _col, TokenType::EndOfFile, TokenType::EndOfFile, endOfFileText, sizeof(endOfFileText) - 1));
+            _token = TokenPtr(&_tokens, _tokens.size() - 1);
         }
         else if (isOperation()) {
             readOperation();
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <fstream>
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <memory>
 #include <set>
@@ -8,13 +9,24 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <exception>
 #include "Token.h"
+#include "NameTable.h"
+#include "TextScan.h"
 #include "error.h"
+#include "SourceBuffer.h"
 
 class Scanner {
 public:
     Scanner(const char*);
+    static const size_t defaultChunkSize = 1 << 18;
+    Scanner(const char* data, size_t size);
     void next();
+    void lexParallel(unsigned threads, size_t minChunkSize = defaultChunkSize);
+    void lexRest();
     std::string getTokenString();
     std::string getTokensString();
     std::map<TokenType, std::string> getTokenNames();
@@ -22,9 +34,12 @@ public:
     TokenPtr getNextToken();
     void expect(TokenType);
     void expect(TokenPtr tok, TokenType type);
-    ~Scanner();
 private:
+    void lexAll();
+    std::vector<const char*> findChunkBounds(size_t chunks);
     bool readChar();
+    void advanceTo(const char* pos);
+    char peekChar();
     bool isLetter();
     bool isSpace();
     bool isNumber();
@@ -34,11 +49,8 @@ private:
     bool isBinaryDigit();
     bool isLetterOrDigit();
     bool isOperation();
-    bool isOperation(const std::string&);
     bool isNewLine();
-    bool isKeyWord(std::string);
     bool isDelimiter();
-    bool isDelimiter(const std::string&);
     void readOperation();
     void readDelimiterOrOperation();
     void readIdentifier();
@@ -51,36 +63,36 @@ private:
     void readDigits();
     void skipSingleLineComment();
     void skipMultiLineComment();
-    void setToken(Token*);
-    template<class T>
-    void setToken();
+    void setToken(TokenType type, TokenType kind);
+    void setIntegerToken(long long value);
+    void setRealToken();
+    void setStringToken(std::string& value);
+    long long parseInteger(const char* first, const char* last, int base);
     template<class T>
     void throwException();
     std::string getTokenName(TokenPtr tok);
     std::string getTokenName(TokenType type);    
-    void setTokenNames();
     std::string _fname;
-    std::ifstream _fin;
+    SourceBuffer _source;
+    const char* _pos;
+    const char* _end;
+    const char* _charPos;
+    const char* _tokenStart;
     int _line = 1;
     int _col = 0;
     int _tokenLine = 1;
     int _tokenCol = 0;
     char _char = ' ';
     bool _eof = false;
-    std::string _charQueue;
-    std::string _charBuffer;
+    std::vector<Token> _tokens;
+    std::deque<std::string> _strings;
     TokenPtr _token;
-    std::map<std::string, TokenType> _operations;
-    std::map<std::string, TokenType> _delimiters;
-    std::map<std::string, TokenType> _keywords;
-    std::map<TokenType, std::string> _tokenNames;
+    bool _isLexed = false;
+    size_t _cursor = 0;
+    std::exception_ptr _error;
+    static const std::map<TokenType, std::string> _tokenNames;
 };
 
-template<class T>
-inline void Scanner::setToken() {
-    setToken(new T(_tokenLine, _tokenCol, _charBuffer));
-}
-
 template<class T>
 inline void Scanner::throwException() {
     throw T(_tokenLine, _tokenCol);
@@ -0,0 +1,76 @@
+#include "SourceBuffer.h"
+
+#include <fstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+SourceBuffer::SourceBuffer(const char* fname) {
+    load(fname);
+}
+
+SourceBuffer::SourceBuffer(const char* data, size_t size) : _begin(data), _end(data + size) {}
+
+SourceBuffer::~SourceBuffer() {
+#ifndef _WIN32
+    if (_mapping != nullptr)
+        munmap(_mapping, _mappingSize);
+#endif
+}
+
+const char* SourceBuffer::begin() const {
+    return _begin;
+}
+
+const char* SourceBuffer::end() const {
+    return _end;
+}
+
+size_t SourceBuffer::size() const {
+    return _end - _begin;
+}
+
+bool SourceBuffer::fail() const {
+    return _fail;
+}
+
+void SourceBuffer::load(const char* fname) {
+#ifndef _WIN32
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        _fail = true;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            _mapping = mapping;
+            _mappingSize = st.st_size;
+            _begin = (const char*)mapping;
+            _end = _begin + _mappingSize;
+            close(fd);
+            return;
+        }
+    }
+    close(fd);
+#endif
+    std::ifstream fin(fname, std::ios::binary);
+    if (fin.fail()) {
+        _fail = true;
+        return;
+    }
+    fin.seekg(0, std::ios::end);
+    std::streamoff size = fin.tellg();
+    fin.seekg(0, std::ios::beg);
+    if (size > 0) {
+        _storage.resize((size_t)size);
+        fin.read(&_storage[0], size);
+        _storage.resize((size_t)fin.gcount());
+    }
+    _begin = _storage.data();
+    _end = _begin + _storage.size();
+}
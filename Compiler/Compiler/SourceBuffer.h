@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Whole source text available through a raw pointer range. A file is mapped
+// into memory (or read with a single bulk read where mapping is unavailable);
+// an in-memory buffer is only referenced and must outlive the SourceBuffer.
+class SourceBuffer {
+public:
+    SourceBuffer(const char* fname);
+    SourceBuffer(const char* data, size_t size);
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    ~SourceBuffer();
+    const char* begin() const;
+    const char* end() const;
+    size_t size() const;
+    bool fail() const;
+private:
+    void load(const char* fname);
+    const char* _begin = nullptr;
+    const char* _end = nullptr;
+    void* _mapping = nullptr;
+    size_t _mappingSize = 0;
+    std::string _storage;
+    bool _fail = false;
+};
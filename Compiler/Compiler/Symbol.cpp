@@ -1,6 +1,8 @@
 #include "Symbol.h"
 
-Symbol::Symbol(SymbolType type, std::string name, int size) : _type(type), _name(name), _size(size) {}
+Symbol::Symbol(SymbolType type, std::string name, int size) : _type(type), _name(name), _size(size) {
+    _nameId = NameTable::intern(_name, &_symbolId);
+}
 
 SymbolType Symbol::getType() {
     return _type;
@@ -22,6 +24,14 @@ std::string Symbol::getName() {
     return _name;
 }
 
+int Symbol::getNameId() {
+    return _nameId;
+}
+
+int Symbol::getSymbolId() {
+    return _symbolId;
+}
+
 bool Symbol::isType() {
     return false;
 }
@@ -67,7 +77,7 @@ std::string SymVar::toString(int depth) {
     if (_init != nullptr) {
         sstream << std::setw(_thirdColumnWidth);
         if (_varType->getType() == SymbolType::TypeInteger)
-            sstream << _init->getValue<int>();
+            sstream << _init->getValue<i64>();
         else if (_varType->getType() == SymbolType::TypeReal)
             sstream << _init->getValue<double>();
     }
@@ -84,11 +94,11 @@ SymbolType SymVar::getVarType() {
 void SymVar::generate(AsmCode & asmCode) {
     if (getType() == SymbolType::VarGlobal)
         if (getSize() == 8) {
-            asmCode.addCmd(MOV, RAX, asmCode.getAdressOperand(asmCode.getVarName(_name)));
+            asmCode.addCmd(MOV, RAX, asmCode.getAdressOperand(asmCode.getVarName(_nameId)));
             asmCode.addCmd(PUSH, RAX);
         }
         else
-            generateMemoryCopy(asmCode, AsmCmdPtr(new AsmCmd(MOV, AsmOperandPtr(new AsmReg(RAX)), AsmOperandPtr(new AsmStringImmediate(asmCode.getVarName(_name))))), ADD);
+            generateMemoryCopy(asmCode, AsmCmdPtr(new AsmCmd(MOV, AsmOperandPtr(new AsmReg(RAX)), AsmOperandPtr(new AsmStringImmediate(asmCode.getVarName(_nameId))))), ADD);
     else 
         if (getSize() == 8) {
             asmCode.addCmd(MOV, RAX, asmCode.getAdressOperand(RBP, -(int)getOffset() - 8));
@@ -100,7 +110,7 @@ void SymVar::generate(AsmCode & asmCode) {
 
 void SymVar::generateLValue(AsmCode & asmCode) {
     if (getType() == SymbolType::VarGlobal)
-        asmCode.addCmd(PUSH, asmCode.getVarName(_name));
+        asmCode.addCmd(PUSH, asmCode.getVarName(_nameId));
     else {
         asmCode.addCmd(LEA, RAX, asmCode.getAdressOperand(RBP, -(int)getOffset() - 8));
         asmCode.addCmd(PUSH, RAX);
@@ -136,12 +146,12 @@ void SymVar::generateMemoryCopy(AsmCode & asmCode, AsmCmdPtr cmdMemory, AsmOpTyp
 }
 
 void SymVar::generateDecl(AsmCode & asmCode) {
-    std::string varName = asmCode.getVarName(_name);
+    std::string varName = asmCode.getVarName(_nameId);
     SymbolType type = _varType->getType();
     type = type == SymbolType::TypeAlias ? std::dynamic_pointer_cast<SymTypeAlias>(_varType)->getRefType() : type;
     switch (type) {
         case SymbolType::TypeInteger:
-            asmCode.addData(varName, _init == nullptr ? 0 : _init->getValue<int>());
+            asmCode.addData(varName, _init == nullptr ? (i64)0 : _init->getValue<i64>());
             break;
         case SymbolType::TypeReal:
             asmCode.addData(varName, _init == nullptr ? 0.0 : _init->getValue<double>());
@@ -158,28 +168,40 @@ void SymTable::add(SymbolPtr symb) {
         symb->setOffset(_size);
         _size += symb->getSize();
     }
-    _symbolNames[symb->getName()] = _symbols.size();
+    _symbolIds[symb->getSymbolId()] = _symbols.size();
     _symbols.push_back(symb);
 }
 
+bool SymTable::have(int symbolId) {
+    return _symbolIds.find(symbolId) != _symbolIds.end();
+}
+
 bool SymTable::have(std::string name) {
-    return _symbolNames.find(name) != _symbolNames.end();
+    int symbolId;
+    NameTable::intern(name, &symbolId);
+    return have(symbolId);
+}
+
+SymbolPtr SymTable::getSymbol(int symbolId) {
+    return _symbols[_symbolIds[symbolId]];
 }
 
 SymbolPtr SymTable::getSymbol(std::string name) {
-    return _symbols[_symbolNames[name]];
+    int symbolId;
+    NameTable::intern(name, &symbolId);
+    return getSymbol(symbolId);
 }
 
 std::vector<SymbolPtr>& SymTable::getSymbols() {
     return _symbols;
 }
 
-std::unordered_map<std::string, int>& SymTable::getSymbolNames() {
-    return _symbolNames;
+std::unordered_map<int, int>& SymTable::getSymbolIds() {
+    return _symbolIds;
 }
 
 void SymTable::checkUnique(TokenPtr token) {
-    if (have(token->getText()))
+    if (have(token->getSymbolId()))
         throw Duplicate(token->getLine(), token->getCol(), token->getText());
 }
 
@@ -213,15 +235,14 @@ void SymTableStack::pop() {
     _symTables.pop_back();
 }
 
-bool SymTableStack::haveSymbol(std::string name) {
-    return findTableBySymbol(name) != nullptr;
+bool SymTableStack::haveSymbol(int symbolId) {
+    return findTableBySymbol(symbolId) != nullptr;
 }
 
 SymbolPtr SymTableStack::getSymbol(TokenPtr token, bool isSymbolCheck) {
-    std::string name = token->getText();
-    SymTablePtr table = findTableBySymbol(name);
+    SymTablePtr table = findTableBySymbol(token->getSymbolId());
     if (table != nullptr)
-        return findTableBySymbol(name)->getSymbol(name);
+        return table->getSymbol(token->getSymbolId());
     else
         if (isSymbolCheck)
             throw WrongSymbol(token->getLine(), token->getCol(), token->getText());
@@ -229,9 +250,9 @@ SymbolPtr SymTableStack::getSymbol(TokenPtr token, bool isSymbolCheck) {
             return SymbolPtr(new SymType(SymbolType::TypeInteger, "integer"));
 }
 
-SymTablePtr SymTableStack::findTableBySymbol(const std::string& symbol) {
+SymTablePtr SymTableStack::findTableBySymbol(int symbolId) {
     for (auto i = _symTables.rbegin(); i != _symTables.rend(); ++i)
-        if ((*i)->have(symbol))
+        if ((*i)->have(symbolId))
             return *i;
 
     return nullptr;
@@ -246,16 +267,16 @@ std::string SymTypeRecord::toString(int depth) {
     return sstream.str();
 }
 
-SymbolPtr SymTypeRecord::getSymbol(std::string& name) {
-    return _symTable->getSymbol(name);
+SymbolPtr SymTypeRecord::getSymbol(int symbolId) {
+    return _symTable->getSymbol(symbolId);
 }
 
 SymTablePtr SymTypeRecord::getTable() {
     return _symTable;
 }
 
-bool SymTypeRecord::have(std::string & name) {
-    return _symTable->have(name);
+bool SymTypeRecord::have(int symbolId) {
+    return _symTable->have(symbolId);
 }
 
 size_t SymTypeRecord::getSize() {
@@ -351,9 +372,9 @@ std::string SymConst::toString(int depth) {
     return sstream.str();
 }
 
-SymIntegerConst::SymIntegerConst(std::string name, int value) : SymConst(SymbolType::ConstInteger, name), _value(value) {}
+SymIntegerConst::SymIntegerConst(std::string name, i64 value) : SymConst(SymbolType::ConstInteger, name), _value(value) {}
 
-int SymIntegerConst::getValue() {
+i64 SymIntegerConst::getValue() {
     return _value;
 }
 
@@ -367,8 +388,13 @@ SymbolType SymIntegerConst::getVarType() {
     return SymbolType::TypeInteger;
 }
 
+void SymIntegerConst::generate(AsmCode & asmCode) {
+    asmCode.addCmd(MOV, RAX, _value);
+    asmCode.addCmd(PUSH, RAX);
+}
+
 void SymIntegerConst::generateDecl(AsmCode & asmCode) {
-    asmCode.addData(asmCode.getVarName(_name), _value);
+    asmCode.addData(asmCode.getVarName(_nameId), _value);
 }
 
 std::string SymIntegerConst::getConstTypeStr() {
@@ -391,8 +417,16 @@ SymbolType SymRealConst::getVarType() {
     return SymbolType::TypeReal;
 }
 
+// Local constants get no declaration, so the value comes from the constant
+// pool.
+void SymRealConst::generate(AsmCode & asmCode) {
+    std::string name = asmCode.addRealConst(_value);
+    asmCode.addCmd(MOV, RAX, asmCode.getAdressOperand(name));
+    asmCode.addCmd(PUSH, RAX);
+}
+
 void SymRealConst::generateDecl(AsmCode & asmCode) {
-    asmCode.addData(asmCode.getVarName(_name), _value);
+    asmCode.addData(asmCode.getVarName(_nameId), _value);
 }
 
 std::string SymRealConst::getConstTypeStr() {
@@ -6,6 +6,7 @@
 #include <unordered_map>
 #include <iomanip>
 #include "Token.h"
+#include "NameTable.h"
 #include "error.h"
 #include "Const.h"
 #include "AsmGen.h"
@@ -47,6 +48,8 @@ public:
     virtual size_t getOffset();
     virtual void setOffset(size_t offset);
     virtual std::string getName();
+    int getNameId();
+    int getSymbolId();
     virtual bool isType();
     virtual std::string toString(int depth);
     virtual SymbolType getVarType();
@@ -58,6 +61,7 @@ protected:
     size_t _size;
     size_t _offset;
     std::string _name;
+    int _nameId, _symbolId;
     SymbolType _type;
     static const int _spaces = 4;
     static const int _firstColumnWidth = 15;
@@ -68,17 +72,19 @@ protected:
 class SymTable {
 public:
     void add(SymbolPtr symb);
+    bool have(int symbolId);
     bool have(std::string name);
+    SymbolPtr getSymbol(int symbolId);
     SymbolPtr getSymbol(std::string name);
     std::vector<SymbolPtr>& getSymbols();
-    std::unordered_map<std::string, int>& getSymbolNames();
+    std::unordered_map<int, int>& getSymbolIds();
     void checkUnique(TokenPtr token);
     size_t getSize();
     std::string toString(int depth);
 private:
     size_t _size = 0;
     std::vector<SymbolPtr> _symbols;
-    std::unordered_map<std::string, int> _symbolNames;
+    std::unordered_map<int, int> _symbolIds;
 };
 
 typedef std::shared_ptr<SymTable> SymTablePtr;
@@ -89,9 +95,9 @@ public:
     void addTable(SymTablePtr table);
     SymTablePtr top();
     void pop();
-    bool haveSymbol(std::string name);
+    bool haveSymbol(int symbolId);
     SymbolPtr getSymbol(TokenPtr token, bool isSymbolCheck = true);
-    SymTablePtr findTableBySymbol(const std::string& symbol);
+    SymTablePtr findTableBySymbol(int symbolId);
 private:
     std::vector<SymTablePtr> _symTables;
 };
@@ -124,9 +130,9 @@ class SymTypeRecord : public SymType {
 public:
     SymTypeRecord(SymTablePtr table);
     std::string toString(int depth);
-    SymbolPtr getSymbol(std::string& name);
+    SymbolPtr getSymbol(int symbolId);
     SymTablePtr getTable();
-    bool have(std::string& name);
+    bool have(int symbolId);
     size_t getSize() override;
 private:
     SymTablePtr _symTable;
@@ -202,14 +208,15 @@ protected:
 
 class SymIntegerConst : public SymConst {
 public:
-    SymIntegerConst(std::string name, int value);
-    int getValue();
+    SymIntegerConst(std::string name, i64 value);
+    i64 getValue();
     std::string toString(int depth) override;
     SymbolType getVarType() override;
+    void generate(AsmCode& asmCode) override;
     void generateDecl(AsmCode& asmCode) override;
 private:
     std::string getConstTypeStr() override;
-    int _value;
+    i64 _value;
 };
 
 class SymRealConst : public SymConst {
@@ -218,6 +225,7 @@ public:
     double getValue();
     std::string toString(int depth) override;
     SymbolType getVarType() override;
+    void generate(AsmCode& asmCode) override;
     void generateDecl(AsmCode& asmCode) override;
 private:
     std::string getConstTypeStr() override;
@@ -1,5 +1,11 @@
 ﻿#include "SynNode.h"
 #include "TypeChecker.h"
+#include "RegisterGen.h"
+
+static int resultSymbolId() {
+    static const int symbolId = NameTable::getSymbolId(NameTable::intern("result"));
+    return symbolId;
+}
 
 SynNode::SynNode(SynNodeType type) : _type(type) {}
 
@@ -7,10 +13,32 @@ SynNodeType SynNode::getNodeType() {
     return _type;
 }
 
+// A node's type is computed on first use and every later query (type checks,
+// code generation) reads the cache. The setters that swap a child (used by
+// ConstFolder) do not clear it, so a replacement must have the same type as
+// the node it replaces.
 SymbolType SynNode::getType() {
+    if (!_isTypeKnown) {
+        _exprType = computeType();
+        _isTypeKnown = true;
+    }
+    return _exprType;
+}
+
+SymbolType SynNode::computeType() {
     return SymbolType::None;
 }
 
+// Jumps to label when the value is nonzero, or when it is zero if
+// isJumpIfTrue is false. Comparisons override this to branch on the flags
+// instead of materializing 0 or 1 first.
+void SynNode::generateBranch(AsmCode& asmCode, const std::string& label, bool isJumpIfTrue) {
+    generate(asmCode);
+    asmCode.addCmd(POP, RAX);
+    asmCode.addCmd(TEST, RAX, RAX);
+    asmCode.addCmd(isJumpIfTrue ? JNZ : JZ, label);
+}
+
 int SynNode::getSize() {
     return 0;
 }
@@ -38,7 +66,7 @@ void SynNode::updateIndentAndStr(std::string& str, std::string& indent, bool las
     }
 }
 
-BinOpNode::BinOpNode(TokenPtr t, const PNode& left, const PNode& right) :
+BinOpNode::BinOpNode(TokenPtr t, PNode left, PNode right) :
     OpNode(t, SynNodeType::BinaryOp),
     _left(left),
     _right(right) {}
@@ -53,12 +81,15 @@ std::string BinOpNode::toString(std::string indent, bool last) {
 }
 
 void BinOpNode::generate(AsmCode & asmCode) {
+    if (asmCode.getBackend() == AsmBackend::Register && RegisterGen::canGenerate(this)) {
+        RegisterGen(asmCode).generate(this);
+        return;
+    }
     _left->generate(asmCode);
     _right->generate(asmCode);
     SymbolType leftType = _left->getType();
     SymbolType rightType = _right->getType();
-    SymbolType castedType = TypeChecker::tryCast(leftType, rightType);
-    switch (castedType) {
+    switch (getType()) {
         case SymbolType::TypeInteger:  generateInt(asmCode); break;
         case SymbolType::TypeReal:     generateReal(leftType, rightType, asmCode);  break;
         case SymbolType::TypeBoolean:  break;
@@ -79,11 +110,11 @@ void BinOpNode::generateInt(AsmCode & asmCode) {
             asmCode.addCmd(IMUL, RBX);
             break;
         case TokenType::Div:
-            asmCode.addCmd(XOR, RDX, RDX);
+            asmCode.addCmd(CQO);
             asmCode.addCmd(IDIV, RBX);
             break;
         case TokenType::Mod:
-            asmCode.addCmd(XOR, RDX, RDX);
+            asmCode.addCmd(CQO);
             asmCode.addCmd(IDIV, RBX);
             asmCode.addCmd(MOV, RAX, RDX);
             break;
@@ -95,6 +126,7 @@ void BinOpNode::generateInt(AsmCode & asmCode) {
             break;
         case TokenType::Xor:
             asmCode.addCmd(XOR, RAX, RBX);
+            break;
         case TokenType::Shl:
             asmCode.addCmd(MOV, RCX, RBX);
             asmCode.addCmd(SHL, RAX, CL);
@@ -111,18 +143,7 @@ void BinOpNode::generateInt(AsmCode & asmCode) {
 }
 
 void BinOpNode::generateReal(SymbolType leftType, SymbolType rightType, AsmCode & asmCode) {
-    asmCode.addCmd(POP, RBX);
-    asmCode.addCmd(POP, RAX);
-    if (leftType == SymbolType::TypeInteger)
-        asmCode.addCmd(CVTSI2SD, XMM0, RAX);
-    else
-        asmCode.addCmd(MOVQ, XMM0, RAX);
-
-    if (rightType == SymbolType::TypeInteger)
-        asmCode.addCmd(CVTSI2SD, XMM1, RBX);
-    else
-        asmCode.addCmd(MOVQ, XMM1, RBX);
-
+    loadRealOperands(asmCode);
     bool isRelation = false;
     switch (_op) {
         case TokenType::Add:
@@ -147,66 +168,93 @@ void BinOpNode::generateReal(SymbolType leftType, SymbolType rightType, AsmCode
     asmCode.addCmd(PUSH, RAX);
 }
 
-void BinOpNode::generateIntRelation(AsmCode & asmCode) {
-    asmCode.addCmd(CMP, RAX, RBX);
-    std::string label1 = asmCode.genLabelName();
-    std::string label2 = asmCode.genLabelName();
+// Pops the operands into XMM0 and XMM1, converting integers.
+void BinOpNode::loadRealOperands(AsmCode& asmCode) {
+    asmCode.addCmd(POP, RBX);
+    asmCode.addCmd(POP, RAX);
+    if (_left->getType() == SymbolType::TypeInteger)
+        asmCode.addCmd(CVTSI2SD, XMM0, RAX);
+    else
+        asmCode.addCmd(MOVQ, XMM0, RAX);
+
+    if (_right->getType() == SymbolType::TypeInteger)
+        asmCode.addCmd(CVTSI2SD, XMM1, RBX);
+    else
+        asmCode.addCmd(MOVQ, XMM1, RBX);
+}
+
+// The jump taken when the relation holds after cmp or comisd, NONE for an
+// operator that is not a relation.
+AsmOpType BinOpNode::getRelationJump(bool isReal) {
     switch (_op) {
-        case TokenType::Equal:
-            asmCode.addCmd(JE, label1);
-            break;
-        case TokenType::NotEqual:
-            asmCode.addCmd(JNE, label1);
-            break;
-        case TokenType::Less:
-            asmCode.addCmd(JL, label1);
-            break;
-        case TokenType::LessEqual:
-            asmCode.addCmd(JLE, label1);
-            break;
-        case TokenType::GreaterEqual:
-            asmCode.addCmd(JGE, label1);
-            break;
-        case TokenType::Greater:
-            asmCode.addCmd(JG, label1);
-            break;
+        case TokenType::Equal:        return JE;
+        case TokenType::NotEqual:     return JNE;
+        case TokenType::Less:         return isReal ? JB : JL;
+        case TokenType::LessEqual:    return isReal ? JBE : JLE;
+        case TokenType::GreaterEqual: return isReal ? JAE : JGE;
+        case TokenType::Greater:      return isReal ? JA : JG;
+        default:                      return NONE;
     }
-    asmCode.addCmd(XOR, RAX, RAX);
-    asmCode.addCmd(JMP, label2);
-    asmCode.addLabel(label1);
-    asmCode.addCmd(MOV, RAX, 1);
-    asmCode.addLabel(label2);
+}
+
+// Any other operator that ends up here yields 0.
+void BinOpNode::generateIntRelation(AsmCode & asmCode) {
+    AsmOpType jump = getRelationJump(false);
+    if (jump == NONE) {
+        asmCode.addCmd(XOR, RAX, RAX);
+        return;
+    }
+    asmCode.addCmd(CMP, RAX, RBX);
+    asmCode.addCmd(getSetForJump(jump), AL);
+    asmCode.addCmd(MOVZX, RAX, AL);
 }
 
 void BinOpNode::generateRealRelation(AsmCode& asmCode) {
+    AsmOpType jump = getRelationJump(true);
+    if (jump == NONE) {
+        asmCode.addCmd(XOR, RAX, RAX);
+        return;
+    }
     asmCode.addCmd(COMISD, XMM0, XMM1);
-    std::string label1 = asmCode.genLabelName();
-    std::string label2 = asmCode.genLabelName();
-    switch (_op) {
-        case TokenType::Equal:
-            asmCode.addCmd(JE, label1);
-            break;
-        case TokenType::NotEqual:
-            asmCode.addCmd(JNE, label1);
-            break;
-        case TokenType::Less:
-            asmCode.addCmd(JB, label1);
-            break;
-        case TokenType::LessEqual:
-            asmCode.addCmd(JBE, label1);
-            break;
-        case TokenType::GreaterEqual:
-            asmCode.addCmd(JAE, label1);
-            break;
-        case TokenType::Greater:
-            asmCode.addCmd(JA, label1);
-            break;
+    asmCode.addCmd(getSetForJump(jump), AL);
+    asmCode.addCmd(MOVZX, RAX, AL);
+}
+
+// A comparison of integers or reals jumps on the flags it sets. A
+// short-circuit and/or branches on its left operand first and only evaluates
+// the right one when that does not decide the outcome.
+void BinOpNode::generateBranch(AsmCode& asmCode, const std::string& label, bool isJumpIfTrue) {
+    if (isShortCircuit()) {
+        if ((_op == TokenType::And) == isJumpIfTrue) {
+            std::string skip = asmCode.genLabelName();
+            _left->generateBranch(asmCode, skip, !isJumpIfTrue);
+            _right->generateBranch(asmCode, label, isJumpIfTrue);
+            asmCode.addLabel(skip);
+        }
+        else {
+            _left->generateBranch(asmCode, label, isJumpIfTrue);
+            _right->generateBranch(asmCode, label, isJumpIfTrue);
+        }
+        return;
     }
-    asmCode.addCmd(MOV, RAX, 0);
-    asmCode.addCmd(JMP, label2);
-    asmCode.addLabel(label1);
-    asmCode.addCmd(MOV, RAX, 1);
-    asmCode.addLabel(label2);
+    bool isReal = getType() == SymbolType::TypeReal;
+    AsmOpType jump = isArithmetic() ? getRelationJump(isReal) : NONE;
+    if (jump == NONE) {
+        SynNode::generateBranch(asmCode, label, isJumpIfTrue);
+        return;
+    }
+    _left->generate(asmCode);
+    _right->generate(asmCode);
+    if (isReal) {
+        loadRealOperands(asmCode);
+        asmCode.addCmd(COMISD, XMM0, XMM1);
+    }
+    else {
+        asmCode.addCmd(POP, RBX);
+        asmCode.addCmd(POP, RAX);
+        asmCode.addCmd(CMP, RAX, RBX);
+    }
+    asmCode.addCmd(isJumpIfTrue ? jump : getInverseJump(jump), label);
 }
 
 void BinOpNode::generateBoolean(AsmCode & asmCode) {
@@ -235,6 +283,86 @@ void BinOpNode::generateBoolean(AsmCode & asmCode) {
     asmCode.addCmd(PUSH, RAX);
 }
 
+// Integer or real arithmetic and comparisons, the part of the operators that
+// code generators other than the stack machine evaluate themselves. Integer
+// "/" and Boolean operators are left to the stack machine.
+bool BinOpNode::isArithmetic() {
+    SymbolType leftType = _left->getType();
+    SymbolType rightType = _right->getType();
+    bool isRelation = _op == TokenType::Equal || _op == TokenType::NotEqual || _op == TokenType::Less ||
+                      _op == TokenType::LessEqual || _op == TokenType::Greater || _op == TokenType::GreaterEqual;
+    switch (getType()) {
+        case SymbolType::TypeInteger:
+            if (leftType != SymbolType::TypeInteger || rightType != SymbolType::TypeInteger)
+                return false;
+            switch (_op) {
+                case TokenType::Add: case TokenType::Sub: case TokenType::Mul:
+                case TokenType::Div: case TokenType::Mod:
+                case TokenType::And: case TokenType::Or: case TokenType::Xor:
+                case TokenType::Shl: case TokenType::Shr:
+                    return true;
+                default:
+                    return isRelation;
+            }
+        case SymbolType::TypeReal:
+            if ((leftType != SymbolType::TypeInteger && leftType != SymbolType::TypeReal) ||
+                (rightType != SymbolType::TypeInteger && rightType != SymbolType::TypeReal))
+                return false;
+            switch (_op) {
+                case TokenType::Add: case TokenType::Sub: case TokenType::Mul: case TokenType::DivReal:
+                    return true;
+                default:
+                    return isRelation;
+            }
+        default:
+            return false;
+    }
+}
+
+// Expressions that are always 0 or 1, on which the bitwise and/or give the
+// same result as the logical ones.
+static bool isBoolean(PNode node) {
+    switch (node->getNodeType()) {
+        case SynNodeType::IntegerNumber: {
+            i64 value = static_cast<IntConstNode*>(node)->getValue();
+            return value == 0 || value == 1;
+        }
+        case SynNodeType::BinaryOp: {
+            BinOpNode* op = static_cast<BinOpNode*>(node);
+            if (op->getType() != SymbolType::TypeInteger || !op->isArithmetic())
+                return false;
+            switch (op->getOpType()) {
+                case TokenType::Equal: case TokenType::NotEqual: case TokenType::Less:
+                case TokenType::LessEqual: case TokenType::Greater: case TokenType::GreaterEqual:
+                    return true;
+                case TokenType::And: case TokenType::Or: case TokenType::Xor:
+                    return isBoolean(op->getLeft()) && isBoolean(op->getRight());
+                default:
+                    return false;
+            }
+        }
+        case SynNodeType::UnaryOp: {
+            UnaryNode* op = static_cast<UnaryNode*>(node);
+            return op->getOpType() == TokenType::Not && op->getArg()->getType() == SymbolType::TypeInteger &&
+                   isBoolean(op->getArg());
+        }
+        default:
+            return false;
+    }
+}
+
+// An and/or parsed in short-circuit mode ({$B-} in Borland Pascal) whose
+// operands are both Boolean, so skipping the right operand only skips its
+// side effects. Conditions branch on it without evaluating both operands.
+bool BinOpNode::isShortCircuit() {
+    return _isShortCircuit && (_op == TokenType::And || _op == TokenType::Or) && getType() == SymbolType::TypeInteger &&
+           isBoolean(_left) && isBoolean(_right);
+}
+
+void BinOpNode::setShortCircuit(bool isShortCircuit) {
+    _isShortCircuit = isShortCircuit;
+}
+
 PNode BinOpNode::getLeft() {
     return _left;
 }
@@ -243,11 +371,19 @@ PNode BinOpNode::getRight() {
     return _right;
 }
 
-SymbolType BinOpNode::getType() {
+void BinOpNode::setLeft(PNode left) {
+    _left = left;
+}
+
+void BinOpNode::setRight(PNode right) {
+    _right = right;
+}
+
+SymbolType BinOpNode::computeType() {
     return TypeChecker::tryCast(_left->getType(), _right->getType());
 }
 
-IntConstNode::IntConstNode(int value) : SynNode(SynNodeType::IntegerNumber), _value(value) {}
+IntConstNode::IntConstNode(i64 value) : SynNode(SynNodeType::IntegerNumber), _value(value) {}
 
 std::string IntConstNode::toString(std::string indent, bool last) {
     return makeIndent(indent, last) + std::to_string(_value);
@@ -258,30 +394,38 @@ void IntConstNode::generate(AsmCode & asmCode) {
     asmCode.addCmd(PUSH, RAX);
 }
 
-SymbolType IntConstNode::getType() {
+SymbolType IntConstNode::computeType() {
     return SymbolType::TypeInteger;
 }
 
-int IntConstNode::getValue() {
+i64 IntConstNode::getValue() {
     return _value;
 }
 
-IdentifierNode::IdentifierNode(std::string name, SymbolPtr symbol) : SynNode(SynNodeType::Identifier), _name(name), _symbol(symbol) {}
+IdentifierNode::IdentifierNode(int nameId, SymbolPtr symbol) : SynNode(SynNodeType::Identifier), _nameId(nameId), _symbol(symbol) {}
 
 std::string IdentifierNode::getName() {
-    return _name;
+    return NameTable::getText(_nameId);
+}
+
+int IdentifierNode::getNameId() {
+    return _nameId;
+}
+
+int IdentifierNode::getSymbolId() {
+    return NameTable::getSymbolId(_nameId);
 }
 
 std::string IdentifierNode::toString(std::string indent, bool last) {
-    return makeIndent(indent, last) + _name;
+    return makeIndent(indent, last) + NameTable::getText(_nameId);
 }
 
-SymbolType IdentifierNode::getType() {
+SymbolType IdentifierNode::computeType() {
     SymbolType type = _symbol->getType();
     if (type == SymbolType::Proc || type == SymbolType::TypeRecord)
         return type;
     else if (type == SymbolType::Func)
-        return std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol("result")->getVarType();
+        return std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol(resultSymbolId())->getVarType();
     return _symbol->getVarType();
 }
 
@@ -292,7 +436,7 @@ SymbolPtr IdentifierNode::getSymbol() {
 int IdentifierNode::getSize() {
     switch (_symbol->getType()) {
         case SymbolType::Func:
-            return std::dynamic_pointer_cast<SymVar>(std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol("result"))->getSize();
+            return std::dynamic_pointer_cast<SymVar>(std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol(resultSymbolId()))->getSize();
         default:
             return _symbol->getSize();
     }
@@ -317,13 +461,12 @@ std::string RealConstNode::toString(std::string indent, bool last) {
 }
 
 void RealConstNode::generate(AsmCode & asmCode) {
-    std::string name = asmCode.genVarName();
-    asmCode.addData(name, _value);
+    std::string name = asmCode.addRealConst(_value);
     asmCode.addCmd(MOV, RAX, asmCode.getAdressOperand(name));
     asmCode.addCmd(PUSH, RAX);
 }
 
-SymbolType RealConstNode::getType() {
+SymbolType RealConstNode::computeType() {
     return SymbolType::TypeReal;
 }
 
@@ -331,7 +474,7 @@ double RealConstNode::getValue() {
     return _value;
 }
 
-RecordAccessNode::RecordAccessNode(const PNode& left, const PNode& right, SymbolPtr symbol) :
+RecordAccessNode::RecordAccessNode(PNode left, PNode right, SymbolPtr symbol) :
     SynNode(SynNodeType::RecordAccess),
     _left(left),
     _right(right),
@@ -358,7 +501,7 @@ int RecordAccessNode::getSize() {
     return _right->getSize();
 }
 
-SymbolType RecordAccessNode::getType() {
+SymbolType RecordAccessNode::computeType() {
     return _right->getType();
 }
 
@@ -373,7 +516,7 @@ void RecordAccessNode::generateLValue(AsmCode & asmCode) {
     _left->generateLValue(asmCode);
     asmCode.addCmd(POP, RAX);
     AsmOpType op = _left->isLocal() ? SUB : ADD;
-    asmCode.addCmd(op, RAX, std::dynamic_pointer_cast<IdentifierNode>(_right)->getSymbol()->getOffset());
+    asmCode.addCmd(op, RAX, dynamic_cast<IdentifierNode*>(_right)->getSymbol()->getOffset());
     asmCode.addCmd(PUSH, RAX);
 }
 
@@ -381,7 +524,7 @@ bool RecordAccessNode::isLocal() {
     return _left->isLocal();
 }
 
-ArrayIndexNode::ArrayIndexNode(const PNode& left, const std::vector<PNode>& args, SymbolPtr symbol) :
+ArrayIndexNode::ArrayIndexNode(PNode left, const std::vector<PNode>& args, SymbolPtr symbol) :
     SynNode(SynNodeType::ArrayIndex),
     _arr(left),
     _args(args),
@@ -402,7 +545,7 @@ SymbolPtr ArrayIndexNode::getSymbol() {
     return _symbol;
 }
 
-SymbolType ArrayIndexNode::getType() {
+SymbolType ArrayIndexNode::computeType() {
     SymbolType type = _symbol->getVarType();
     if (type == SymbolType::TypeArray)
         type = std::dynamic_pointer_cast<SymTypeArray>(std::dynamic_pointer_cast<SymVar>(_symbol)->getVarTypeSymbol())->getArrType();
@@ -448,7 +591,7 @@ void ArrayIndexNode::generateIdx(AsmCode & asmCode) {
     SymbolPtr type = std::dynamic_pointer_cast<SymVar>(_symbol)->getVarTypeSymbol();
     int left = 0;
     AsmOpType asmOp;
-    asmOp = std::dynamic_pointer_cast<IdentifierNode>(_arr)->isLocal() ? SUB : ADD;
+    asmOp = dynamic_cast<IdentifierNode*>(_arr)->isLocal() ? SUB : ADD;
     for (auto arg : _args) {
         if (type->getType() == SymbolType::TypeArray) {
             left = std::dynamic_pointer_cast<SymTypeArray>(type)->getLeft();
@@ -481,11 +624,19 @@ PNode UnaryNode::getArg() {
     return _arg;
 }
 
-SymbolType UnaryNode::getType() {
+void UnaryNode::setArg(PNode arg) {
+    _arg = arg;
+}
+
+SymbolType UnaryNode::computeType() {
     return _arg->getType();
 }
 
 void UnaryNode::generate(AsmCode & asmCode) {
+    if (asmCode.getBackend() == AsmBackend::Register && RegisterGen::canGenerate(this)) {
+        RegisterGen(asmCode).generate(this);
+        return;
+    }
     _arg->generate(asmCode);
     if (_arg->getType() == SymbolType::TypeInteger) {
         asmCode.addCmd(POP, RAX);
@@ -525,18 +676,33 @@ std::string IfNode::toString(std::string indent, bool last) {
 }
 
 void IfNode::generate(AsmCode & asmCode) {
-    _cond->generate(asmCode);
     std::string label1 = asmCode.genLabelName();
     std::string label2 = asmCode.genLabelName();
-    asmCode.addCmd(POP, RAX);
-    asmCode.addCmd(TEST, RAX, RAX);
-    asmCode.addCmd(JZ, label1);
+    _cond->generateBranch(asmCode, label1, false);
     _then->generate(asmCode);
-    asmCode.addCmd(JMP, label2);
-    asmCode.addLabel(label1);
     if (_else)
+        asmCode.addCmd(JMP, label2);
+    asmCode.addLabel(label1);
+    if (_else) {
         _else->generate(asmCode);
-    asmCode.addLabel(label2);
+        asmCode.addLabel(label2);
+    }
+}
+
+PNode IfNode::getCond() {
+    return _cond;
+}
+
+void IfNode::setCond(PNode cond) {
+    _cond = cond;
+}
+
+PNode IfNode::getThen() {
+    return _then;
+}
+
+PNode IfNode::getElse() {
+    return _else;
 }
 
 WhileNode::WhileNode(PNode cond, PNode block) :
@@ -561,14 +727,23 @@ void WhileNode::generate(AsmCode& asmCode) {
     asmCode.addLabel(start);
     _block->generate(asmCode);
     asmCode.addLabel(cond);
-    _cond->generate(asmCode);
-    asmCode.addCmd(POP, RAX);
-    asmCode.addCmd(TEST, RAX, RAX);
-    asmCode.addCmd(JNZ, start);
+    _cond->generateBranch(asmCode, start, true);
     asmCode.addLabel(end);
     asmCode.popLoopLabels();
 }
 
+PNode WhileNode::getCond() {
+    return _cond;
+}
+
+void WhileNode::setCond(PNode cond) {
+    _cond = cond;
+}
+
+PNode WhileNode::getBody() {
+    return _block;
+}
+
 ForNode::ForNode(SymbolPtr sym, PNode initial_exp, PNode final_exp, PNode body, bool isTo) :
     SynNode(SynNodeType::ForStmt),
     _initial(initial_exp), _final(final_exp), _body(body),
@@ -618,6 +793,34 @@ void ForNode::generate(AsmCode & asmCode) {
     asmCode.popLoopLabels();
 }
 
+SymbolPtr ForNode::getSymbol() {
+    return _symbol;
+}
+
+PNode ForNode::getInitial() {
+    return _initial;
+}
+
+PNode ForNode::getFinal() {
+    return _final;
+}
+
+void ForNode::setInitial(PNode initial) {
+    _initial = initial;
+}
+
+void ForNode::setFinal(PNode final) {
+    _final = final;
+}
+
+PNode ForNode::getBody() {
+    return _body;
+}
+
+bool ForNode::isTo() {
+    return _isTo;
+}
+
 RepeatNode::RepeatNode(PNode cond, PNode body) :
     SynNode(SynNodeType::RepeatStmt),
     _cond(cond), _body(body) {}
@@ -639,14 +842,23 @@ void RepeatNode::generate(AsmCode & asmCode) {
     asmCode.addLabel(body);
     _body->generate(asmCode);
     asmCode.addLabel(cond);
-    _cond->generate(asmCode);
-    asmCode.addCmd(POP, RAX);
-    asmCode.addCmd(TEST, RAX, RAX);
-    asmCode.addCmd(JZ, body);
+    _cond->generateBranch(asmCode, body, false);
     asmCode.addLabel(end);
     asmCode.popLoopLabels();
 }
 
+PNode RepeatNode::getCond() {
+    return _cond;
+}
+
+void RepeatNode::setCond(PNode cond) {
+    _cond = cond;
+}
+
+PNode RepeatNode::getBody() {
+    return _body;
+}
+
 BlockNode::BlockNode(std::string& name) :
     SynNode(SynNodeType::Block),
     _name(name) {}
@@ -671,7 +883,7 @@ std::string BlockNode::toString(std::string indent, bool last) {
     return str;
 }
 
-void BlockNode::addStatement(PNode& statement) {
+void BlockNode::addStatement(PNode statement) {
     _statements.push_back(statement);
 }
 
@@ -680,6 +892,10 @@ void BlockNode::generate(AsmCode & asmCode) {
         stmt->generate(asmCode);
 }
 
+const std::vector<PNode>& BlockNode::getStatements() {
+    return _statements;
+}
+
 EmptyNode::EmptyNode() :
     SynNode(SynNodeType::Empty) {}
 
@@ -727,8 +943,16 @@ SymbolPtr CallNode::getSymbol() {
     return _symbol;
 }
 
-SymbolType CallNode::getType() {
-    return std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol("result")->getVarType();
+const std::vector<PNode>& CallNode::getArgs() {
+    return _args;
+}
+
+void CallNode::setArg(size_t index, PNode arg) {
+    _args[index] = arg;
+}
+
+SymbolType CallNode::computeType() {
+    return std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol(resultSymbolId())->getVarType();
 }
 
 std::string CallNode::toString(std::string indent, bool last) {
@@ -746,14 +970,14 @@ std::string CallNode::toString(std::string indent, bool last) {
 }
 
 int CallNode::getSize() {
-    return std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol("result")->getSize();
+    return std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol(resultSymbolId())->getSize();
 }
 
 void CallNode::generate(AsmCode & asmCode) {
     int size = 0;
     SymTablePtr table = std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs();
     if (_symbol->getType() == SymbolType::Func) {
-        size = table->getSymbol("result")->getSize();
+        size = table->getSymbol(resultSymbolId())->getSize();
         asmCode.addCmd(SUB, RSP, size);
     }
     for (int i = 0; i < _args.size(); ++i) {
@@ -769,7 +993,7 @@ void CallNode::generate(AsmCode & asmCode) {
 void CallNode::generateLValue(AsmCode & asmCode) {
     generate(asmCode);
     asmCode.addCmd(MOV, RAX, RSP);
-    asmCode.addCmd(ADD, RAX, std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol("result")->getSize() - 8);
+    asmCode.addCmd(ADD, RAX, std::dynamic_pointer_cast<SymProcBase>(_symbol)->getArgs()->getSymbol(resultSymbolId())->getSize() - 8);
     asmCode.addCmd(PUSH, RAX);
 }
 
@@ -787,7 +1011,7 @@ void WriteNode::generate(AsmCode & asmCode) {
                 asmCode.addWriteFloat();
                 break;
             case SymbolType::TypeString:
-                asmCode.addWriteString(std::dynamic_pointer_cast<StringConstNode>(arg)->getValue());
+                asmCode.addWriteString(dynamic_cast<StringConstNode*>(arg)->getValue());
                 break;
         }
     }
@@ -806,7 +1030,7 @@ std::string StringConstNode::toString(std::string indent, bool last) {
     return str;
 }
 
-SymbolType StringConstNode::getType() {
+SymbolType StringConstNode::computeType() {
     return SymbolType::TypeString;
 }
 
@@ -40,21 +40,28 @@ enum class SynNodeType {
 class SynNode {
 public:
     SynNode(SynNodeType type);
+    virtual ~SynNode() {}
     virtual std::string toString(std::string, bool last) = 0;
     SynNodeType getNodeType();
-    virtual SymbolType getType();
+    SymbolType getType();
     virtual void generate(AsmCode& asmCode) {} //make abstract
     virtual void generateLValue(AsmCode& asmCode) {} //make abstract
+    virtual void generateBranch(AsmCode& asmCode, const std::string& label, bool isJumpIfTrue);
     virtual int getSize();
     virtual bool isLocal() { return false; }
     bool operator == (SynNodeType type);
     bool operator != (SynNodeType type);
 protected:
+    virtual SymbolType computeType();
     SynNodeType _type;
     std::string makeIndent(std::string, bool);
     void updateIndentAndStr(std::string&, std::string&, bool);
+private:
+    SymbolType _exprType = SymbolType::None;
+    bool _isTypeKnown = false;
 };
-typedef std::shared_ptr<SynNode> PNode;
+// Nodes are owned by the parser's NodeArena; tree links are non-owning.
+typedef SynNode* PNode;
 
 class OpNode : public SynNode {
 public:
@@ -70,7 +77,8 @@ public:
     UnaryNode(TokenPtr, PNode);
     std::string toString(std::string, bool);
     PNode getArg();
-    SymbolType getType() override;
+    void setArg(PNode arg);
+    SymbolType computeType() override;
     virtual void generate(AsmCode& asmCode);
 private:
     PNode _arg;
@@ -78,7 +86,7 @@ private:
 
 class BinOpNode : public OpNode {
 public:
-    BinOpNode(TokenPtr, const PNode&, const PNode&);
+    BinOpNode(TokenPtr, PNode, PNode);
     std::string toString(std::string, bool last);
     void generate(AsmCode& asmCode);
     void generateInt(AsmCode& asmCode);
@@ -86,23 +94,32 @@ public:
     void generateIntRelation(AsmCode& asmCode);
     void generateRealRelation(AsmCode& asmCode);
     void generateBoolean(AsmCode& asmCode);
+    void generateBranch(AsmCode& asmCode, const std::string& label, bool isJumpIfTrue) override;
+    bool isArithmetic();
+    bool isShortCircuit();
+    void setShortCircuit(bool isShortCircuit);
     PNode getLeft();
     PNode getRight();
-    SymbolType getType() override;
+    void setLeft(PNode left);
+    void setRight(PNode right);
+    SymbolType computeType() override;
 protected:
+    AsmOpType getRelationJump(bool isReal);
+    void loadRealOperands(AsmCode& asmCode);
     PNode _left, _right;
+    bool _isShortCircuit = false;
 };
-typedef std::shared_ptr<BinOpNode> BinOpNodePtr;
+typedef BinOpNode* BinOpNodePtr;
 
 class IntConstNode : public SynNode {
 public:
-    IntConstNode(int);
+    IntConstNode(i64);
     std::string toString(std::string, bool);
     void generate(AsmCode& asmCode);
-    SymbolType getType() override;
-    int getValue();
+    SymbolType computeType() override;
+    i64 getValue();
 private:
-    int _value;
+    i64 _value;
 };
 
 class RealConstNode : public SynNode {
@@ -110,7 +127,7 @@ public:
     RealConstNode(double);
     std::string toString(std::string, bool) override;
     void generate(AsmCode& asmCode) override;
-    SymbolType getType() override;
+    SymbolType computeType() override;
     double getValue();
 private:
     double _value;
@@ -120,7 +137,7 @@ class StringConstNode : public SynNode {
 public:
     StringConstNode(std::string value);
     std::string toString(std::string indent, bool last);
-    SymbolType getType() override;
+    SymbolType computeType() override;
     std::string getValue();
 private:
     std::string _value;
@@ -128,10 +145,12 @@ private:
 
 class IdentifierNode : public SynNode {
 public:
-    IdentifierNode(std::string name, SymbolPtr symbol);
+    IdentifierNode(int nameId, SymbolPtr symbol);
     std::string getName();
+    int getNameId();
+    int getSymbolId();
     std::string toString(std::string, bool);
-    SymbolType getType() override;
+    SymbolType computeType() override;
     SymbolPtr getSymbol();
     int getSize() override;
     void generate(AsmCode& asmCode) override;
@@ -139,18 +158,18 @@ public:
     bool isLocal() override;
 private:
     SymbolPtr _symbol;
-    std::string _name;
+    int _nameId;
 };
-typedef std::shared_ptr<IdentifierNode> IdentifierNodePtr;
+typedef IdentifierNode* IdentifierNodePtr;
 
 class RecordAccessNode : public SynNode {
 public:
-    RecordAccessNode(const PNode&, const PNode&, SymbolPtr symbol = nullptr);
+    RecordAccessNode(PNode, PNode, SymbolPtr symbol = nullptr);
     std::string toString(std::string, bool);
     SymbolPtr getSymbol();
     PNode getRight();
     int getSize() override;
-    SymbolType getType() override;
+    SymbolType computeType() override;
     void generate(AsmCode& asmCode) override;
     void generateLValue(AsmCode& asmCode) override;
     bool isLocal() override;
@@ -161,10 +180,10 @@ private:
 
 class ArrayIndexNode : public SynNode {
 public:
-    ArrayIndexNode(const PNode&, const std::vector<PNode>&, SymbolPtr symbol);
+    ArrayIndexNode(PNode, const std::vector<PNode>&, SymbolPtr symbol);
     std::string toString(std::string, bool);
     SymbolPtr getSymbol();
-    SymbolType getType() override;
+    SymbolType computeType() override;
     void generate(AsmCode& asmCode);
     void generateLValue(AsmCode& asmCode) override;
     bool isLocal() override;
@@ -180,6 +199,10 @@ public:
     IfNode(PNode cond, PNode then, PNode else_block);
     std::string toString(std::string, bool);
     void generate(AsmCode& asmCode);
+    PNode getCond();
+    void setCond(PNode cond);
+    PNode getThen();
+    PNode getElse();
 private:
     PNode _cond, _then, _else;
 };
@@ -189,6 +212,9 @@ public:
     WhileNode(PNode cond, PNode block);
     std::string toString(std::string, bool);
     void generate(AsmCode& asmCode);
+    PNode getCond();
+    void setCond(PNode cond);
+    PNode getBody();
 private:
     PNode _cond, _block;
 };
@@ -198,6 +224,13 @@ public:
     ForNode(SymbolPtr sym, PNode initial_exp, PNode final_exp, PNode body, bool isTo);
     std::string toString(std::string, bool);
     void generate(AsmCode& asmCode);
+    SymbolPtr getSymbol();
+    PNode getInitial();
+    PNode getFinal();
+    void setInitial(PNode initial);
+    void setFinal(PNode final);
+    PNode getBody();
+    bool isTo();
 private:
     PNode _initial, _final, _body;
     bool _isTo;
@@ -209,6 +242,9 @@ public:
     RepeatNode(PNode cond, PNode body);
     std::string toString(std::string, bool);
     void generate(AsmCode& asmCode);
+    PNode getCond();
+    void setCond(PNode cond);
+    PNode getBody();
 private:
     PNode _cond, _body;
 };
@@ -219,8 +255,9 @@ public:
     BlockNode(std::string&& name);
     BlockNode(std::vector<PNode>& statements, std::string& name);
     std::string toString(std::string, bool);
-    void addStatement(PNode& statement);
+    void addStatement(PNode statement);
     void generate(AsmCode& asmCode);
+    const std::vector<PNode>& getStatements();
 private:
     std::string _name;
     std::vector<PNode> _statements;
@@ -242,7 +279,9 @@ class CallNode : public SynNode {
 public:
     CallNode(PNode expr, std::vector<PNode> args, SymbolPtr symbol = SymbolPtr(nullptr));
     SymbolPtr getSymbol();
-    SymbolType getType() override;
+    const std::vector<PNode>& getArgs();
+    void setArg(size_t index, PNode arg);
+    SymbolType computeType() override;
     std::string toString(std::string, bool);
     int getSize() override;
     void generate(AsmCode& asmCode) override;
@@ -0,0 +1,72 @@
+#include "TestRunner.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include "Tests.h"
+
+struct GeneratorTest {
+    const GeneratorConfig* config;
+    const std::string* file;
+    bool isPassed;
+    std::string error;
+    double seconds;
+};
+
+static std::string readFile(const std::string& fname) {
+    std::ifstream fin(fname);
+    return std::string(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+}
+
+static void runTest(GeneratorTest& test) {
+    std::string path = generatorPath + *test.file;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        std::unique_ptr<Parser> parser = makeGeneratorParser(path + ".in", *test.config);
+        test.isPassed = parser->getAsmStr() == readFile(path + ".out");
+    }
+    catch (const BaseException& e) {
+        test.isPassed = false;
+        test.error = e.what();
+    }
+    catch (const std::exception& e) {
+        test.isPassed = false;
+        test.error = e.what();
+    }
+    catch (...) {
+        test.isPassed = false;
+        test.error = "Unexpected error.";
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    test.seconds = elapsed.count();
+}
+
+TestRunner::TestRunner(unsigned threads) : _pool(threads) {}
+
+// Returns whether every test passed.
+bool TestRunner::runGenerator(std::ostream& out) {
+    std::vector<GeneratorTest> tests;
+    for (auto& config : generatorConfigs)
+        for (auto& file : *config.files)
+            tests.push_back({ &config, &file, false, "", 0 });
+    out << "generator tests: " << tests.size() << " on " << _pool.getThreads() << " threads" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    _pool.run(tests.size(), [&](size_t i) { runTest(tests[i]); });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    size_t failed = 0;
+    double total = 0;
+    out << std::fixed << std::setprecision(1);
+    for (auto& test : tests) {
+        out << std::setw(8) << test.seconds * 1e3 << " ms  " << (test.isPassed ? "ok    " : "FAILED")
+            << "  " << test.config->name << "/" << *test.file << std::endl;
+        if (!test.error.empty())
+            out << "    " << test.error << std::endl;
+        failed += !test.isPassed;
+        total += test.seconds;
+    }
+    out << tests.size() << " tests, " << failed << " failed: " << elapsed.count() * 1e3 << " ms wall, "
+        << total * 1e3 << " ms in tests" << std::endl;
+    return failed == 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <ostream>
+#include "ThreadPool.h"
+
+// Runs the generator tests of every configuration the unit tests check (see
+// Tests.h) on a pool of threads and prints the wall time of each test and of
+// the whole run (see main.cpp). Every build writes its own files, and the
+// runtime keeps the output of programs run in memory apart per thread.
+class TestRunner {
+public:
+    TestRunner(unsigned threads = 0);
+    bool runGenerator(std::ostream& out);
+private:
+    ThreadPool _pool;
+};
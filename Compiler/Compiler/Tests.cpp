@@ -27,6 +27,7 @@ std::vector<std::string> scannerCheckFiles = {
     "021 Range",
     "022 Opeations with integers",
     "023 Operatins with reals",
+    "036 Keywords mixed case",
 };
 std::vector<std::string> scannerThrowFiles = {
     "024 Invalid integer1",
@@ -141,6 +142,7 @@ std::vector<std::string> parserCheckDeclFiles = {
     "083 Func With proc",
     "084 Func With func",
     "087 Proc With func",
+    "088 Const 64-bit integer expressions",
 };
 std::vector<std::string> parserCheckThrowDeclFiles = {
     "010 Const Missing colon",
@@ -182,6 +184,7 @@ std::vector<std::string> parserCheckThrowDeclFiles = {
     "076 Proc Missing identifier in args",
     "085 Func Missing semilocon before results type",
     "086 Func Missing types result",
+    "089 Const Division by zero",
 };
 std::vector<std::string> parserStatementCheckFiles = {
     "000 Empty Statement",
@@ -274,6 +277,16 @@ std::vector<std::string> generatorCheckFiles = {
     "042 Assign array records attr",
     "043 Assign record with array element",
     "044 Write func result record attr",
+    "045 Identifiers ignore case",
+    "046 Constant expressions",
+    "047 Large integer constants",
+    "048 Comparisons in conditions",
+    "050 Repeated literals",
+    "051 Instruction encodings",
+};
+
+std::vector<std::string> generatorShortCircuitFiles = {
+    "049 Short-circuit conditions",
 };
 
 TEST_P(ScannerCheckTest, Check) { check(GetParam()); }
@@ -282,6 +295,15 @@ INSTANTIATE_TEST_CASE_P(scannerCheck, ScannerCheckTest, VALUESIN(scannerCheckFil
 TEST_P(ScannerThrowTest, Throw) { check_throw(GetParam()); }
 INSTANTIATE_TEST_CASE_P(scannerThrow, ScannerThrowTest, VALUESIN(scannerThrowFiles));
 
+TEST_P(ScannerBufferTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(scannerBuffer, ScannerBufferTest, VALUESIN(scannerCheckFiles));
+
+TEST_P(ScannerParallelCheckTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(scannerParallelCheck, ScannerParallelCheckTest, VALUESIN(scannerCheckFiles));
+
+TEST_P(ScannerParallelThrowTest, Throw) { check_throw(GetParam()); }
+INSTANTIATE_TEST_CASE_P(scannerParallelThrow, ScannerParallelThrowTest, VALUESIN(scannerThrowFiles));
+
 TEST_P(ParserExpTest, Check) { check(GetParam()); }
 INSTANTIATE_TEST_CASE_P(ParserExp, ParserExpTest, VALUESIN(parserCheckExpFiles));
 
@@ -300,5 +322,108 @@ INSTANTIATE_TEST_CASE_P(ParseStatement,ParserStatementCheckTest, VALUESIN(parser
 TEST_P(ParserStatementCheckThrowTest, Throw)  { check_throw(GetParam()); }
 INSTANTIATE_TEST_CASE_P(ParseStatement, ParserStatementCheckThrowTest, VALUESIN(parserStatementCheckThrowFiles));
 
+const char generatorPath[] = "../Tests/generator_tests/";
+
+const std::vector<GeneratorConfig> generatorConfigs = {
+    { "Generate", &generatorCheckFiles, 0, [](Parser&) {} },
+    { "GenerateExecutable", &generatorCheckFiles, 0, [](Parser& parser) { parser.setRunner(ProgramRunner::Executable); } },
+    { "GenerateRegister", &generatorCheckFiles, 0, [](Parser& parser) { parser.setBackend(AsmBackend::Register); } },
+    { "GenerateIR", &generatorCheckFiles, 0, [](Parser& parser) { parser.setIRLowering(true); } },
+    { "GenerateShortCircuit", &generatorShortCircuitFiles, 0, [](Parser& parser) { parser.setShortCircuit(true); } },
+    { "GenerateShortCircuitIR", &generatorShortCircuitFiles, 0, [](Parser& parser) {
+        parser.setShortCircuit(true);
+        parser.setIRLowering(true);
+    } },
+    { "GenerateParallelLex", &generatorCheckFiles, 4, [](Parser&) {} },
+    { "GenerateNoPeephole", &generatorCheckFiles, 0, [](Parser& parser) { parser.getPeephole().setEnabled(false); } },
+    { "GenerateNoFolding", &generatorCheckFiles, 0, [](Parser& parser) { parser.setConstFolding(false); } },
+};
+
+// Programs run in memory unless the configuration picks another runner.
+std::unique_ptr<Parser> makeGeneratorParser(const std::string& fname, const GeneratorConfig& config) {
+    std::unique_ptr<Parser> parser(new Parser(fname.c_str(), true, config.lexThreads, 1));
+    parser->setRunner(ProgramRunner::Jit);
+    config.setUp(*parser);
+    return parser;
+}
+
 TEST_P(GeneratorCheckTest, Check) { check(GetParam()); }
-INSTANTIATE_TEST_CASE_P(Generate, GeneratorCheckTest, VALUESIN(generatorCheckFiles));
\ No newline at end of file
+INSTANTIATE_TEST_CASE_P(Generate, GeneratorCheckTest, VALUESIN(*generatorConfigs[0].files));
+
+TEST_P(GeneratorExecutableCheckTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(GenerateExecutable, GeneratorExecutableCheckTest, VALUESIN(*generatorConfigs[1].files));
+
+TEST_P(GeneratorRegisterCheckTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(GenerateRegister, GeneratorRegisterCheckTest, VALUESIN(*generatorConfigs[2].files));
+
+TEST_P(GeneratorIRCheckTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(GenerateIR, GeneratorIRCheckTest, VALUESIN(*generatorConfigs[3].files));
+
+TEST_P(GeneratorShortCircuitCheckTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(GenerateShortCircuit, GeneratorShortCircuitCheckTest, VALUESIN(*generatorConfigs[4].files));
+
+TEST_P(GeneratorShortCircuitIRCheckTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(GenerateShortCircuitIR, GeneratorShortCircuitIRCheckTest, VALUESIN(*generatorConfigs[5].files));
+
+TEST_P(GeneratorParallelLexCheckTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(GenerateParallelLex, GeneratorParallelLexCheckTest, VALUESIN(*generatorConfigs[6].files));
+
+TEST_P(GeneratorNoPeepholeCheckTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(GenerateNoPeephole, GeneratorNoPeepholeCheckTest, VALUESIN(*generatorConfigs[7].files));
+
+TEST_P(GeneratorNoFoldingCheckTest, Check) { check(GetParam()); }
+INSTANTIATE_TEST_CASE_P(GenerateNoFolding, GeneratorNoFoldingCheckTest, VALUESIN(*generatorConfigs[8].files));
+
+TEST_F(CompileCacheTest, CountsHitsAndMisses) {
+    std::string key = cache.getKey("begin end.", "");
+    std::string listing;
+    EXPECT_FALSE(cache.load(key, listing));
+    cache.store(key, "listing");
+    EXPECT_TRUE(cache.load(key, listing));
+    EXPECT_EQ(listing, "listing");
+    EXPECT_EQ(cache.getStatsString().find("cache: 1 hits, 1 misses, 1 stored, 0 evicted"), 0u);
+}
+
+TEST_F(CompileCacheTest, KeyDependsOnOptions) {
+    EXPECT_EQ(cache.getKey("begin end.", "a").size(), 16u);
+    EXPECT_EQ(cache.getKey("begin end.", "a"), cache.getKey("begin end.", "a"));
+    EXPECT_NE(cache.getKey("begin end.", "a"), cache.getKey("begin end.", "b"));
+    EXPECT_NE(cache.getKey("begin end.", "a"), cache.getKey("begin  end.", "a"));
+}
+
+TEST_F(CompileCacheTest, TrimEvictsOldestFirst) {
+    CompileCache limited(directory, 2500);
+    writeFile("old.asm", 1000, 300);
+    writeFile("middle.asm", 1000, 200);
+    writeFile("new.asm", 1000, 100);
+    limited.trim();
+    EXPECT_FALSE(isPresent("old.asm"));
+    EXPECT_TRUE(isPresent("middle.asm"));
+    EXPECT_TRUE(isPresent("new.asm"));
+    EXPECT_EQ(limited.getStatsString().find("cache: 0 hits, 0 misses, 0 stored, 1 evicted, 2 entries"), 0u);
+}
+
+TEST_F(CompileCacheTest, TrimRemovesStaleTemporaryFiles) {
+    CompileCache limited(directory, 1500);
+    writeFile("entry.asm", 1000, 100);
+    writeFile("entry.asm.1-0.tmp", 1000, 2 * 60 * 60);
+    writeFile("entry.asm.2-0.tmp", 1000, 0);
+    limited.trim();
+    EXPECT_FALSE(isPresent("entry.asm.1-0.tmp"));
+    EXPECT_TRUE(isPresent("entry.asm.2-0.tmp"));
+    // The temporary file being written takes the room of the entry.
+    EXPECT_FALSE(isPresent("entry.asm"));
+    std::remove((std::string(directory) + "/entry.asm.2-0.tmp").c_str());
+}
+
+TEST(ProfilerTest, NestedScopeUnderParent) {
+    Profiler profiler;
+    {
+        Profiler::Scope outer(&profiler, "outer");
+        for (int i = 0; i < 2; ++i)
+            Profiler::Scope inner(&profiler, "inner");
+    }
+    std::string json = profiler.getJson();
+    EXPECT_NE(json.find("{\"name\": \"outer\", \"path\": \"outer\", \"depth\": 0, \"calls\": 1,"), std::string::npos);
+    EXPECT_NE(json.find("{\"name\": \"inner\", \"path\": \"outer/inner\", \"depth\": 1, \"calls\": 2,"), std::string::npos);
+}
\ No newline at end of file
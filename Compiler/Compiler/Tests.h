@@ -7,7 +7,19 @@
 #include "Scanner.h"
 #include "Parser.h"
 #include "AsmGen.h"
+#include "CompileCache.h"
+#include "Profiler.h"
 //#include "Symbol.h"
+#ifdef _WIN32
+#include <direct.h>
+#include <sys/utime.h>
+#define rmdir _rmdir
+#define utime _utime
+#define utimbuf _utimbuf
+#else
+#include <unistd.h>
+#include <utime.h>
+#endif
 
 template<class T>
 class BaseTest : public ::testing::TestWithParam<std::string> {
@@ -15,14 +27,17 @@ protected:
     virtual std::string getPath() = 0;
     virtual std::string getData(T& obj) = 0;
     virtual void modifyObj(T& obj) {}
+    virtual std::unique_ptr<T> makeObj(const std::string& fname) {
+        return std::unique_ptr<T>(new T(fname.c_str()));
+    }
     void check(const std::string& fname) {
         std::ifstream test_stream(getPath() + fname + ".out");
         expected = std::string(std::istreambuf_iterator<char>(test_stream),
                                std::istreambuf_iterator<char>());
 
-        T obj((getPath() + fname + ".in").c_str());
-        modifyObj(obj);
-        testing = getData(obj);
+        std::unique_ptr<T> obj = makeObj(getPath() + fname + ".in");
+        modifyObj(*obj);
+        testing = getData(*obj);
         ASSERT_STREQ(testing.c_str(), expected.c_str());
     }
     void check_throw(const std::string& fname) {
@@ -47,6 +62,27 @@ class ScannerBaseTest : public BaseTest<Scanner> {
 class ScannerCheckTest : public ScannerBaseTest {};
 class ScannerThrowTest : public ScannerBaseTest {};
 
+class ScannerParallelBaseTest : public ScannerBaseTest {
+    void modifyObj(Scanner& obj) override { obj.lexParallel(4, 1); }
+};
+class ScannerParallelCheckTest : public ScannerParallelBaseTest {};
+class ScannerParallelThrowTest : public ScannerParallelBaseTest {};
+
+class ScannerBufferTest : public ::testing::TestWithParam<std::string> {
+protected:
+    void check(const std::string& fname) {
+        std::string path = "../Tests/scanner_tests/" + fname;
+        std::ifstream source_stream(path + ".in", std::ios::binary);
+        std::string source = std::string(std::istreambuf_iterator<char>(source_stream),
+                                         std::istreambuf_iterator<char>());
+        std::ifstream test_stream(path + ".out");
+        std::string expected = std::string(std::istreambuf_iterator<char>(test_stream),
+                                           std::istreambuf_iterator<char>());
+        Scanner obj(source.data(), source.size());
+        ASSERT_STREQ(obj.getTokensString().c_str(), expected.c_str());
+    }
+};
+
 class ParserExprBaseTest : public BaseTest<Parser> {
     std::string getPath() override { return "../Tests/parser_exp_tests/"; }
     std::string getData(Parser& obj) override { return obj.getNodeTreeStr(); }
@@ -69,9 +105,69 @@ class ParserStatementBaseTest : public BaseTest<Parser> {
 class ParserStatementCheckTest : public ParserStatementBaseTest {};
 class ParserStatementCheckThrowTest : public ParserStatementBaseTest {};
 
+extern std::vector<std::string> generatorCheckFiles;
+extern std::vector<std::string> generatorShortCircuitFiles;
+
+extern const char generatorPath[];
+
+// A way of compiling the generator tests: its name, the tests it runs, the
+// number of threads lexing each source up front in the smallest chunks (0 to
+// lex as the parser goes) and the settings it applies to the parser. The unit
+// tests below and TestRunner run the same configurations from
+// generatorConfigs.
+struct GeneratorConfig {
+    const char* name;
+    const std::vector<std::string>* files;
+    unsigned lexThreads;
+    void (*setUp)(Parser& parser);
+};
+
+extern const std::vector<GeneratorConfig> generatorConfigs;
+
+std::unique_ptr<Parser> makeGeneratorParser(const std::string& fname, const GeneratorConfig& config);
+
+template<size_t Config>
 class GeneratorBaseTest : public BaseTest<Parser> {
-    std::string getPath() override { return "../Tests/generator_tests/"; }
+    std::string getPath() override { return generatorPath; }
     std::string getData(Parser& obj) override { return obj.getAsmStr(); }
+    std::unique_ptr<Parser> makeObj(const std::string& fname) override {
+        return makeGeneratorParser(fname, generatorConfigs[Config]);
+    }
 };
 
-class GeneratorCheckTest : public GeneratorBaseTest {};
\ No newline at end of file
+// In the order of generatorConfigs.
+typedef GeneratorBaseTest<0> GeneratorCheckTest;
+typedef GeneratorBaseTest<1> GeneratorExecutableCheckTest;
+typedef GeneratorBaseTest<2> GeneratorRegisterCheckTest;
+typedef GeneratorBaseTest<3> GeneratorIRCheckTest;
+typedef GeneratorBaseTest<4> GeneratorShortCircuitCheckTest;
+typedef GeneratorBaseTest<5> GeneratorShortCircuitIRCheckTest;
+typedef GeneratorBaseTest<6> GeneratorParallelLexCheckTest;
+typedef GeneratorBaseTest<7> GeneratorNoPeepholeCheckTest;
+typedef GeneratorBaseTest<8> GeneratorNoFoldingCheckTest;
+
+// Each test starts with an empty cache directory, which is removed after it.
+class CompileCacheTest : public ::testing::Test {
+protected:
+    CompileCacheTest() : cache(directory, 1 << 20) {}
+    void TearDown() override {
+        CompileCache(directory, 0).trim();
+        rmdir(directory);
+    }
+    // Writes a file of size bytes into the directory, last modified seconds ago.
+    void writeFile(const std::string& name, size_t size, time_t age) {
+        std::string path = std::string(directory) + "/" + name;
+        std::ofstream(path, std::ios::binary) << std::string(size, 'x');
+        setAge(path, age);
+    }
+    void setAge(const std::string& path, time_t age) {
+        utimbuf times;
+        times.actime = times.modtime = time(nullptr) - age;
+        utime(path.c_str(), &times);
+    }
+    bool isPresent(const std::string& name) {
+        return std::ifstream(std::string(directory) + "/" + name).good();
+    }
+    const char* directory = "cache_tests";
+    CompileCache cache;
+};
\ No newline at end of file
@@ -0,0 +1,324 @@
+#include "TextScan.h"
+
+#include <atomic>
+
+// 32-bit x86 gets the vector paths only when it is built for SSE2.
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__)) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTSCAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TEXTSCAN_AVX2_TARGET
+#else
+#define TEXTSCAN_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+static bool isSpaceChar(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool isDigitChar(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool isIdentifierChar(char c) {
+    char lower = c | 0x20;
+    return (lower >= 'a' && lower <= 'z') || isDigitChar(c) || c == '_';
+}
+
+static const char* skipSpacesScalar(const char* first, const char* last) {
+    while (first != last && isSpaceChar(*first))
+        ++first;
+    return first;
+}
+
+static const char* skipIdentifierScalar(const char* first, const char* last) {
+    while (first != last && isIdentifierChar(*first))
+        ++first;
+    return first;
+}
+
+static const char* skipDigitsScalar(const char* first, const char* last) {
+    while (first != last && isDigitChar(*first))
+        ++first;
+    return first;
+}
+
+static const char* findCharScalar(const char* first, const char* last, char c) {
+    while (first != last && *first != c)
+        ++first;
+    return first;
+}
+
+static size_t countNewLinesScalar(const char* first, const char* last, const char** lastNewLine) {
+    size_t count = 0;
+    for (; first != last; ++first)
+        if (*first == '\n') {
+            ++count;
+            *lastNewLine = first;
+        }
+    return count;
+}
+
+#ifdef TEXTSCAN_X86
+
+// Most identifiers and gaps between tokens are short, so runs are first
+// checked byte by byte for this many bytes before switching to vectors.
+static const int shortRun = 8;
+
+static unsigned lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static unsigned highestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse(&idx, mask);
+    return idx;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+static unsigned bitCount(unsigned mask) {
+    mask = mask - ((mask >> 1) & 0x55555555);
+    mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+    return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+// Masks of bytes that continue a run; the first zero bit ends it.
+static unsigned spaceMask16(__m128i v) {
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+static unsigned digitMask16(__m128i v) {
+    __m128i m = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+static unsigned identifierMask16(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(letter, underscore)) | digitMask16(v);
+}
+
+template<unsigned (*mask16)(__m128i), bool (*isRunChar)(char)>
+static const char* skipRunSSE2(const char* first, const char* last) {
+    const char* prefixEnd = last - first > shortRun ? first + shortRun : last;
+    while (first != prefixEnd && isRunChar(*first))
+        ++first;
+    if (first != prefixEnd || first == last)
+        return first;
+    for (; last - first >= 16; first += 16) {
+        unsigned stop = ~mask16(_mm_loadu_si128((const __m128i*)first)) & 0xFFFF;
+        if (stop != 0)
+            return first + lowestBit(stop);
+    }
+    while (first != last && isRunChar(*first))
+        ++first;
+    return first;
+}
+
+static const char* findCharSSE2(const char* first, const char* last, char c) {
+    __m128i needle = _mm_set1_epi8(c);
+    for (; last - first >= 16; first += 16) {
+        unsigned found = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)first), needle));
+        if (found != 0)
+            return first + lowestBit(found);
+    }
+    return findCharScalar(first, last, c);
+}
+
+static size_t countNewLinesSSE2(const char* first, const char* last, const char** lastNewLine) {
+    __m128i newLine = _mm_set1_epi8('\n');
+    size_t count = 0;
+    for (; last - first >= 16; first += 16) {
+        unsigned found = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)first), newLine));
+        if (found != 0) {
+            count += bitCount(found);
+            *lastNewLine = first + highestBit(found);
+        }
+    }
+    return count + countNewLinesScalar(first, last, lastNewLine);
+}
+
+TEXTSCAN_AVX2_TARGET static unsigned spaceMask32(__m256i v) {
+    __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+TEXTSCAN_AVX2_TARGET static unsigned digitMask32(__m256i v) {
+    __m256i m = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+TEXTSCAN_AVX2_TARGET static unsigned identifierMask32(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return (unsigned)_mm256_movemask_epi8(_mm256_or_si256(letter, underscore)) | digitMask32(v);
+}
+
+template<unsigned (*mask32)(__m256i), bool (*isRunChar)(char)>
+TEXTSCAN_AVX2_TARGET static const char* skipRunAVX2(const char* first, const char* last) {
+    const char* prefixEnd = last - first > shortRun ? first + shortRun : last;
+    while (first != prefixEnd && isRunChar(*first))
+        ++first;
+    if (first != prefixEnd || first == last)
+        return first;
+    for (; last - first >= 32; first += 32) {
+        unsigned stop = ~mask32(_mm256_loadu_si256((const __m256i*)first));
+        if (stop != 0)
+            return first + lowestBit(stop);
+    }
+    while (first != last && isRunChar(*first))
+        ++first;
+    return first;
+}
+
+TEXTSCAN_AVX2_TARGET static const char* findCharAVX2(const char* first, const char* last, char c) {
+    __m256i needle = _mm256_set1_epi8(c);
+    for (; last - first >= 32; first += 32) {
+        unsigned found = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)first), needle));
+        if (found != 0)
+            return first + lowestBit(found);
+    }
+    return findCharSSE2(first, last, c);
+}
+
+TEXTSCAN_AVX2_TARGET static size_t countNewLinesAVX2(const char* first, const char* last, const char** lastNewLine) {
+    __m256i newLine = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    for (; last - first >= 32; first += 32) {
+        unsigned found = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)first), newLine));
+        if (found != 0) {
+            count += bitCount(found);
+            *lastNewLine = first + highestBit(found);
+        }
+    }
+    return count + countNewLinesSSE2(first, last, lastNewLine);
+}
+
+static bool haveAVX2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osSaves = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSaves && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif
+
+struct TextScanImpl {
+    const char* (*skipSpaces)(const char*, const char*);
+    const char* (*skipIdentifier)(const char*, const char*);
+    const char* (*skipDigits)(const char*, const char*);
+    const char* (*findChar)(const char*, const char*, char);
+    size_t (*countNewLines)(const char*, const char*, const char**);
+};
+
+static const TextScanImpl scalarImpl = {
+    skipSpacesScalar, skipIdentifierScalar, skipDigitsScalar, findCharScalar, countNewLinesScalar
+};
+
+#ifdef TEXTSCAN_X86
+static const TextScanImpl sse2Impl = {
+    skipRunSSE2<spaceMask16, isSpaceChar>, skipRunSSE2<identifierMask16, isIdentifierChar>,
+    skipRunSSE2<digitMask16, isDigitChar>, findCharSSE2, countNewLinesSSE2
+};
+
+static const TextScanImpl avx2Impl = {
+    skipRunAVX2<spaceMask32, isSpaceChar>, skipRunAVX2<identifierMask32, isIdentifierChar>,
+    skipRunAVX2<digitMask32, isDigitChar>, findCharAVX2, countNewLinesAVX2
+};
+#endif
+
+// Atomic so that a benchmark may switch levels while scanner threads run.
+static std::atomic<TextScan::Level> activeLevel(TextScan::Scalar);
+static std::atomic<const TextScanImpl*> impl(&scalarImpl);
+
+// Selects the best implementation before main() runs.
+static struct TextScanInit {
+    TextScanInit() { TextScan::setLevel(TextScan::getBestLevel()); }
+} textScanInit;
+
+const char* TextScan::skipSpaces(const char* first, const char* last) {
+    return impl.load(std::memory_order_relaxed)->skipSpaces(first, last);
+}
+
+const char* TextScan::skipIdentifier(const char* first, const char* last) {
+    return impl.load(std::memory_order_relaxed)->skipIdentifier(first, last);
+}
+
+const char* TextScan::skipDigits(const char* first, const char* last) {
+    return impl.load(std::memory_order_relaxed)->skipDigits(first, last);
+}
+
+const char* TextScan::findChar(const char* first, const char* last, char c) {
+    return impl.load(std::memory_order_relaxed)->findChar(first, last, c);
+}
+
+size_t TextScan::countNewLines(const char* first, const char* last, const char** lastNewLine) {
+    return impl.load(std::memory_order_relaxed)->countNewLines(first, last, lastNewLine);
+}
+
+TextScan::Level TextScan::getLevel() {
+    return activeLevel.load(std::memory_order_relaxed);
+}
+
+TextScan::Level TextScan::getBestLevel() {
+#ifdef TEXTSCAN_X86
+    static const Level best = haveAVX2() ? AVX2 : SSE2;
+    return best;
+#else
+    return Scalar;
+#endif
+}
+
+void TextScan::setLevel(Level level) {
+    if (level > getBestLevel())
+        level = getBestLevel();
+    const TextScanImpl* chosen;
+    switch (level) {
+#ifdef TEXTSCAN_X86
+        case AVX2:
+            chosen = &avx2Impl;
+            break;
+        case SSE2:
+            chosen = &sse2Impl;
+            break;
+#endif
+        default:
+            chosen = &scalarImpl;
+    }
+    impl.store(chosen, std::memory_order_relaxed);
+    activeLevel.store(level, std::memory_order_relaxed);
+}
+
+const char* TextScan::getLevelName(Level level) {
+    switch (level) {
+        case AVX2: return "avx2";
+        case SSE2: return "sse2";
+        default:   return "scalar";
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+// Byte-run primitives used by the scanner's fast paths. Each function looks at
+// [first, last) and returns the first position that stops the run (or last).
+// The implementation is picked at startup from the best instruction set the
+// CPU supports (AVX2, SSE2, or plain scalar code) and can be overridden, e.g.
+// to compare implementations in a benchmark.
+class TextScan {
+public:
+    enum Level {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+    static const char* skipSpaces(const char* first, const char* last);
+    static const char* skipIdentifier(const char* first, const char* last);
+    static const char* skipDigits(const char* first, const char* last);
+    static const char* findChar(const char* first, const char* last, char c);
+    // Number of '\n' in [first, last); lastNewLine gets the position of the
+    // last one found (untouched when there are none).
+    static size_t countNewLines(const char* first, const char* last, const char** lastNewLine);
+    static Level getLevel();
+    static Level getBestLevel();
+    static void setLevel(Level level);
+    static const char* getLevelName(Level level);
+};
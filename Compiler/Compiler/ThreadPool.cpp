@@ -0,0 +1,44 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// No threads means one per hardware thread.
+ThreadPool::ThreadPool(unsigned threads) : _threads(threads) {
+    if (_threads == 0)
+        _threads = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+unsigned ThreadPool::getThreads() const {
+    return _threads;
+}
+
+void ThreadPool::run(size_t jobs, const std::function<void(size_t)>& job) {
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto work = [&]() {
+        for (size_t i = next++; i < jobs; i = next++) {
+            try {
+                job(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min<size_t>(_threads, jobs); ++i)
+        workers.emplace_back(work);
+    work();
+    for (auto& worker : workers)
+        worker.join();
+    if (error)
+        std::rethrow_exception(error);
+}
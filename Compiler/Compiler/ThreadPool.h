@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Runs jobs numbered from zero on a fixed number of threads; each thread takes
+// the next job as soon as it is done with the previous one, and the calling
+// thread is one of them. The first exception a job throws is rethrown once all
+// the threads are done.
+class ThreadPool {
+public:
+    ThreadPool(unsigned threads = 0);
+    unsigned getThreads() const;
+    void run(size_t jobs, const std::function<void(size_t)>& job);
+private:
+    unsigned _threads;
+};
@@ -1,10 +1,26 @@
 #include "Token.h"
 
-Token::Token(int line, int col, TokenType type, std::string text) :
+Token::Token() :
+    _type(TokenType::EndOfFile),
+    _kind(TokenType::EndOfFile),
+    _line(0),
+    _col(0),
+    _text(""),
+    _length(0),
+    _nameId(-1),
+    _symbolId(-1),
+    _intValue(0) {}
+
+Token::Token(int line, int col, TokenType type, TokenType kind, const char* text, size_t length) :
     _type(type),
+    _kind(kind),
     _line(line),
     _col(col),
-    _text(text) {}
+    _text(text),
+    _length(length),
+    _nameId(-1),
+    _symbolId(-1),
+    _intValue(0) {}
 
 int Token::getLine() const {
     return _line;
@@ -15,92 +31,104 @@ int Token::getCol() const {
 }
 
 std::string Token::getText() const {
+    return std::string(_text, _length);
+}
+
+const char* Token::getTextBegin() const {
     return _text;
 }
 
+size_t Token::getTextLength() const {
+    return _length;
+}
+
 TokenType Token::getType() const {
     return _type;
 }
 
-std::string Token::getValue() const {
-    return _text;
+TokenType Token::getKind() const {
+    return _kind;
 }
 
-bool Token::operator==(TokenType type) {
-    return type == _type;
+std::string Token::getValue() const {
+    switch (_kind) {
+        case TokenType::IntegerNumber:
+            return std::to_string(_intValue);
+        case TokenType::RealNumber:
+            return std::to_string(_realValue);
+        case TokenType::String:
+            return *_stringValue;
+        default:
+            return getText();
+    }
 }
 
-Operation::Operation(int line, int col, TokenType type, std::string text) :
-    Token(line, col, type, text) {}
-
-std::string Operation::getTypeString() const {
-    return "Operation";
+std::string Token::getTypeString() const {
+    switch (_kind) {
+        case TokenType::Identifier:    return "Identifier";
+        case TokenType::Word:          return "Word";
+        case TokenType::IntegerNumber: return "Integer number";
+        case TokenType::RealNumber:    return "Real number";
+        case TokenType::String:        return "String";
+        case TokenType::Operation:     return "Operation";
+        case TokenType::Delimiter:     return "Delimiter";
+        default:                       return "End of file";
+    }
 }
 
-EndOfFile::EndOfFile(int line, int col) :
-    Token(line, col, TokenType::EndOfFile, "End of file") {}
-
-std::string EndOfFile::getTypeString() const {
-    return "End of file";
+long long Token::getIntValue() const {
+    return _intValue;
 }
 
-Word::Word(int line, int col, TokenType type, std::string text) :
-    Token(line, col, type, text) {}
-
-std::string Word::getTypeString() const {
-    return "Word";
+double Token::getRealValue() const {
+    return _realValue;
 }
 
-Delimiter::Delimiter(int line, int col, TokenType type, std::string text) :
-    Token(line, col, type, text) {}
+const std::string& Token::getStringValue() const {
+    return *_stringValue;
+}
 
-std::string Delimiter::getTypeString() const {
-    return "Delimiter";
+int Token::getNameId() const {
+    return _nameId;
 }
 
-Identifier::Identifier(int line, int col, std::string text) :
-    Token(line, col, TokenType::Identifier, text) {}
+int Token::getSymbolId() const {
+    return _symbolId;
+}
 
-std::string Identifier::getTypeString() const {
-    return "Identifier";
+void Token::setIntValue(long long value) {
+    _intValue = value;
 }
 
-IntegerNumber::IntegerNumber(int line, int col, std::string text) :
-    Token(line, col, TokenType::IntegerNumber, text),
-    _value(std::stoi(text)) {}
+void Token::setRealValue(double value) {
+    _realValue = value;
+}
 
-IntegerNumber::IntegerNumber(int line, int col, std::string text, int value) :
-    Token(line, col, TokenType::IntegerNumber, text),
-    _value(value) {}
+void Token::setStringValue(const std::string* value) {
+    _stringValue = value;
+}
 
-std::string IntegerNumber::getTypeString() const {
-    return "Integer number";
+void Token::setName(int nameId, int symbolId) {
+    _nameId = nameId;
+    _symbolId = symbolId;
 }
 
-std::string IntegerNumber::getValue() const {
-    return std::to_string(_value);
+bool Token::operator==(TokenType type) const {
+    return type == _type;
 }
 
-RealNumber::RealNumber(int line, int col, std::string text) :
-    Token(line, col, TokenType::RealNumber, text),
-    _value(std::stod(text)) {}
+TokenPtr::TokenPtr() : _arena(nullptr), _index(0) {}
 
-std::string RealNumber::getTypeString() const {
-    return "Real number";
-}
+TokenPtr::TokenPtr(const std::vector<Token>* arena, size_t index) : _arena(arena), _index(index) {}
 
-std::string RealNumber::getValue() const {
-    return std::to_string(_value);
+const Token* TokenPtr::operator->() const {
+    return &(*_arena)[_index];
 }
 
-String::String(int line, int col, std::string text, std::string value) :
-    Token(line, col, TokenType::String, text),
-    _value(value) {}
-
-std::string String::getTypeString() const {
-    return "String";
+const Token& TokenPtr::operator*() const {
+    return (*_arena)[_index];
 }
 
-std::string String::getValue() const {
-    return _value;
+size_t TokenPtr::getIndex() const {
+    return _index;
 }
@@ -1,7 +1,7 @@
 #pragma once
 
-#include <memory>
 #include <string>
+#include <vector>
 
 enum class TokenType {
     And,
@@ -83,80 +83,57 @@ enum class TokenType {
     Writeln
 };
 
+// Compact token stored by value in the scanner's token arena. The text is a
+// span of the scanner's source buffer, numeric values are decoded once while
+// scanning and identifiers carry their interned ids (see NameTable), so copying
+// a token never allocates.
 class Token {
 public:
-    Token(int, int, TokenType, std::string);
-    ~Token() {}
+    Token();
+    Token(int line, int col, TokenType type, TokenType kind, const char* text, size_t length);
     int getLine() const;
     int getCol() const;
     std::string getText() const;
+    const char* getTextBegin() const;
+    size_t getTextLength() const;
     TokenType getType() const;
-    virtual std::string getValue() const;
-    virtual std::string getTypeString() const = 0;
-    bool operator==(TokenType);
-private:
-    std::string _token_name;
-    int _line, _col;
-    TokenType _type;
-    std::string _text;
-};
-
-typedef std::shared_ptr<Token> TokenPtr;
-
-class Identifier : public Token {
-public:
-    Identifier(int, int, std::string);
-    std::string getTypeString() const;
-};
-
-class Word : public Token {
-public:
-    Word(int, int, TokenType, std::string);
-    std::string getTypeString() const;
-};
-
-class IntegerNumber : public Token {
-public:
-    IntegerNumber(int, int, std::string);
-    IntegerNumber(int, int, std::string, int value);
-    std::string getTypeString() const;
+    TokenType getKind() const;
     std::string getValue() const;
-private:
-    int _value;
-};
-
-class RealNumber : public Token {
-public:
-    RealNumber(int, int, std::string);
     std::string getTypeString() const;
-    std::string getValue() const;
+    long long getIntValue() const;
+    double getRealValue() const;
+    const std::string& getStringValue() const;
+    int getNameId() const;
+    int getSymbolId() const;
+    void setIntValue(long long value);
+    void setRealValue(double value);
+    void setStringValue(const std::string* value);
+    void setName(int nameId, int symbolId);
+    bool operator==(TokenType) const;
 private:
-    double _value;
+    TokenType _type;
+    TokenType _kind;
+    int _line, _col;
+    const char* _text;
+    size_t _length;
+    int _nameId, _symbolId;
+    union {
+        long long _intValue;
+        double _realValue;
+        const std::string* _stringValue;
+    };
 };
 
-class String : public Token {
+// Lightweight handle to a token in a token arena. Handles stay valid while the
+// arena grows and must not outlive the scanner that owns it.
+class TokenPtr {
 public:
-    String(int, int, std::string, std::string);
-    std::string getTypeString() const;
-    std::string getValue() const;
+    TokenPtr();
+    TokenPtr(const std::vector<Token>* arena, size_t index);
+    const Token* operator->() const;
+    const Token& operator*() const;
+    size_t getIndex() const;
 private:
-    std::string _value;
-};
-
-class Operation : public Token {
-public:
-    Operation(int, int, TokenType, std::string);
-    std::string getTypeString() const;
+    const std::vector<Token>* _arena;
+    size_t _index;
 };
-
-class Delimiter : public Token {
-public:
-    Delimiter(int, int, TokenType, std::string);
-    std::string getTypeString() const;
-};
-
-class EndOfFile : public Token {
-public:
-    EndOfFile(int, int);
-    std::string getTypeString() const;
-};
\ No newline at end of file
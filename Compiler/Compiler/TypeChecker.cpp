@@ -1,8 +1,8 @@
 #include "TypeChecker.h"
 
-TypeChecker::TypeChecker(SymTableStackPtr tableStack) : _tableStack(tableStack) {}
+TypeChecker::TypeChecker(SymTableStackPtr tableStack) : _tableStack(tableStack), _profiler(nullptr) {}
 
-std::unordered_map <SymbolType, std::unordered_map<TokenType, SymbolType> > opTypeResults = {
+static const std::unordered_map<SymbolType, std::unordered_map<TokenType, SymbolType> > opTypeResults = {
     { SymbolType::TypeInteger,
         {
             { TokenType::Add,          SymbolType::TypeInteger },
@@ -48,31 +48,32 @@ std::unordered_map <SymbolType, std::unordered_map<TokenType, SymbolType> > opTy
     }
 };
 
-std::unordered_map<SymbolType, std::set<SymbolType>> typeCasts = {
+static const std::unordered_map<SymbolType, std::set<SymbolType>> typeCasts = {
     { SymbolType::TypeInteger, { SymbolType::TypeInteger, SymbolType::TypeReal, SymbolType::TypeBoolean } },
     { SymbolType::TypeReal, { SymbolType::TypeReal } },
     { SymbolType::TypeBoolean,{ SymbolType::TypeBoolean } },
 };
 
 SymbolType TypeChecker::getExprType(PNode exp) {
+    Profiler::Scope scope(_profiler, "typecheck");
     switch (exp->getNodeType()) {
         case SynNodeType::BinaryOp:
         {
-            TokenType op = std::dynamic_pointer_cast<BinOpNode>(exp)->getOpType();
-            SymbolType left = getExprType(std::dynamic_pointer_cast<BinOpNode>(exp)->getLeft());
-            SymbolType right = getExprType(std::dynamic_pointer_cast<BinOpNode>(exp)->getRight());
+            TokenType op = dynamic_cast<BinOpNode*>(exp)->getOpType();
+            SymbolType left = getExprType(dynamic_cast<BinOpNode*>(exp)->getLeft());
+            SymbolType right = getExprType(dynamic_cast<BinOpNode*>(exp)->getRight());
             return calcTypeResult(tryCast(left, right), op);
         }
         case SynNodeType::ArrayIndex:
         {
             PNode expr = exp;
-            SymbolPtr arr = std::dynamic_pointer_cast<SymVar>(std::dynamic_pointer_cast<ArrayIndexNode>(expr)->getSymbol())->getVarTypeSymbol();
+            SymbolPtr arr = std::dynamic_pointer_cast<SymVar>(dynamic_cast<ArrayIndexNode*>(expr)->getSymbol())->getVarTypeSymbol();
             SymbolType type = std::dynamic_pointer_cast<SymTypeArray>(arr)->getArrType();
             return type;
         }
         case SynNodeType::Identifier:
         {
-            IdentifierNodePtr tmpPtr = std::dynamic_pointer_cast<IdentifierNode>(exp);
+            IdentifierNodePtr tmpPtr = dynamic_cast<IdentifierNode*>(exp);
             SymbolType type = tmpPtr->getSymbol()->getVarType();
             if (type == SymbolType::TypeAlias)
                 type = std::dynamic_pointer_cast<SymTypeAlias>(tmpPtr->getSymbol())->getRefType();
@@ -80,7 +81,7 @@ SymbolType TypeChecker::getExprType(PNode exp) {
         }
         case SynNodeType::Call:
         {
-            SymbolPtr sym = std::dynamic_pointer_cast<CallNode>(exp)->getSymbol();
+            SymbolPtr sym = dynamic_cast<CallNode*>(exp)->getSymbol();
             if (sym->getType() == SymbolType::Proc)
                 throw "smth";
             if (sym->getType() == SymbolType::Func)
@@ -88,11 +89,11 @@ SymbolType TypeChecker::getExprType(PNode exp) {
         }
         case SynNodeType::RecordAccess:
             while (exp->getNodeType() == SynNodeType::RecordAccess)
-                exp = std::dynamic_pointer_cast<RecordAccessNode>(exp)->getRight();
+                exp = dynamic_cast<RecordAccessNode*>(exp)->getRight();
             if (exp->getNodeType() == SynNodeType::Identifier)
                 return getExprType(exp);
         case SynNodeType::UnaryOp:
-            return getExprType(std::dynamic_pointer_cast<UnaryNode>(exp)->getArg());
+            return getExprType(dynamic_cast<UnaryNode*>(exp)->getArg());
     }
     return getExprType(exp->getNodeType());
 }
@@ -105,6 +106,7 @@ SymbolType TypeChecker::getExprType(SynNodeType type) {
 }
 
 bool TypeChecker::checkExprType(SymbolType type, PNode expr) {
+    Profiler::Scope scope(_profiler, "typecheck");
     SymbolType exprType = getExprType(expr);
     if (type == exprType)
         return true;
@@ -129,12 +131,21 @@ void TypeChecker::setTableStack(SymTableStackPtr tableStack) {
     _tableStack = tableStack;
 }
 
+void TypeChecker::setProfiler(Profiler* profiler) {
+    _profiler = profiler;
+}
+
+// The tables are only read, so that parsers on several threads can share
+// them; a type missing from a table has no casts or operations.
 bool TypeChecker::canCast(SymbolType from, SymbolType to) {
-    return typeCasts[from].find(to) != typeCasts[from].end();
+    auto casts = typeCasts.find(from);
+    return casts != typeCasts.end() && casts->second.count(to);
 }
 
 SymbolType TypeChecker::calcTypeResult(SymbolType type, TokenType tokType) {
-    if (opTypeResults[type].find(tokType) != opTypeResults[type].end())
-        return opTypeResults[type][tokType];
-    return SymbolType::TypeBadType;
+    auto results = opTypeResults.find(type);
+    if (results == opTypeResults.end())
+        return SymbolType::TypeBadType;
+    auto result = results->second.find(tokType);
+    return result != results->second.end() ? result->second : SymbolType::TypeBadType;
 }
@@ -4,6 +4,7 @@
 #include <map>
 #include "Symbol.h"
 #include "SynNode.h"
+#include "Profiler.h"
 
 class TypeChecker {
 public:
@@ -14,6 +15,7 @@ public:
     bool equalTypes(SymbolType left, SymbolType right);
     static SymbolType tryCast(SymbolType left, SymbolType right);
     void setTableStack(SymTableStackPtr tableStack);
+    void setProfiler(Profiler* profiler);
 
     std::map<SymbolType, std::string> typeNames = {
         { SymbolType::TypeInteger, "integer" },
@@ -28,4 +30,5 @@ private:
     static bool canCast(SymbolType from, SymbolType to);
     SymbolType calcTypeResult(SymbolType type, TokenType tokType);
     SymTableStackPtr _tableStack;
+    Profiler* _profiler;
 };
\ No newline at end of file
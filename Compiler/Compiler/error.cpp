@@ -56,3 +56,23 @@ IllegalQualifier::IllegalQualifier(int line, int col) :
 
 ProcAssignment::ProcAssignment(int line, int col) :
     BaseException(line, col, "Invalid assignment, procedures return no value.") {}
+
+UnencodableCommand::UnencodableCommand(const std::string& command) {
+    _msg = "Cannot encode command \"" + command + "\".";
+}
+
+UndefinedLabel::UndefinedLabel(const std::string& name) {
+    _msg = "Label " + name + " is not defined.";
+}
+
+UnwritableFile::UnwritableFile(const std::string& fname) {
+    _msg = "File " + fname + " cannot be written.";
+}
+
+UnexecutableCode::UnexecutableCode(size_t size) {
+    _msg = "Code of " + std::to_string(size) + " bytes cannot be made executable.";
+}
+
+CommandFailed::CommandFailed(const std::string& command) {
+    _msg = "Command " + command + " failed.";
+}
@@ -106,4 +106,29 @@ public:
 class ProcAssignment : public BaseException {
 public:
     ProcAssignment(int line, int col);
+};
+
+class UnencodableCommand : public BaseException {
+public:
+    UnencodableCommand(const std::string& command);
+};
+
+class UndefinedLabel : public BaseException {
+public:
+    UndefinedLabel(const std::string& name);
+};
+
+class UnwritableFile : public BaseException {
+public:
+    UnwritableFile(const std::string& fname);
+};
+
+class UnexecutableCode : public BaseException {
+public:
+    UnexecutableCode(size_t size);
+};
+
+class CommandFailed : public BaseException {
+public:
+    CommandFailed(const std::string& command);
 };
\ No newline at end of file
@@ -6,38 +6,187 @@
 #include "error.h"
 #include "Parser.h"
 #include "AsmGen.h"
+#include "Benchmark.h"
+#include "TestRunner.h"
+#include "BatchCompiler.h"
+#include "Profiler.h"
 
 using namespace std;
 
+struct Options {
+    AsmTarget target;
+    ProgramRunner runner;
+    ProfileFormat profile;
+    unsigned lexThreads;
+    size_t lexChunkSize;
+    string outputFile;
+};
+
+// Options after the mode: -win64 or -linux picks the platform a compiled
+// program is built and run for, the default being the one the compiler runs
+// on; -jit runs the program in memory inside the compiler and -nasm builds a
+// Linux program from the nasm listing with nasm and gcc instead of writing
+// the executable in process; -time prints the time and heap use of every
+// phase of the compilation to stderr as a table, -time=json as JSON;
+// -lexthreads=n lexes the whole source up front on n threads, in chunks of
+// at least -lexchunk=bytes. -o file, read by main, keeps the program built
+// as file.
+static bool parseOption(const char* arg, Options& options) {
+    if (!strcmp(arg, "-win64"))
+        options.target = AsmTarget::Win64;
+    else if (!strcmp(arg, "-linux"))
+        options.target = AsmTarget::SysV;
+    else if (!strcmp(arg, "-jit"))
+        options.runner = ProgramRunner::Jit;
+    else if (!strcmp(arg, "-nasm"))
+        options.runner = ProgramRunner::ExternalAssembler;
+    else if (!strcmp(arg, "-time"))
+        options.profile = ProfileFormat::Table;
+    else if (!strcmp(arg, "-time=json"))
+        options.profile = ProfileFormat::Json;
+    else if (!strncmp(arg, "-lexthreads=", 12))
+        options.lexThreads = (unsigned)strtoul(arg + 12, nullptr, 10);
+    else if (!strncmp(arg, "-lexchunk=", 10))
+        options.lexChunkSize = std::max<size_t>(strtoull(arg + 10, nullptr, 10), 1);
+    else
+        return false;
+    return true;
+}
+
+static void setOutput(Parser& parser, const Options& options, Profiler* profiler) {
+    parser.setTarget(options.target);
+    parser.setRunner(options.runner);
+    parser.setOutputFile(options.outputFile);
+    parser.setProfiler(profiler);
+}
+
+// The code generation modes of the -p options, shared by single file and
+// batch compilation; an empty function for any other argument.
+static function<void(Parser&)> getCompileMode(const char* mode) {
+    if (!strcmp(mode, "-p"))
+        return [](Parser&) {};
+    if (!strcmp(mode, "-pn"))
+        return [](Parser& parser) { parser.getPeephole().setEnabled(false); };
+    if (!strcmp(mode, "-pc"))
+        return [](Parser& parser) { parser.setConstFolding(false); };
+    if (!strcmp(mode, "-pr"))
+        return [](Parser& parser) { parser.setBackend(AsmBackend::Register); };
+    if (!strcmp(mode, "-pi"))
+        return [](Parser& parser) { parser.setIRLowering(true); };
+    if (!strcmp(mode, "-pb"))
+        return [](Parser& parser) { parser.setShortCircuit(true); };
+    if (!strcmp(mode, "-pa"))
+        return [](Parser& parser) { parser.setConstAlignment(16); };
+    return nullptr;
+}
+
 int main(int argc, char *argv[]) {
     try {
-        if (argc == 3) {
-            if (!strcmp(argv[2], "-l")) {
+        Options options = { AsmCode::getHostTarget(), ProgramRunner::Executable, ProfileFormat::None, 0,
+                            Scanner::defaultChunkSize, "" };
+        while (argc > 3) {
+            if (argc > 4 && !strcmp(argv[argc - 2], "-o")) {
+                options.outputFile = argv[argc - 1];
+                argc -= 2;
+            }
+            else if (parseOption(argv[argc - 1], options))
+                --argc;
+            else
+                break;
+        }
+        Profiler profiler;
+        Profiler* activeProfiler = options.profile != ProfileFormat::None ? &profiler : nullptr;
+        if (argc > 2 && !strcmp(argv[1], "-b")) {
+            // -b [mode] files... compiles every file to a listing next to it;
+            // @name reads the file names from a response file, -cache=dir
+            // keeps listings in dir for later builds and -cachesize=n
+            // limits it to n megabytes.
+            int first = 2;
+            auto mode = getCompileMode(argv[2]);
+            if (mode)
+                first = 3;
+            else
+                mode = getCompileMode("-p");
+            BatchCompiler batch([=](Parser& parser) {
+                setOutput(parser, options, nullptr);
+                mode(parser);
+            });
+            string cacheDir;
+            uint64_t cacheSize = 256;
+            for (int i = first; i < argc; ++i) {
+                if (argv[i][0] == '@')
+                    batch.addResponseFile(argv[i] + 1);
+                else if (!strncmp(argv[i], "-cache=", 7))
+                    cacheDir = argv[i] + 7;
+                else if (!strncmp(argv[i], "-cachesize=", 11))
+                    cacheSize = strtoull(argv[i] + 11, nullptr, 10);
+                else
+                    batch.addFile(argv[i]);
+            }
+            unique_ptr<CompileCache> cache;
+            if (!cacheDir.empty()) {
+                cache.reset(new CompileCache(cacheDir, cacheSize << 20));
+                batch.setCache(cache.get());
+            }
+            return batch.run(cout) ? 0 : 1;
+        }
+        else if (argc == 3) {
+            if (!strcmp(argv[1], "-tp")) {
+                return TestRunner(atoi(argv[2])).runGenerator(cout) ? 0 : 1;
+            }
+            else if (!strcmp(argv[2], "-l")) {
                 Scanner scanner(argv[1]);
                 cout << scanner.getTokensString();
             }
-            else if (!strcmp(argv[2], "-p")) {
-                Parser parser(argv[1]);
-                //parser.setSymbolCheck(false);
-                //cout << parser.getNodeTreeStr() << endl;
-                //cout << parser.getDeclStr() << endl;
-                //cout << parser.getStmtStr() << endl;
-                //ofstream tmp("test.bbb");
+            else if (!strcmp(argv[2], "-lp")) {
+                Scanner scanner(argv[1]);
+                scanner.lexParallel(thread::hardware_concurrency());
+                cout << scanner.getTokensString();
+            }
+            else if (auto mode = getCompileMode(argv[2])) {
+                Parser parser(argv[1], true, options.lexThreads, options.lexChunkSize);
+                setOutput(parser, options, activeProfiler);
+                mode(parser);
                 cout << parser.getAsmStr();
             }
+            else if (!strcmp(argv[2], "-ir")) {
+                Parser parser(argv[1], true, options.lexThreads, options.lexChunkSize);
+                setOutput(parser, options, activeProfiler);
+                cout << parser.getIRStr();
+            }
+            else if (!strcmp(argv[2], "-ps")) {
+                Parser parser(argv[1], true, options.lexThreads, options.lexChunkSize);
+                setOutput(parser, options, activeProfiler);
+                cout << parser.getAsmStr();
+                cout << parser.getPeephole().getStatsString();
+            }
+            else if (!strcmp(argv[2], "-bl")) {
+                Benchmark().runLexer(argv[1], cout);
+            }
         }
         else if (argc == 2) {
             if (!strcmp(argv[1], "-t")) {
                 ::testing::InitGoogleTest(&argc, argv);
                 return RUN_ALL_TESTS();
             }
+            else if (!strcmp(argv[1], "-tp")) {
+                return TestRunner().runGenerator(cout) ? 0 : 1;
+            }
+            else if (!strcmp(argv[1], "-bp")) {
+                Benchmark().runParser(cout);
+            }
         }
         else {
             cout << BadArgumentNumber().what();
         }
+        if (options.profile == ProfileFormat::Table)
+            cerr << profiler.getTable();
+        else if (options.profile == ProfileFormat::Json)
+            cerr << profiler.getJson();
     }
     catch (BaseException e) {
         cout << e.what() << endl;
+        return 1;
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,159 @@
+/*
+ * Output runtime linked with every compiled program. write and writeln
+ * append to one large buffer, which is flushed when it fills up and when
+ * the program exits. Integers and reals are formatted by hand; reals print
+ * like printf's "%f" (six decimals, rounded half to even on the exact
+ * binary value). Every function takes at most one integer argument, so the
+ * generated code passes it in the first argument register of the platform
+ * calling convention; a real is passed as its bit pattern. The compiler
+ * links the runtime too, to run programs in memory with the output sent
+ * to a sink instead of stdout. The buffer and the sink belong to the
+ * calling thread, so programs run on several threads at once keep their
+ * output apart; the flush at exit is registered once for the process.
+ */
+#include "pasrt.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_SIZE (1 << 16)
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define THREAD_LOCAL __declspec(thread)
+#define EXCHANGE(flag, value) _InterlockedExchange(&(flag), (value))
+#else
+#define THREAD_LOCAL _Thread_local
+#define EXCHANGE(flag, value) __atomic_exchange_n(&(flag), (value), __ATOMIC_ACQ_REL)
+#endif
+
+static THREAD_LOCAL char buffer[BUFFER_SIZE];
+static THREAD_LOCAL size_t length;
+static THREAD_LOCAL pas_sink sink;
+static volatile long isFlushRegistered;
+
+static void output(const char* data, size_t size) {
+    if (sink)
+        sink(data, size);
+    else
+        fwrite(data, 1, size, stdout);
+}
+
+void pas_flush(void) {
+    output(buffer, length);
+    if (!sink)
+        fflush(stdout);
+    length = 0;
+}
+
+/* Flushes what was written so far, then sends the output to newSink, or
+ * back to stdout when it is NULL. */
+void pas_set_sink(pas_sink newSink) {
+    pas_flush();
+    sink = newSink;
+}
+
+static char* reserve(size_t size) {
+    if (!isFlushRegistered && !EXCHANGE(isFlushRegistered, 1))
+        atexit(pas_flush);
+    if (length + size > BUFFER_SIZE)
+        pas_flush();
+    return buffer + length;
+}
+
+/* Writes the digits of value right-aligned ending at end; returns the first. */
+static char* formatUnsigned(char* end, uint64_t value) {
+    do {
+        *--end = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    return end;
+}
+
+static void appendUnsigned(uint64_t value, int isNegative) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* first = formatUnsigned(end, value);
+    if (isNegative)
+        *--first = '-';
+    size_t size = (size_t)(end - first);
+    memcpy(reserve(size), first, size);
+    length += size;
+}
+
+void pas_write_int(int64_t value) {
+    appendUnsigned(value < 0 ? 0 - (uint64_t)value : (uint64_t)value, value < 0);
+}
+
+void pas_write_str(const char* text) {
+    size_t size = strlen(text);
+    if (size > BUFFER_SIZE) {
+        pas_flush();
+        output(text, size);
+        return;
+    }
+    memcpy(reserve(size), text, size);
+    length += size;
+}
+
+void pas_writeln(void) {
+    *reserve(1) = '\n';
+    ++length;
+}
+
+#ifdef __SIZEOF_INT128__
+/*
+ * value = mantissa * 2^shift exactly; value * 10^6 fits in 128 bits below
+ * 10^18, which is rounded once to an integer count of millionths.
+ */
+static void writeExact(uint64_t bits) {
+    int isNegative = (int)(bits >> 63);
+    int exponent = (int)((bits >> 52) & 0x7ff);
+    uint64_t mantissa = bits & ((UINT64_C(1) << 52) - 1);
+    if (exponent)
+        mantissa |= UINT64_C(1) << 52;
+    else
+        exponent = 1;
+    int shift = exponent - 1075;
+    unsigned __int128 scaled = (unsigned __int128)mantissa * 1000000;
+    if (shift >= 0)
+        scaled <<= shift;
+    else if (-shift >= 128)
+        scaled = 0;
+    else {
+        unsigned __int128 rest = scaled & (((unsigned __int128)1 << -shift) - 1);
+        unsigned __int128 half = (unsigned __int128)1 << (-shift - 1);
+        scaled >>= -shift;
+        if (rest > half || (rest == half && (scaled & 1)))
+            ++scaled;
+    }
+    uint64_t whole = (uint64_t)(scaled / 1000000);
+    uint64_t fraction = (uint64_t)(scaled % 1000000);
+    appendUnsigned(whole, isNegative);
+    char* text = reserve(7);
+    text[0] = '.';
+    for (int i = 6; i > 0; --i) {
+        text[i] = (char)('0' + fraction % 10);
+        fraction /= 10;
+    }
+    length += 7;
+}
+#endif
+
+/* Larger magnitudes, infinities and NaNs are left to snprintf, and so is
+ * every value where the C compiler has no 128-bit integers. */
+void pas_write_real(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+#ifdef __SIZEOF_INT128__
+    if (((bits >> 52) & 0x7ff) != 0x7ff && value < 1e18 && value > -1e18) {
+        writeExact(bits);
+        return;
+    }
+#endif
+    char text[400];
+    snprintf(text, sizeof(text), "%f", value);
+    pas_write_str(text);
+}
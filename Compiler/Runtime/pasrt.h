@@ -0,0 +1,27 @@
+/*
+ * Output runtime of compiled programs (see pasrt.c).
+ */
+#ifndef PASRT_H
+#define PASRT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*pas_sink)(const char* data, size_t size);
+
+void pas_write_int(int64_t value);
+void pas_write_real(uint64_t bits);
+void pas_write_str(const char* text);
+void pas_writeln(void);
+void pas_flush(void);
+void pas_set_sink(pas_sink newSink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif